@@ -0,0 +1,273 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "bus_scheduler.hpp"
+
+#include "endpoint_registry.hpp"
+
+#include <algorithm>
+#include <array>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/post.hpp>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+
+namespace nvmemi::scheduler
+{
+static constexpr size_t priorityCount = static_cast<size_t>(Priority::count);
+
+struct SlotQueue
+{
+    /** @brief Waiting coroutine and the slots it can take */
+    struct Waiter
+    {
+        uint32_t slotMask;
+        std::function<void(size_t)> resume;
+    };
+
+    explicit SlotQueue(size_t slotCount) : busy(slotCount, false)
+    {
+    }
+
+    size_t getOutstanding() const
+    {
+        return static_cast<size_t>(std::count(busy.begin(), busy.end(), true));
+    }
+    size_t getWaiting() const
+    {
+        size_t waiting = 0;
+        for (const auto& queue : waiters)
+        {
+            waiting += queue.size();
+        }
+        return waiting;
+    }
+    /**
+     * @brief Take a free slot out of slotMask, suspending the coroutine until
+     * one is handed over if none is free or others with the same or higher
+     * priority are already waiting
+     *
+     * @return size_t Index of the slot taken
+     */
+    size_t wait(Priority priority, uint32_t slotMask,
+                boost::asio::yield_context yield)
+    {
+        bool queued = false;
+        for (size_t idx = 0; idx <= static_cast<size_t>(priority); idx++)
+        {
+            queued = queued || !waiters[idx].empty();
+        }
+        for (size_t slot = 0; slot < busy.size() && !queued; slot++)
+        {
+            if (!busy[slot] && (slotMask & (1u << slot)) != 0)
+            {
+                busy[slot] = true;
+                return slot;
+            }
+        }
+        // The slot is handed over by the releasing transaction and stays
+        // busy
+        size_t granted = 0;
+        boost::asio::async_initiate<boost::asio::yield_context,
+                                    void(boost::system::error_code)>(
+            [this, priority, slotMask, &granted](auto handler) {
+                auto shared =
+                    std::make_shared<decltype(handler)>(std::move(handler));
+                waiters[static_cast<size_t>(priority)].emplace_back(
+                    Waiter{slotMask, [shared, &granted](size_t slot) {
+                               granted = slot;
+                               auto executor =
+                                   boost::asio::get_associated_executor(
+                                       *shared);
+                               boost::asio::post(executor, [shared]() {
+                                   (*shared)(boost::system::error_code());
+                               });
+                           }});
+            },
+            yield);
+        return granted;
+    }
+    /**
+     * @brief Give a finished transaction's slot to the first waiter with the
+     * highest priority that can take it, or free it if nobody waits
+     *
+     */
+    void handOver(size_t slot)
+    {
+        for (auto& queue : waiters)
+        {
+            for (auto it = queue.begin(); it != queue.end(); it++)
+            {
+                if ((it->slotMask & (1u << slot)) != 0)
+                {
+                    auto resume = std::move(it->resume);
+                    queue.erase(it);
+                    resume(slot);
+                    return;
+                }
+            }
+        }
+        busy[slot] = false;
+    }
+
+    std::vector<bool> busy;
+    /** @brief Waiters per priority, in arrival order */
+    std::array<std::deque<Waiter>, priorityCount> waiters{};
+};
+
+struct Bus : public SlotQueue
+{
+    using SlotQueue::SlotQueue;
+
+    std::string name;
+    std::vector<mctpw::eid_t> endpoints;
+};
+
+static constexpr size_t maxBusSlots = 32;
+static constexpr size_t commandSlots = 2;
+/** @brief Command slots of an endpoint and the bus it is on */
+struct Endpoint : public SlotQueue
+{
+    using SlotQueue::SlotQueue;
+
+    std::shared_ptr<Bus> bus;
+};
+
+static EndpointRegistry<Endpoint> endpoints{};
+static std::unordered_map<std::string, std::shared_ptr<Bus>> buses{};
+static size_t maxOutstanding = 2;
+
+Slot::Slot(std::shared_ptr<SlotQueue> slotQueue, size_t slotIndex) :
+    queue(std::move(slotQueue)), index(slotIndex)
+{
+}
+
+Slot::Slot(Slot&& other) noexcept :
+    queue(std::move(other.queue)), index(other.index)
+{
+}
+
+Slot& Slot::operator=(Slot&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        queue = std::move(other.queue);
+        index = other.index;
+    }
+    return *this;
+}
+
+Slot::~Slot()
+{
+    release();
+}
+
+void Slot::release()
+{
+    if (queue)
+    {
+        queue->handOver(index);
+        queue.reset();
+    }
+}
+
+size_t Slot::getIndex() const
+{
+    return index;
+}
+
+void setMaxOutstanding(size_t limit)
+{
+    maxOutstanding = std::clamp<size_t>(limit, 1, maxBusSlots);
+}
+
+size_t getMaxOutstanding()
+{
+    return maxOutstanding;
+}
+
+void registerEndpoint(mctpw::eid_t eid, const std::string& busName,
+                      const void* owner)
+{
+    unregisterEndpoint(eid);
+    std::string name =
+        busName.empty() ? "eid_" + std::to_string(eid) : busName;
+    auto& bus = buses[name];
+    if (!bus)
+    {
+        bus = std::make_shared<Bus>(maxOutstanding);
+        bus->name = name;
+    }
+    bus->endpoints.emplace_back(eid);
+    endpoints.add(eid, owner, commandSlots).bus = bus;
+}
+
+void unregisterEndpoint(mctpw::eid_t eid, const void* owner)
+{
+    std::shared_ptr<Endpoint> endpoint = endpoints.share(eid);
+    if (!endpoint || !endpoints.remove(eid, owner))
+    {
+        return;
+    }
+    std::shared_ptr<Bus> bus = endpoint->bus;
+    auto& members = bus->endpoints;
+    members.erase(std::remove(members.begin(), members.end(), eid),
+                  members.end());
+    // Slots still held keep the bus alive until the transactions finish
+    if (members.empty())
+    {
+        buses.erase(bus->name);
+    }
+}
+
+Grant acquire(mctpw::eid_t eid, Priority priority,
+              boost::asio::yield_context yield)
+{
+    std::shared_ptr<Endpoint> endpoint = endpoints.share(eid);
+    std::shared_ptr<Bus> bus = endpoint ? endpoint->bus : nullptr;
+    if (!endpoint || !bus)
+    {
+        return Grant();
+    }
+    if (priority >= Priority::count)
+    {
+        priority = Priority::bulk;
+    }
+    // Bulk transfers stay on slot 0 so that slot 1 is always left for the
+    // health polls and short requests
+    uint32_t commandSlotMask = priority == Priority::bulk ? 0x1 : 0x3;
+    Grant grant;
+    size_t commandSlot = endpoint->wait(priority, commandSlotMask, yield);
+    grant.endpoint = Slot(endpoint, commandSlot);
+    size_t busSlot = bus->wait(priority, 0xFFFFFFFF, yield);
+    grant.bus = Slot(bus, busSlot);
+    return grant;
+}
+
+std::vector<BusStatus> getBuses()
+{
+    std::vector<BusStatus> status;
+    for (const auto& [name, bus] : buses)
+    {
+        status.emplace_back(BusStatus{name, bus->endpoints,
+                                      bus->getOutstanding(),
+                                      bus->getWaiting()});
+    }
+    return status;
+}
+} // namespace nvmemi::scheduler
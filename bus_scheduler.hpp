@@ -0,0 +1,132 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <boost/asio/spawn.hpp>
+#include <cstdint>
+#include <mctp_wrapper.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nvmemi::scheduler
+{
+/**
+ * @brief Order in which waiting transactions get a free slot
+ *
+ */
+enum class Priority : uint8_t
+{
+    /** @brief Health status polls feeding the sensors */
+    health,
+    /** @brief Identify, features and configuration requests */
+    inventory,
+    /** @brief Log page reads */
+    bulk,
+    count
+};
+
+struct SlotQueue;
+
+/**
+ * @brief Right to have one transaction outstanding on an endpoint command
+ * slot or a bus. The slot is passed to the next waiter or freed when the
+ * object is destroyed.
+ *
+ */
+class Slot
+{
+  public:
+    Slot() = default;
+    Slot(std::shared_ptr<SlotQueue> slotQueue, size_t slotIndex);
+    Slot(const Slot&) = delete;
+    Slot& operator=(const Slot&) = delete;
+    Slot(Slot&& other) noexcept;
+    Slot& operator=(Slot&& other) noexcept;
+    ~Slot();
+
+    void release();
+    size_t getIndex() const;
+
+  private:
+    std::shared_ptr<SlotQueue> queue;
+    size_t index = 0;
+};
+
+/**
+ * @brief Slots held by one transaction. The bus is released before the
+ * endpoint. The index of the endpoint slot is the NVMe-MI command slot to
+ * send the request on.
+ *
+ */
+struct Grant
+{
+    Slot endpoint;
+    Slot bus;
+};
+
+/**
+ * @brief Set the number of transactions allowed to be outstanding on each
+ * bus. Applies to the buses created afterwards.
+ *
+ * @param limit Transactions per bus, 1 to 32
+ */
+void setMaxOutstanding(size_t limit);
+size_t getMaxOutstanding();
+
+/**
+ * @brief Attach an endpoint to a bus. Endpoints without a known bus get a
+ * bus of their own.
+ *
+ * @param eid MCTP EID
+ * @param busName Name identifying the physical bus
+ * @param owner Object the endpoint is registered for
+ */
+void registerEndpoint(mctpw::eid_t eid, const std::string& busName,
+                      const void* owner = nullptr);
+/**
+ * @brief Free the entry of an endpoint
+ *
+ * @param eid MCTP EID
+ * @param owner Owner given at registration. The entry is kept if the endpoint
+ * was registered for an other owner since. nullptr frees it anyway.
+ */
+void unregisterEndpoint(mctpw::eid_t eid, const void* owner = nullptr);
+
+/**
+ * @brief Wait for a free NVMe-MI command slot of the endpoint, then for a
+ * free slot on its bus. Each endpoint has two command slots; bulk transfers
+ * only use slot 0. Waiters are served by priority, then in arrival order.
+ * Returns right away with command slot 0 for endpoints that are not
+ * registered.
+ *
+ * @param eid MCTP EID the transaction is sent to
+ * @param priority Priority of the transaction
+ * @param yield yield_context of the calling coroutine
+ * @return Grant Slots to be held until the response is received
+ */
+Grant acquire(mctpw::eid_t eid, Priority priority,
+              boost::asio::yield_context yield);
+
+struct BusStatus
+{
+    std::string name;
+    std::vector<mctpw::eid_t> endpoints;
+    size_t outstanding;
+    size_t waiting;
+};
+std::vector<BusStatus> getBuses();
+} // namespace nvmemi::scheduler
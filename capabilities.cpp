@@ -0,0 +1,186 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "capabilities.hpp"
+
+#include "endpoint_registry.hpp"
+#include "protocol/admin/admin_cmd.hpp"
+#include "protocol/admin/get_log_page.hpp"
+#include "protocol/mi_msg.hpp"
+
+
+namespace nvmemi::capabilities
+{
+using LogPage = nvmemi::protocol::getlog::LogPage;
+using MiOpCode = nvmemi::protocol::MiOpCode;
+using AdminOpCode = nvmemi::protocol::AdminOpCode;
+
+static EndpointRegistry<Capabilities> endpoints{};
+
+/** @brief NVMe-MI message types in the optional command entries */
+static constexpr uint8_t miCommandType = 1;
+static constexpr uint8_t adminCommandType = 2;
+
+Support Capabilities::get(Kind kind, uint8_t id) const noexcept
+{
+    if (kind >= Kind::count)
+    {
+        return Support::unknown;
+    }
+    return entries[static_cast<size_t>(kind)][id];
+}
+
+void Capabilities::set(Kind kind, uint8_t id, Support support) noexcept
+{
+    if (kind >= Kind::count)
+    {
+        return;
+    }
+    Support& entry = entries[static_cast<size_t>(kind)][id];
+    if (entry != Support::unsupported)
+    {
+        entry = support;
+    }
+}
+
+void Capabilities::setOptionalCommands(
+    const std::vector<std::pair<uint8_t, uint8_t>>& commands) noexcept
+{
+    // Commands every management endpoint has to support
+    auto isMandatory = [](uint8_t type, uint8_t opcode) {
+        if (type == miCommandType)
+        {
+            return opcode <= static_cast<uint8_t>(MiOpCode::reset);
+        }
+        return opcode == static_cast<uint8_t>(AdminOpCode::getLogPage) ||
+               opcode == static_cast<uint8_t>(AdminOpCode::identify) ||
+               opcode == static_cast<uint8_t>(AdminOpCode::getFeatures);
+    };
+    std::array<std::array<bool, 256>, 2> listed{};
+    for (const auto& [type, opcode] : commands)
+    {
+        if (type == miCommandType || type == adminCommandType)
+        {
+            listed[type - miCommandType][opcode] = true;
+        }
+    }
+    for (uint8_t type : {miCommandType, adminCommandType})
+    {
+        Kind kind =
+            type == miCommandType ? Kind::miCommand : Kind::adminCommand;
+        for (size_t opcode = 0; opcode < 256; opcode++)
+        {
+            auto op = static_cast<uint8_t>(opcode);
+            if (listed[type - miCommandType][opcode] || isMandatory(type, op))
+            {
+                set(kind, op, Support::supported);
+            }
+            else
+            {
+                set(kind, op, Support::unsupported);
+            }
+        }
+    }
+}
+
+void Capabilities::setIdentifyController(const uint8_t* data,
+                                         size_t size) noexcept
+{
+    static constexpr size_t cmicOffset = 76;
+    static constexpr size_t oaesOffset = 92;
+    static constexpr size_t ctrattOffset = 96;
+    static constexpr size_t oacsOffset = 256;
+    static constexpr size_t lpaOffset = 261;
+    if (data == nullptr || size <= lpaOffset)
+    {
+        return;
+    }
+    auto bit = [data](size_t offset, unsigned bitIdx) {
+        return (data[offset + bitIdx / 8] & (1 << (bitIdx % 8))) != 0;
+    };
+    auto setLogPage = [this](LogPage logPage, bool supported) {
+        set(Kind::logPage, static_cast<uint8_t>(logPage),
+            supported ? Support::supported : Support::unsupported);
+    };
+    setLogPage(LogPage::errorInformation, true);
+    setLogPage(LogPage::smartHealthInformation, true);
+    setLogPage(LogPage::firmwareSlotInformation, true);
+    // Namespace Attribute Notices
+    setLogPage(LogPage::changedNamespaceList, bit(oaesOffset, 8));
+    setLogPage(LogPage::commandsSupportedEffects, bit(lpaOffset, 1));
+    // Device Self-test command
+    setLogPage(LogPage::deviceSelfTest, bit(oacsOffset, 4));
+    setLogPage(LogPage::telemetryHostInitiated, bit(lpaOffset, 3));
+    setLogPage(LogPage::telemetryControllerInitiated, bit(lpaOffset, 3));
+    // Endurance Groups
+    setLogPage(LogPage::enduranceGroupInformation, bit(ctrattOffset, 4));
+    setLogPage(LogPage::enduranceGroupEventAggregate, bit(ctrattOffset, 4));
+    // Predictable Latency Mode
+    setLogPage(LogPage::predictableLatencyPerNVMSet, bit(ctrattOffset, 5));
+    setLogPage(LogPage::predictableLatencyEventAggregate,
+               bit(ctrattOffset, 5));
+    // Asymmetric Namespace Access Reporting
+    setLogPage(LogPage::asymmetricNamespaceAccess, bit(cmicOffset, 3));
+    setLogPage(LogPage::persistentEventLog, bit(lpaOffset, 4));
+}
+
+void Capabilities::setCommandsSupported(const uint8_t* data,
+                                        size_t size) noexcept
+{
+    static constexpr size_t entrySize = sizeof(uint32_t);
+    static constexpr uint8_t commandSupported = 0x01;
+    for (size_t opcode = 0; opcode < 256 && (opcode + 1) * entrySize <= size;
+         opcode++)
+    {
+        set(Kind::adminCommand, static_cast<uint8_t>(opcode),
+            (data[opcode * entrySize] & commandSupported) != 0
+                ? Support::supported
+                : Support::unsupported);
+    }
+}
+
+bool isUnsupportedStatus(uint8_t miStatus, uint32_t cqDword3) noexcept
+{
+    static constexpr uint8_t miInvalidOpcode = 0x03;
+    static constexpr uint8_t miInvalidParameter = 0x04;
+    static constexpr uint8_t genericStatusType = 0x00;
+    static constexpr uint8_t invalidCommandOpcode = 0x01;
+    static constexpr uint8_t invalidField = 0x02;
+    if (miStatus == miInvalidOpcode || miStatus == miInvalidParameter)
+    {
+        return true;
+    }
+    auto statusCode = static_cast<uint8_t>((cqDword3 >> 17) & 0xFF);
+    auto statusType = static_cast<uint8_t>((cqDword3 >> 25) & 0x07);
+    return statusType == genericStatusType &&
+           (statusCode == invalidCommandOpcode || statusCode == invalidField);
+}
+
+Capabilities& registerEndpoint(mctpw::eid_t eid, const void* owner)
+{
+    return endpoints.add(eid, owner);
+}
+
+void unregisterEndpoint(mctpw::eid_t eid, const void* owner)
+{
+    endpoints.remove(eid, owner);
+}
+
+Capabilities* getEndpoint(mctpw::eid_t eid) noexcept
+{
+    return endpoints.get(eid);
+}
+} // namespace nvmemi::capabilities
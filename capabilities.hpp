@@ -0,0 +1,166 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mctp_wrapper.hpp>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace nvmemi::capabilities
+{
+enum class Support : uint8_t
+{
+    unknown,
+    supported,
+    unsupported
+};
+
+/**
+ * @brief Kind of request a capability entry is kept for
+ *
+ */
+enum class Kind : uint8_t
+{
+    /** @brief NVMe-MI command by MI opcode */
+    miCommand,
+    /** @brief Admin command by admin opcode */
+    adminCommand,
+    /** @brief Get Log Page by log page identifier */
+    logPage,
+    /** @brief Get Features by feature identifier */
+    feature,
+    count
+};
+
+/**
+ * @brief Requests a drive can answer. Built once from the optional commands
+ * list, Identify Controller and the Commands Supported and Effects log, and
+ * extended with the requests the drive rejected. An entry marked unsupported
+ * stays unsupported.
+ *
+ */
+class Capabilities
+{
+  public:
+    Support get(Kind kind, uint8_t id) const noexcept;
+    void set(Kind kind, uint8_t id, Support support) noexcept;
+    bool isUnsupported(Kind kind, uint8_t id) const noexcept
+    {
+        return get(kind, id) == Support::unsupported;
+    }
+
+    /**
+     * @brief Learn the optional MI and admin commands from the Optional
+     * Commands Supported data structure. Optional commands not listed are
+     * not supported on the management endpoint.
+     *
+     * @param commands Pairs of NVMe-MI message type and opcode
+     */
+    void setOptionalCommands(
+        const std::vector<std::pair<uint8_t, uint8_t>>& commands) noexcept;
+    /**
+     * @brief Learn the log pages from the Identify Controller data structure
+     *
+     * @param data Identify Controller data, at least up to the LPA field
+     * @param size Size of the data
+     */
+    void setIdentifyController(const uint8_t* data, size_t size) noexcept;
+    /**
+     * @brief Learn the admin commands from the Commands Supported and Effects
+     * log page
+     *
+     * @param data Admin command entries at the start of the log page
+     * @param size Size of the data
+     */
+    void setCommandsSupported(const uint8_t* data, size_t size) noexcept;
+
+    /**
+     * @brief Forget everything, for a drive whose firmware or configuration
+     * changed
+     *
+     */
+    void reset() noexcept
+    {
+        *this = Capabilities();
+    }
+    bool isDiscovered() const noexcept
+    {
+        return discovered;
+    }
+    void setDiscovered() noexcept
+    {
+        discovered = true;
+    }
+    /**
+     * @brief Number of requests not sent because the drive does not
+     * support them
+     *
+     */
+    size_t getSkipped() const noexcept
+    {
+        return skipped;
+    }
+    void addSkipped() noexcept
+    {
+        skipped++;
+    }
+
+  private:
+    static constexpr size_t kindCount = static_cast<size_t>(Kind::count);
+    std::array<std::array<Support, 256>, kindCount> entries{};
+    bool discovered = false;
+    size_t skipped = 0;
+};
+
+/**
+ * @brief Check if a response status means the request is not supported:
+ * Invalid Opcode or Invalid Parameter in the NVMe-MI status, or Invalid
+ * Command Opcode or Invalid Field in Command in the admin completion
+ *
+ * @param miStatus NVMe-MI response message status
+ * @param cqDword3 Completion queue entry dword 3 of admin responses, 0
+ * otherwise
+ */
+bool isUnsupportedStatus(uint8_t miStatus, uint32_t cqDword3) noexcept;
+
+/**
+ * @brief Create the capabilities of an endpoint
+ *
+ * @param eid MCTP EID
+ * @param owner Object the endpoint is registered for. An endpoint registered
+ * for an other owner starts with nothing known.
+ */
+Capabilities& registerEndpoint(mctpw::eid_t eid, const void* owner = nullptr);
+/**
+ * @brief Free the entry of an endpoint
+ *
+ * @param eid MCTP EID
+ * @param owner Owner given at registration. The entry is kept if the endpoint
+ * was registered for an other owner since. nullptr frees it anyway.
+ */
+void unregisterEndpoint(mctpw::eid_t eid, const void* owner = nullptr);
+/**
+ * @brief Get the capabilities of an endpoint
+ *
+ * @param eid MCTP EID
+ * @return Capabilities* nullptr if the endpoint is not registered
+ */
+Capabilities* getEndpoint(mctpw::eid_t eid) noexcept;
+} // namespace nvmemi::capabilities
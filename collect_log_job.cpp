@@ -0,0 +1,283 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "collect_log_job.hpp"
+
+#include "constants.hpp"
+
+#include <deque>
+#include <phosphor-logging/log.hpp>
+
+using nvmemi::CollectLogJob;
+
+CollectLogJob::CollectLogJob(sdbusplus::asio::object_server& objServerIn,
+                             const std::string& objPath,
+                             const std::vector<std::string>& sections,
+                             Task taskIn) :
+    objServer(objServerIn),
+    objectPath(objPath), task(std::move(taskIn))
+{
+    for (const auto& section : sections)
+    {
+        sectionStatus.emplace_back(
+            section, getSectionStatusName(SectionStatus::pending));
+    }
+    std::string interfaceName =
+        nvmemi::constants::interfacePrefix + std::string("drive_log_job");
+    jobInterface = objServer.add_interface(objectPath, interfaceName);
+    jobInterface->register_property("State",
+                                    std::string(getStateName(state)));
+    jobInterface->register_property("Progress", static_cast<uint8_t>(0));
+    jobInterface->register_property("Sections", sectionStatus);
+    jobInterface->register_property("Status", static_cast<int32_t>(0));
+    jobInterface->register_property("Result", std::string());
+    jobInterface->register_method("Cancel", [this]() { cancel(); });
+    jobInterface->register_signal<std::string, int32_t, std::string>(
+        "Completed");
+    jobInterface->initialize();
+}
+
+CollectLogJob::~CollectLogJob()
+{
+    objServer.remove_interface(jobInterface);
+}
+
+void CollectLogJob::run(boost::asio::yield_context yield)
+{
+    if (isFinished())
+    {
+        return;
+    }
+    setState(State::running);
+    std::tuple<int, std::string> result;
+    try
+    {
+        result = task(yield, *this);
+    }
+    catch (const std::exception& e)
+    {
+        result = std::make_tuple(-1, std::string(e.what()));
+    }
+    // Task can hold references to the drive, release them as soon as done
+    task = nullptr;
+    auto& [status, message] = result;
+    if (cancelRequested)
+    {
+        finish(State::cancelled, status, "Cancelled");
+    }
+    else
+    {
+        finish(status == 0 ? State::completed : State::failed, status,
+               message);
+    }
+}
+
+void CollectLogJob::cancel()
+{
+    if (isFinished())
+    {
+        return;
+    }
+    cancelRequested = true;
+    if (state == State::queued)
+    {
+        finish(State::cancelled, -1, "Cancelled");
+    }
+}
+
+bool CollectLogJob::isCancelRequested() const
+{
+    return cancelRequested;
+}
+
+bool CollectLogJob::isFinished() const
+{
+    return state != State::queued && state != State::running;
+}
+
+CollectLogJob::State CollectLogJob::getState() const
+{
+    return state;
+}
+
+const std::string& CollectLogJob::getObjectPath() const
+{
+    return objectPath;
+}
+
+static bool isTerminal(const std::string& statusName)
+{
+    using SectionStatus = CollectLogJob::SectionStatus;
+    return statusName !=
+               CollectLogJob::getSectionStatusName(SectionStatus::pending) &&
+           statusName !=
+               CollectLogJob::getSectionStatusName(SectionStatus::running);
+}
+
+void CollectLogJob::setSectionStatus(const std::string& section,
+                                     SectionStatus status)
+{
+    for (auto& [name, statusName] : sectionStatus)
+    {
+        if (name != section)
+        {
+            continue;
+        }
+        bool wasTerminal = isTerminal(statusName);
+        statusName = getSectionStatusName(status);
+        if (!wasTerminal && isTerminal(statusName))
+        {
+            sectionsDone++;
+        }
+        jobInterface->set_property("Sections", sectionStatus);
+        jobInterface->set_property(
+            "Progress",
+            static_cast<uint8_t>(sectionsDone * 100 / sectionStatus.size()));
+        return;
+    }
+}
+
+const char* CollectLogJob::getStateName(State state)
+{
+    switch (state)
+    {
+        case State::queued:
+            return "Queued";
+        case State::running:
+            return "Running";
+        case State::completed:
+            return "Completed";
+        case State::failed:
+            return "Failed";
+        case State::cancelled:
+            return "Cancelled";
+        default:
+            return "Unknown";
+    }
+}
+
+const char* CollectLogJob::getSectionStatusName(SectionStatus status)
+{
+    switch (status)
+    {
+        case SectionStatus::pending:
+            return "Pending";
+        case SectionStatus::running:
+            return "Running";
+        case SectionStatus::completed:
+            return "Completed";
+        case SectionStatus::failed:
+            return "Failed";
+        case SectionStatus::skipped:
+            return "Skipped";
+        default:
+            return "Unknown";
+    }
+}
+
+void CollectLogJob::setState(State newState)
+{
+    state = newState;
+    jobInterface->set_property("State", std::string(getStateName(state)));
+}
+
+void CollectLogJob::finish(State finalState, int status,
+                           const std::string& result)
+{
+    for (auto& [name, statusName] : sectionStatus)
+    {
+        if (!isTerminal(statusName))
+        {
+            statusName = getSectionStatusName(SectionStatus::skipped);
+        }
+    }
+    sectionsDone = sectionStatus.size();
+    jobInterface->set_property("Sections", sectionStatus);
+    jobInterface->set_property("Progress", static_cast<uint8_t>(100));
+    jobInterface->set_property("Status", static_cast<int32_t>(status));
+    jobInterface->set_property("Result", result);
+    setState(finalState);
+
+    phosphor::logging::log<phosphor::logging::level::INFO>(
+        "Collect log job finished",
+        phosphor::logging::entry("JOB=%s", objectPath.c_str()),
+        phosphor::logging::entry("STATE=%s", getStateName(finalState)));
+    try
+    {
+        auto signal = jobInterface->new_signal("Completed");
+        signal.append(std::string(getStateName(finalState)),
+                      static_cast<int32_t>(status), result);
+        signal.signal_send();
+    }
+    catch (const std::exception& e)
+    {
+        phosphor::logging::log<phosphor::logging::level::ERR>(
+            "Error sending Completed signal",
+            phosphor::logging::entry("MSG=%s", e.what()));
+    }
+}
+
+namespace nvmemi::collectlog
+{
+static std::deque<std::shared_ptr<CollectLogJob>> queue{};
+static size_t workerCount = 0;
+static size_t concurrencyLimit = 2;
+
+static void runQueue(boost::asio::yield_context yield)
+{
+    while (!queue.empty())
+    {
+        auto job = std::move(queue.front());
+        queue.pop_front();
+        job->run(yield);
+    }
+    workerCount--;
+}
+
+void setConcurrencyLimit(size_t limit)
+{
+    concurrencyLimit = limit == 0 ? 1 : limit;
+}
+
+size_t getConcurrencyLimit()
+{
+    return concurrencyLimit;
+}
+
+void enqueue(std::shared_ptr<CollectLogJob> job,
+             boost::asio::yield_context yield)
+{
+    queue.emplace_back(std::move(job));
+    if (workerCount < concurrencyLimit)
+    {
+        workerCount++;
+        boost::asio::spawn(
+            yield, [](boost::asio::yield_context workerYield) {
+                runQueue(workerYield);
+            });
+    }
+}
+
+size_t getQueuedCount()
+{
+    return queue.size();
+}
+
+size_t getRunningCount()
+{
+    return workerCount;
+}
+} // namespace nvmemi::collectlog
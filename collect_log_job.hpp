@@ -0,0 +1,140 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <boost/asio/spawn.hpp>
+#include <functional>
+#include <memory>
+#include <sdbusplus/asio/object_server.hpp>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace nvmemi
+{
+/**
+ * @brief Log collection running in the background. Exposes its state,
+ * progress and the status of each log section on DBus, can be cancelled and
+ * emits a Completed signal when it is done.
+ *
+ */
+class CollectLogJob
+{
+  public:
+    enum class State : uint8_t
+    {
+        queued,
+        running,
+        completed,
+        failed,
+        cancelled
+    };
+    enum class SectionStatus : uint8_t
+    {
+        pending,
+        running,
+        completed,
+        failed,
+        skipped
+    };
+    /**
+     * @brief Function doing the actual collection. Returns the status code
+     * and the dump file name or the error message, same as CollectLog.
+     *
+     */
+    using Task = std::function<std::tuple<int, std::string>(
+        boost::asio::yield_context, CollectLogJob&)>;
+
+    /**
+     * @brief Construct a new CollectLogJob object
+     *
+     * @param objServer Existing sdbusplus object_server
+     * @param objPath Object path for the job
+     * @param sections Names of the log sections the task will collect
+     * @param task Function collecting the log
+     */
+    CollectLogJob(sdbusplus::asio::object_server& objServer,
+                  const std::string& objPath,
+                  const std::vector<std::string>& sections, Task task);
+    CollectLogJob(const CollectLogJob&) = delete;
+    CollectLogJob& operator=(const CollectLogJob&) = delete;
+    ~CollectLogJob();
+
+    /**
+     * @brief Run the task unless the job was cancelled while queued
+     *
+     * @param yield yield_context object to wait on mctp transfers
+     */
+    void run(boost::asio::yield_context yield);
+    /**
+     * @brief Cancel the job. A queued job is cancelled right away. A running
+     * job stops before the next section.
+     *
+     */
+    void cancel();
+    bool isCancelRequested() const;
+    bool isFinished() const;
+    State getState() const;
+    const std::string& getObjectPath() const;
+    /**
+     * @brief Update the status of a section. Progress is the share of the
+     * sections that are no longer pending or running.
+     *
+     * @param section Name of the section as passed to the constructor
+     * @param status New status
+     */
+    void setSectionStatus(const std::string& section, SectionStatus status);
+
+    static const char* getStateName(State state);
+    static const char* getSectionStatusName(SectionStatus status);
+
+  private:
+    void setState(State newState);
+    void finish(State finalState, int status, const std::string& result);
+
+    sdbusplus::asio::object_server& objServer;
+    std::shared_ptr<sdbusplus::asio::dbus_interface> jobInterface{};
+    std::string objectPath;
+    Task task;
+    State state = State::queued;
+    bool cancelRequested = false;
+    std::vector<std::tuple<std::string, std::string>> sectionStatus{};
+    size_t sectionsDone = 0;
+};
+
+namespace collectlog
+{
+/**
+ * @brief Set the number of jobs that can run at the same time across all
+ * the drives. Jobs beyond the limit wait in a FIFO queue.
+ *
+ * @param limit Maximum number of running jobs. 0 is treated as 1.
+ */
+void setConcurrencyLimit(size_t limit);
+size_t getConcurrencyLimit();
+/**
+ * @brief Add a job to the daemon wide queue. A new worker coroutine is
+ * spawned if the concurrency limit allows.
+ *
+ * @param job Job to run
+ * @param yield yield_context of the caller, used to spawn the worker
+ */
+void enqueue(std::shared_ptr<CollectLogJob> job,
+             boost::asio::yield_context yield);
+size_t getQueuedCount();
+size_t getRunningCount();
+} // namespace collectlog
+} // namespace nvmemi
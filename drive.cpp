@@ -16,33 +16,56 @@
 
 #include "drive.hpp"
 
+#include "bus_scheduler.hpp"
+#include "capabilities.hpp"
 #include "constants.hpp"
+#include "dump_store.hpp"
+#include "fru.hpp"
+#include "log_profile.hpp"
+#include "metrics.hpp"
 #include "protocol/admin/admin_cmd.hpp"
 #include "protocol/admin/admin_rsp.hpp"
 #include "protocol/admin/feature_id.hpp"
 #include "protocol/admin/get_log_page.hpp"
 #include "protocol/admin/identify.hpp"
+#include "protocol/mi/configuration.hpp"
 #include "protocol/mi/controller_hs_poll.hpp"
 #include "protocol/mi/read_nvmemi_ds.hpp"
 #include "protocol/mi/subsystem_hs_poll.hpp"
 #include "protocol/mi_msg.hpp"
 #include "protocol/mi_rsp.hpp"
-
-#include <fstream>
+#include "response_buffer.hpp"
+#include "retry_policy.hpp"
+#include "rtt_estimator.hpp"
+#include "single_flight.hpp"
+#include "utils.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <nlohmann/json.hpp>
 #include <phosphor-logging/log.hpp>
-#include <regex>
+#include <tuple>
 
 using nvmemi::Drive;
+using nvmemi::HealthSample;
 using nvmemi::thresholds::Threshold;
 using DataStructureType = nvmemi::protocol::readnvmeds::DataStructureType;
+using ResponseClass = nvmemi::timeouts::ResponseClass;
+using CapabilityKind = nvmemi::capabilities::Kind;
+using SMBusFrequency = nvmemi::protocol::configuration::SMBusFrequency;
 
 static constexpr double nvmeTemperatureMin = -128.0;
 static constexpr double nvmeTemperatureMax = 127.0;
-static const std::chrono::milliseconds normalRespTimeout{600};
-static const std::chrono::milliseconds longRespTimeout{3000};
 static constexpr uint32_t globalNamespaceId = 0xFFFFFFFF;
 static constexpr uint32_t clearedNamespaceId = 0x00000000;
+static bool clearStatusPolling = false;
+static bool thresholdProgramming = false;
+static bool messageLogging = false;
+static SMBusFrequency maxSMBusFrequency = SMBusFrequency::notSupported;
+static uint16_t maxMctpUnitSize = 0;
 
 static std::vector<Threshold> getDefaultThresholds()
 {
@@ -59,9 +82,12 @@ static std::vector<Threshold> getDefaultThresholds()
 
 Drive::Drive(const std::string& driveName, mctpw::eid_t eid,
              sdbusplus::asio::object_server& objServer,
-             std::shared_ptr<mctpw::MCTPWrapper> wrapper) :
-    name(std::regex_replace(driveName, std::regex("[^a-zA-Z0-9_/]+"), "_")),
-    mctpWrapper(wrapper),
+             std::shared_ptr<mctpw::MCTPWrapper> wrapper,
+             std::shared_ptr<Transport> mctpTransport) :
+    name(nvmemi::utils::sanitizeName(driveName)),
+    transport(mctpTransport ? std::move(mctpTransport)
+                            : std::make_shared<MctpwTransport>(wrapper)),
+    objectServer(objServer),
     subsystemTemp(objServer, driveName + "_Temp", getDefaultThresholds(),
                   nvmeTemperatureMin, nvmeTemperatureMax),
     mctpEid(eid)
@@ -75,28 +101,274 @@ Drive::Drive(const std::string& driveName, mctpw::eid_t eid,
 
     if (!this->driveLogInterface->register_method(
             "CollectLog", [this](boost::asio::yield_context yield) {
-                pausePollRequested = true;
                 std::tuple<int, std::string> status;
                 try
                 {
-                    status = this->collectDriveLog(yield);
+                    status = this->collectDriveLog(
+                        yield, nvmemi::logprofile::allSections);
                 }
                 catch (std::exception& e)
                 {
                     status = std::make_tuple(-1, std::string(e.what()));
                 }
-                pausePollRequested = false;
                 return status;
             }))
     {
         throw std::runtime_error("Register method failed: CollectLog");
     }
+    if (!this->driveLogInterface->register_method(
+            "CollectLogSelective",
+            [this](boost::asio::yield_context yield, const std::string& profile,
+                   const uint32_t sectionMask) {
+                uint32_t sections =
+                    nvmemi::logprofile::resolveSections(profile, sectionMask);
+                std::tuple<int, std::string> status;
+                try
+                {
+                    status = this->collectDriveLog(yield, sections);
+                }
+                catch (std::exception& e)
+                {
+                    status = std::make_tuple(-1, std::string(e.what()));
+                }
+                return status;
+            }))
+    {
+        throw std::runtime_error("Register method failed: CollectLogSelective");
+    }
+    if (!this->driveLogInterface->register_method(
+            "StartCollectLog",
+            [this](boost::asio::yield_context yield, const std::string& profile,
+                   const uint32_t sectionMask) {
+                uint32_t sections =
+                    nvmemi::logprofile::resolveSections(profile, sectionMask);
+                return sdbusplus::message::object_path(
+                    this->startCollectLogJob(yield, sections));
+            }))
+    {
+        throw std::runtime_error("Register method failed: StartCollectLog");
+    }
+    // Timestamp, NVM subsystem status, SMART warnings, composite temperature,
+    // percentage drive life used, composite controller status
+    using HealthRecord =
+        std::tuple<uint64_t, uint8_t, uint8_t, uint8_t, uint8_t, uint16_t>;
+    if (!this->driveLogInterface->register_method(
+            "GetHealthHistory", [this](const uint64_t since) {
+                std::vector<HealthRecord> records;
+                for (const auto& sample : healthHistory.read(
+                         static_cast<uint32_t>(std::min<uint64_t>(
+                             since, std::numeric_limits<uint32_t>::max()))))
+                {
+                    records.emplace_back(
+                        sample.timestamp, sample.data[0], sample.data[1],
+                        sample.data[2], sample.data[3],
+                        static_cast<uint16_t>(sample.data[4] |
+                                              sample.data[5] << 8));
+                }
+                return records;
+            }))
+    {
+        throw std::runtime_error("Register method failed: GetHealthHistory");
+    }
     if (!this->driveLogInterface->register_property("EID", eid))
     {
         phosphor::logging::log<phosphor::logging::level::ERR>(
             "Error registering EID property");
     }
+    // Readings restored from the state file until the first poll
+    if (!this->driveLogInterface->register_property("Stale", false))
+    {
+        phosphor::logging::log<phosphor::logging::level::ERR>(
+            "Error registering Stale property");
+    }
+    if (!this->driveLogInterface->register_property(
+            "Paths", std::vector<mctpw::eid_t>{eid}))
+    {
+        phosphor::logging::log<phosphor::logging::level::ERR>(
+            "Error registering Paths property");
+    }
     driveLogInterface->initialize();
+    registerPath(eid, wrapper);
+    paths.emplace_back(eid);
+    thresholdsPending = thresholdProgramming;
+    portsPending = isPortNegotiationEnabled();
+    inventoryPending = true;
+    subsystemTemp.setThresholdsChangedHandler(
+        [this]() { thresholdsPending = thresholdProgramming; });
+}
+
+Drive::~Drive()
+{
+    for (auto eid : paths)
+    {
+        unregisterPath(eid);
+    }
+}
+
+void Drive::registerPath(mctpw::eid_t eid,
+                         const std::shared_ptr<mctpw::MCTPWrapper>& wrapper)
+{
+    nvmemi::metrics::registerEndpoint(eid, this);
+    nvmemi::timeouts::registerEndpoint(eid, this);
+    nvmemi::capabilities::registerEndpoint(eid, this);
+    nvmemi::retry::registerEndpoint(eid, this);
+    // mctpd runs one service per physical bus, EIDs sharing the service name
+    // share the bus bandwidth
+    std::string busName;
+    const auto& endpoints = wrapper->getEndpointMap();
+    if (auto it = endpoints.find(eid); it != endpoints.end())
+    {
+        busName = it->second.second;
+    }
+    nvmemi::scheduler::registerEndpoint(eid, busName, this);
+}
+
+void Drive::unregisterPath(mctpw::eid_t eid)
+{
+    // A drive kept alive by a job or coroutine must not free the entries of
+    // a newer drive on the same EID
+    nvmemi::metrics::unregisterEndpoint(eid, this);
+    nvmemi::timeouts::unregisterEndpoint(eid, this);
+    nvmemi::capabilities::unregisterEndpoint(eid, this);
+    nvmemi::retry::unregisterEndpoint(eid, this);
+    nvmemi::scheduler::unregisterEndpoint(eid, this);
+}
+
+void Drive::addPath(mctpw::eid_t eid,
+                    const std::shared_ptr<mctpw::MCTPWrapper>& wrapper)
+{
+    if (std::find(paths.begin(), paths.end(), eid) != paths.end())
+    {
+        return;
+    }
+    registerPath(eid, wrapper);
+    paths.emplace_back(eid);
+    publishPaths();
+}
+
+bool Drive::removePath(mctpw::eid_t eid)
+{
+    auto it = std::find(paths.begin(), paths.end(), eid);
+    if (it == paths.end() || paths.size() == 1)
+    {
+        return false;
+    }
+    paths.erase(it);
+    unregisterPath(eid);
+    if (mctpEid == eid)
+    {
+        mctpEid = paths.front();
+        // The new path has not answered yet
+        curErrorCount = 0;
+    }
+    publishPaths();
+    return true;
+}
+
+void Drive::failOver()
+{
+    if (paths.size() < 2)
+    {
+        return;
+    }
+    auto it = std::find(paths.begin(), paths.end(), mctpEid);
+    if (it == paths.end() || ++it == paths.end())
+    {
+        it = paths.begin();
+    }
+    phosphor::logging::log<phosphor::logging::level::WARNING>(
+        "Drive path failed, switching to the next path",
+        phosphor::logging::entry("DRIVE=%s", name.c_str()),
+        phosphor::logging::entry("EID=%d", mctpEid),
+        phosphor::logging::entry("NEXT_EID=%d", *it));
+    mctpEid = *it;
+    publishPaths();
+}
+
+void Drive::publishPaths()
+{
+    driveLogInterface->set_property("EID", mctpEid);
+    driveLogInterface->set_property("Paths", paths);
+}
+
+mctpw::eid_t Drive::getEid() const
+{
+    return mctpEid;
+}
+
+const std::vector<mctpw::eid_t>& Drive::getPaths() const
+{
+    return paths;
+}
+
+const std::optional<std::string>& Drive::getSubsystemId() const
+{
+    return subsystemId;
+}
+
+void Drive::setSubsystemId(std::optional<std::string> id)
+{
+    subsystemId = std::move(id);
+}
+
+void Drive::setPresence(bool present)
+{
+    if (present)
+    {
+        curErrorCount = 0;
+        refreshPending = true;
+        thresholdsPending = thresholdProgramming;
+        portsPending = isPortNegotiationEnabled();
+        inventoryPending = true;
+        return;
+    }
+    subsystemTemp.updateValue(std::numeric_limits<double>::quiet_NaN());
+}
+
+const std::string& Drive::getName() const
+{
+    return name;
+}
+
+nvmemi::DriveState Drive::getState() const
+{
+    return DriveState{name, mctpEid, lastHealth, cwarnState, curErrorCount};
+}
+
+void Drive::restoreState(const DriveState& state, std::chrono::seconds maxAge)
+{
+    cwarnState = state.criticalWarning;
+    // Polling is given another try even if it had stopped before
+    curErrorCount = std::min<uint8_t>(state.errorCount,
+                                      maxHealthStatusCount - 1);
+    if (!state.lastHealth)
+    {
+        return;
+    }
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    if (now - std::chrono::seconds(state.lastHealth->timestamp) > maxAge)
+    {
+        return;
+    }
+    lastHealth = state.lastHealth;
+    healthHistory.add(*lastHealth);
+    try
+    {
+        using nvmemi::protocol::subsystemhs::convertToCelsius;
+        subsystemTemp.updateValue(
+            convertToCelsius(lastHealth->data[HealthSample::temperatureIdx]));
+    }
+    catch (const std::exception&)
+    {
+        return;
+    }
+    setStale(true);
+}
+
+void Drive::setStale(bool stale)
+{
+    driveLogInterface->set_property("Stale", stale);
 }
 
 template <typename It>
@@ -112,16 +384,214 @@ static std::string getHexString(It begin, It end)
     return ss.str();
 }
 
-void Drive::pollSubsystemHealthStatus(boost::asio::yield_context yield)
+/**
+ * @brief Set a flag for the lifetime of the guard, so that it is cleared
+ * even if the guarded code throws
+ *
+ */
+class FlagGuard
 {
-    if (curErrorCount >= maxHealthStatusCount)
+  public:
+    explicit FlagGuard(bool& flagIn) : flag(flagIn)
     {
-        return;
+        flag = true;
+    }
+    ~FlagGuard()
+    {
+        flag = false;
     }
-    if (pausePollRequested)
+    FlagGuard(const FlagGuard&) = delete;
+    FlagGuard& operator=(const FlagGuard&) = delete;
+
+  private:
+    bool& flag;
+};
+
+/**
+ * @brief Log a request or response in hex at DEBUG level. Formatting costs
+ * the io_context thread on every request, so nothing is formatted unless
+ * message logging is enabled.
+ *
+ */
+template <typename It>
+static void logMessage(const char* label, It begin, It end)
+{
+    if (!messageLogging)
     {
         return;
     }
+    phosphor::logging::log<phosphor::logging::level::DEBUG>(
+        (label + getHexString(begin, end)).c_str());
+}
+
+/**
+ * @brief Check if the drive is known not to support a request. Such requests
+ * are skipped instead of waiting for an error or a timeout.
+ *
+ */
+static bool isUnsupported(mctpw::eid_t eid, CapabilityKind kind, uint8_t id)
+{
+    auto capabilities = nvmemi::capabilities::getEndpoint(eid);
+    if (capabilities == nullptr || !capabilities->isUnsupported(kind, id))
+    {
+        return false;
+    }
+    capabilities->addSkipped();
+    phosphor::logging::log<phosphor::logging::level::DEBUG>(
+        "Skipped request not supported by the drive",
+        phosphor::logging::entry("EID=%d", eid),
+        phosphor::logging::entry("KIND=%d", kind),
+        phosphor::logging::entry("ID=%d", id));
+    return true;
+}
+
+/**
+ * @brief Remember the request if the drive rejected it as not supported
+ *
+ * @return true if the request is not supported
+ */
+static bool checkUnsupported(
+    mctpw::eid_t eid, CapabilityKind kind, uint8_t id,
+    const nvmemi::protocol::AdminCommandResponse<const uint8_t*>& adminRsp)
+{
+    if (!nvmemi::capabilities::isUnsupportedStatus(
+            adminRsp.getStatus(), le32toh(adminRsp->sqdword3)))
+    {
+        return false;
+    }
+    if (auto capabilities = nvmemi::capabilities::getEndpoint(eid))
+    {
+        capabilities->set(kind, id,
+                          nvmemi::capabilities::Support::unsupported);
+    }
+    return true;
+}
+
+/**
+ * @brief Send a request and wait for the response. The timeout is estimated
+ * from the previous response times of the EID for the response class.
+ * Latency, outcome and bytes transferred are recorded against the EID and
+ * command. The request waits for a free command slot of the EID and for its
+ * bus. Health polls are served first, then inventory requests and then log
+ * page reads. The request is sent on the command slot it was given.
+ */
+static std::pair<boost::system::error_code, std::vector<uint8_t>>
+    transact(nvmemi::Transport& transport, mctpw::eid_t eid,
+             boost::asio::yield_context yield,
+             const std::vector<uint8_t>& request, ResponseClass responseClass)
+{
+    using Priority = nvmemi::scheduler::Priority;
+    Priority priority = Priority::inventory;
+    if (responseClass == ResponseClass::healthPoll)
+    {
+        priority = Priority::health;
+    }
+    else if (responseClass == ResponseClass::logPage)
+    {
+        priority = Priority::bulk;
+    }
+    // Held until the response arrives. Time spent waiting for the EID and
+    // the bus is not part of the round trip time.
+    auto grant = nvmemi::scheduler::acquire(eid, priority, yield);
+    auto commandSlot = static_cast<nvmemi::protocol::CommandSlot>(
+        grant.endpoint.getIndex());
+    std::vector<uint8_t> slotRequest;
+    const std::vector<uint8_t>* sendBuffer = &request;
+    if (commandSlot != nvmemi::protocol::CommandSlot::slot0)
+    {
+        slotRequest = request;
+        nvmemi::protocol::NVMeMessage msg(slotRequest);
+        msg.setCommandSlot(commandSlot);
+        msg.setCRC();
+        sendBuffer = &slotRequest;
+    }
+    auto timeout = nvmemi::timeouts::getTimeout(eid, responseClass);
+    auto start = std::chrono::steady_clock::now();
+    auto result = transport.sendReceive(yield, eid, *sendBuffer, timeout);
+    // Responses of the two slots are told apart by the command slot bit
+    using Response = nvmemi::protocol::NVMeMessage<const uint8_t*>;
+    if (!result.first &&
+        result.second.size() >= Response::minSize + sizeof(Response::CRC32C) &&
+        Response(result.second.data(), result.second.size())
+                .getCommandSlot() != commandSlot)
+    {
+        phosphor::logging::log<phosphor::logging::level::WARNING>(
+            "Response received for the other command slot",
+            phosphor::logging::entry("EID=%d", eid));
+        result.first = boost::system::errc::make_error_code(
+            boost::system::errc::bad_message);
+    }
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    auto outcome =
+        nvmemi::metrics::classifyResponse(result.first, result.second);
+    // Lookup after the transfer since the drive could be removed meanwhile
+    if (auto stats = nvmemi::metrics::getEndpoint(eid))
+    {
+        stats->record(nvmemi::metrics::classifyRequest(request), outcome,
+                      latency, request.size(), result.second.size());
+    }
+    if (auto estimator = nvmemi::timeouts::getEstimator(eid, responseClass))
+    {
+        if (outcome == nvmemi::metrics::Outcome::timeout)
+        {
+            estimator->onTimeout();
+        }
+        else if (outcome != nvmemi::metrics::Outcome::transportError)
+        {
+            // Response with bad CRC still gives a valid round trip time
+            estimator->addSample(latency);
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Send a request and wait for the response. Read requests identical to
+ * one in flight to the same EID wait for its response instead of being sent
+ * again. Failures are retried according to the retry policy of their error
+ * class. Lost or corrupted responses are only retried for idempotent
+ * requests, other requests may have taken effect.
+ */
+static std::pair<boost::system::error_code, std::vector<uint8_t>>
+    sendReceive(nvmemi::Transport& transport, mctpw::eid_t eid,
+                boost::asio::yield_context yield,
+                const std::vector<uint8_t>& request,
+                ResponseClass responseClass)
+{
+    bool readOnly = nvmemi::retry::isIdempotent(request);
+    return nvmemi::singleflight::run(
+        eid, request, yield,
+        [&transport, eid, &request, responseClass,
+         readOnly](boost::asio::yield_context flightYield) {
+            return nvmemi::retry::run(
+                eid, flightYield,
+                [&transport, eid, &request,
+                 responseClass](boost::asio::yield_context retryYield) {
+                    return transact(transport, eid, retryYield, request,
+                                    responseClass);
+                },
+                readOnly);
+        });
+}
+
+bool Drive::pollSubsystemHealthStatus(boost::asio::yield_context yield)
+{
+    if (curErrorCount >= maxHealthStatusCount)
+    {
+        return false;
+    }
+    // First poll of a new drive can overlap with the regular poll sweep
+    if (pollInProgress)
+    {
+        return false;
+    }
+    if (clearStatusPolling && quietPolls >= quietPollsBeforeSlowdown &&
+        ++skippedPolls < slowPollDivider)
+    {
+        return false;
+    }
+    skippedPolls = 0;
     using Message = nvmemi::protocol::ManagementInterfaceMessage<uint8_t*>;
     using DWord1 = nvmemi::protocol::subsystemhs::RequestDWord1;
     using Response = nvmemi::protocol::subsystemhs::ResponseData;
@@ -131,37 +601,37 @@ void Drive::pollSubsystemHealthStatus(boost::asio::yield_context yield)
     nvmemi::protocol::ManagementInterfaceMessage reqMsg(reqBuffer);
     reqMsg.setMiOpCode(nvmemi::protocol::MiOpCode::subsystemHealthStatusPoll);
     auto dword1 = reinterpret_cast<DWord1*>(reqMsg.getDWord1());
-    dword1->clearStatus = false;
+    dword1->clearStatus = clearStatusPolling;
     reqMsg.setCRC();
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        getHexString(reqBuffer.begin(), reqBuffer.end()).c_str());
+    logMessage("Subsystem health status poll request ", reqBuffer.begin(),
+               reqBuffer.end());
 
-    auto [ec, response] = mctpWrapper->sendReceiveYield(
-        yield, this->mctpEid, reqBuffer, hsPollTimeout);
+    boost::system::error_code ec;
+    std::vector<uint8_t> response;
+    {
+        FlagGuard inProgress(pollInProgress);
+        std::tie(ec, response) =
+            sendReceive(*transport, this->mctpEid, yield, reqBuffer,
+                        ResponseClass::healthPoll);
+    }
     if (ec)
     {
         phosphor::logging::log<phosphor::logging::level::ERR>(
             "Poll Subsystem health status error",
             phosphor::logging::entry("MSG=%s", ec.message().c_str()));
-        ++curErrorCount;
-
-        if (curErrorCount == maxHealthStatusCount)
-        {
-            phosphor::logging::log<phosphor::logging::level::ERR>(
-                "Excluded from the polling, reached max limit",
-                phosphor::logging::entry("DRIVE=%s", this->name.c_str()));
-        }
-        return;
+        onPollFailure();
+        return false;
     }
     if (!validateResponse(response))
     {
-        ++curErrorCount;
-        return;
+        onPollFailure();
+        return false;
     }
     curErrorCount = 0;
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        getHexString(response.begin(), response.end()).c_str());
+    logMessage("Subsystem health status poll response ", response.begin(),
+               response.end());
 
+    bool updated = false;
     try
     {
         nvmemi::protocol::ManagementInterfaceResponse respMsg(response);
@@ -171,16 +641,169 @@ void Drive::pollSubsystemHealthStatus(boost::asio::yield_context yield)
             throw std::runtime_error("Optional data not found");
         }
         auto respPtr = reinterpret_cast<const Response*>(optData);
-        auto temperature =
-            nvmemi::protocol::subsystemhs::convertToCelsius(respPtr->cTemp);
-        this->subsystemTemp.updateValue(temperature);
-        this->logCWarnState(respPtr->ccs.criticalWarning);
+        if (static_cast<size_t>(len) >= sizeof(HealthSample::data))
+        {
+            HealthSample sample{};
+            sample.timestamp = static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count());
+            std::copy_n(optData, sample.data.size(), sample.data.begin());
+            healthHistory.add(sample);
+            lastHealth = sample;
+        }
+        if (clearStatusPolling)
+        {
+            handleStatusChanges(*respPtr);
+        }
+        else
+        {
+            auto temperature = nvmemi::protocol::subsystemhs::convertToCelsius(
+                respPtr->cTemp);
+            this->subsystemTemp.updateValue(temperature);
+            this->logCWarnState(respPtr->ccs.criticalWarning);
+        }
+        setStale(false);
+        updated = true;
     }
     catch (const std::exception& e)
     {
         phosphor::logging::log<phosphor::logging::level::WARNING>(
             (std::string("NVM Poll error. ") + e.what()).c_str());
     }
+    // Set up once the drive answers. The setup runs in its own coroutine so
+    // that it does not hold up the poll sweep.
+    if (!setupInProgress &&
+        (portsPending || thresholdsPending || inventoryPending))
+    {
+        setupInProgress = true;
+        boost::asio::spawn(yield, [self = shared_from_this()](
+                                      boost::asio::yield_context setupYield) {
+            self->runPendingSetup(setupYield);
+        });
+    }
+    return updated;
+}
+
+void Drive::onPollFailure()
+{
+    ++curErrorCount;
+    failOver();
+    if (curErrorCount == maxHealthStatusCount)
+    {
+        phosphor::logging::log<phosphor::logging::level::ERR>(
+            "Excluded from the polling, reached max limit",
+            phosphor::logging::entry("DRIVE=%s", this->name.c_str()));
+    }
+}
+
+void Drive::runPendingSetup(boost::asio::yield_context yield)
+{
+    try
+    {
+        if (portsPending)
+        {
+            portsPending = false;
+            // Polls would time out while the port settings change
+            FlagGuard inProgress(pollInProgress);
+            negotiatePortSettings(yield);
+        }
+        if (inventoryPending)
+        {
+            inventoryPending = false;
+            refreshInventory(yield);
+        }
+        if (thresholdsPending)
+        {
+            thresholdsPending = false;
+            programTemperatureThresholds(yield);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        phosphor::logging::log<phosphor::logging::level::ERR>(
+            "Drive setup failed",
+            phosphor::logging::entry("DRIVE=%s", name.c_str()),
+            phosphor::logging::entry("MSG=%s", e.what()));
+    }
+    setupInProgress = false;
+}
+
+void Drive::setClearStatusPolling(bool enable)
+{
+    clearStatusPolling = enable;
+}
+
+void Drive::setThresholdProgramming(bool enable)
+{
+    thresholdProgramming = enable;
+}
+
+void Drive::setMessageLogging(bool enable)
+{
+    messageLogging = enable;
+}
+
+void Drive::setPortLimits(SMBusFrequency smbusFrequency, uint16_t mctpUnitSize)
+{
+    maxSMBusFrequency = smbusFrequency;
+    maxMctpUnitSize = mctpUnitSize;
+}
+
+bool Drive::isPortNegotiationEnabled()
+{
+    return maxSMBusFrequency != SMBusFrequency::notSupported ||
+           maxMctpUnitSize != 0;
+}
+
+void Drive::handleStatusChanges(
+    const nvmemi::protocol::subsystemhs::ResponseData& health)
+{
+    namespace subsystemhs = nvmemi::protocol::subsystemhs;
+    uint16_t changes = subsystemhs::getChanges(health.ccs);
+    // Changes from before the first poll were not seen
+    if (refreshPending)
+    {
+        changes = subsystemhs::changeMask;
+        refreshPending = false;
+    }
+    if (changes == 0)
+    {
+        if (quietPolls < quietPollsBeforeSlowdown)
+        {
+            quietPolls++;
+        }
+    }
+    else
+    {
+        quietPolls = 0;
+    }
+    static constexpr uint16_t configurationChanges =
+        subsystemhs::resetOccured | subsystemhs::controllerEnableChanged |
+        subsystemhs::namespaceAttributeChanged | subsystemhs::firmwareActivated;
+    if ((changes & configurationChanges) != 0)
+    {
+        if (auto capabilities = nvmemi::capabilities::getEndpoint(mctpEid))
+        {
+            capabilities->reset();
+        }
+        // Thresholds that are not saved are lost on a controller reset
+        thresholdsPending = thresholdProgramming;
+        phosphor::logging::log<phosphor::logging::level::INFO>(
+            "Drive configuration changed",
+            phosphor::logging::entry("DRIVE=%s", this->name.c_str()),
+            phosphor::logging::entry("CHANGES=0x%04x", changes));
+    }
+    // The warning clearing does not set a change flag, so an asserted
+    // warning is checked on every poll
+    if ((changes & subsystemhs::criticalWarning) != 0 || cwarnState)
+    {
+        logCWarnState(subsystemhs::hasCriticalWarning(health.smartWarnings));
+    }
+    if ((changes & subsystemhs::compositeTemperatureChange) != 0)
+    {
+        subsystemTemp.updateValue(subsystemhs::convertToCelsius(health.cTemp));
+    }
 }
 
 void Drive::logCWarnState(bool cwarn)
@@ -216,11 +839,15 @@ void Drive::logCWarnState(bool cwarn)
     }
 }
 
-static std::pair<const uint8_t*, ssize_t>
-    getNVMeDatastructOptionalData(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
-                                  boost::asio::yield_context yield,
-                                  DataStructureType dsType, uint8_t portId,
-                                  uint16_t controllerId)
+/**
+ * @brief Read an NVMe-MI data structure
+ *
+ * @return nvmemi::ResponseBuffer Optional response data of the response
+ */
+static nvmemi::ResponseBuffer getNVMeDatastructOptionalData(
+    nvmemi::Transport& transport, mctpw::eid_t eid,
+    boost::asio::yield_context yield, DataStructureType dsType, uint8_t portId,
+    uint16_t controllerId)
 {
     using MIRequest =
         nvmemi::protocol::ManagementInterfaceMessage<const uint8_t*>;
@@ -236,22 +863,18 @@ static std::pair<const uint8_t*, ssize_t>
     reqPtr->portId = portId;
     reqMsg.setCRC();
 
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        ("ReadNVMe data structure request " +
-         getHexString(requestBuffer.begin(), requestBuffer.end()))
-            .c_str());
+    logMessage("ReadNVMe data structure request ", requestBuffer.begin(),
+               requestBuffer.end());
 
-    auto [ec, response] =
-        wrapper.sendReceiveYield(yield, eid, requestBuffer, normalRespTimeout);
+    auto [ec, response] = sendReceive(transport, eid, yield, requestBuffer,
+                                      ResponseClass::normal);
     if (ec)
     {
         throw boost::system::system_error(ec);
     }
 
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        ("ReadNVMe data structure response " +
-         getHexString(response.begin(), response.end()))
-            .c_str());
+    logMessage("ReadNVMe data structure response ", response.begin(),
+               response.end());
 
     nvmemi::protocol::ManagementInterfaceResponse miRsp(response);
     // TODO Check status code
@@ -261,67 +884,66 @@ static std::pair<const uint8_t*, ssize_t>
         throw std::runtime_error("Optional data not found in response");
     }
 
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        ("Optional data " + getHexString(data, data + len)).c_str());
+    logMessage("Optional data ", data, data + len);
 
-    return std::make_pair(data, len);
+    return nvmemi::ResponseBuffer(std::move(response),
+                                  nvmemi::ByteView(data, len));
 }
 
-static nvmemi::protocol::readnvmeds::SubsystemInfo
-    getSubsystemInfo(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+using SubsystemInfo = nvmemi::protocol::readnvmeds::SubsystemInfo;
+
+static nvmemi::ResponseStruct<SubsystemInfo>
+    getSubsystemInfo(nvmemi::Transport& transport, mctpw::eid_t eid,
                      boost::asio::yield_context yield)
 {
-    auto [data, len] = getNVMeDatastructOptionalData(
-        wrapper, eid, yield, DataStructureType::nvmSubsystemInfo, 0, 0);
-    using SubsystemInfo = nvmemi::protocol::readnvmeds::SubsystemInfo;
-    if (len < static_cast<ssize_t>(sizeof(SubsystemInfo)))
+    auto payload = getNVMeDatastructOptionalData(
+        transport, eid, yield, DataStructureType::nvmSubsystemInfo, 0, 0);
+    if (payload.size() < sizeof(SubsystemInfo))
     {
         throw std::runtime_error("Expected more bytes for subsystem info");
     }
-    auto subsystemInfo = reinterpret_cast<const SubsystemInfo*>(data);
-    return *subsystemInfo;
+    return nvmemi::ResponseStruct<SubsystemInfo>(std::move(payload));
 }
 
-static std::optional<std::string> getPortInfo(mctpw::MCTPWrapper& wrapper,
+static std::optional<std::string> getPortInfo(nvmemi::Transport& transport,
                                               mctpw::eid_t eid, uint8_t portId,
                                               boost::asio::yield_context yield)
 {
-    auto [data, len] = getNVMeDatastructOptionalData(
-        wrapper, eid, yield, DataStructureType::portInfo, portId, 0);
-    return getHexString(data, data + len);
+    auto payload = getNVMeDatastructOptionalData(
+        transport, eid, yield, DataStructureType::portInfo, portId, 0);
+    return getHexString(payload.begin(), payload.end());
 }
 
-std::vector<uint16_t> getControllerList(mctpw::MCTPWrapper& wrapper,
+std::vector<uint16_t> getControllerList(nvmemi::Transport& transport,
                                         mctpw::eid_t eid,
                                         boost::asio::yield_context yield)
 {
-    auto [data, len] = getNVMeDatastructOptionalData(
-        wrapper, eid, yield, DataStructureType::controllerList, 0, 0);
+    auto payload = getNVMeDatastructOptionalData(
+        transport, eid, yield, DataStructureType::controllerList, 0, 0);
     std::vector<uint16_t> controllerList;
-    int i = 0;
-    if (len % 2 == 1)
+    if (payload.size() % 2 == 1)
     {
         throw std::invalid_argument("Expected even number of bytes");
     }
-    for (i = 0; i < len; i = i + sizeof(uint16_t))
+    for (size_t i = 0; i < payload.size(); i = i + sizeof(uint16_t))
     {
-        auto controllerId = reinterpret_cast<const uint16_t*>(data + i);
-        controllerList.emplace_back(le16toh(*controllerId));
+        controllerList.emplace_back(
+            static_cast<uint16_t>(payload[i] | payload[i + 1] << 8));
     }
     return controllerList;
 }
 
-std::optional<std::string> getControllerInfo(mctpw::MCTPWrapper& wrapper,
+std::optional<std::string> getControllerInfo(nvmemi::Transport& transport,
                                              mctpw::eid_t eid,
                                              uint16_t controllerId,
                                              boost::asio::yield_context yield)
 {
     try
     {
-        auto [data, len] = getNVMeDatastructOptionalData(
-            wrapper, eid, yield, DataStructureType::controllerInfo, 0,
+        auto payload = getNVMeDatastructOptionalData(
+            transport, eid, yield, DataStructureType::controllerInfo, 0,
             controllerId);
-        return getHexString(data, data + len);
+        return getHexString(payload.begin(), payload.end());
     }
     catch (const std::exception& e)
     {
@@ -335,41 +957,49 @@ std::optional<std::string> getControllerInfo(mctpw::MCTPWrapper& wrapper,
 }
 
 std::vector<std::pair<nvmemi::protocol::NVMeMessageTye, uint8_t>>
-    getOptionalCommands(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    getOptionalCommands(nvmemi::Transport& transport, mctpw::eid_t eid,
                         boost::asio::yield_context yield)
 {
     static constexpr uint8_t cmdMask = 0x78;
     static constexpr uint8_t cmdIdx = 3;
     std::vector<std::pair<nvmemi::protocol::NVMeMessageTye, uint8_t>>
         optionalCommands;
-    auto [data, len] = getNVMeDatastructOptionalData(
-        wrapper, eid, yield, DataStructureType::optionalCommands, 0, 0);
+    auto payload = getNVMeDatastructOptionalData(
+        transport, eid, yield, DataStructureType::optionalCommands, 0, 0);
     // Optional commands starts from index 2.
-    for (int idx = 2; (idx + 1) < len; idx = idx + sizeof(uint16_t))
+    for (size_t idx = 2; (idx + 1) < payload.size();
+         idx = idx + sizeof(uint16_t))
     {
         optionalCommands.emplace_back(
             static_cast<nvmemi::protocol::NVMeMessageTye>(
-                (data[idx] & cmdMask) >> cmdIdx),
-            data[idx + 1]);
+                (payload[idx] & cmdMask) >> cmdIdx),
+            payload[idx + 1]);
     }
     return optionalCommands;
 }
 
+/**
+ * @brief Read the health of all the controllers of the subsystem, one page of
+ * controllers at a time. Pages follow each other from the last controller ID
+ * reported, so they are read one after the other. The number of pages is
+ * bounded by the 16 bit controller ID space.
+ */
 std::optional<nlohmann::json>
-    getControllerHSPollResponse(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    getControllerHSPollResponse(nvmemi::Transport& transport, mctpw::eid_t eid,
                                 boost::asio::yield_context yield)
 {
+    namespace controllerhspoll = nvmemi::protocol::controllerhspoll;
     using Request = nvmemi::protocol::ManagementInterfaceMessage<uint8_t*>;
-    uint8_t respEntries = 0;
-    uint8_t totalRespEntries = 0;
-    constexpr uint8_t maximumEntries = 0xFE;
-    uint8_t nextStartId = 0;
-    constexpr uint8_t maxLoopCount = 32;
-    uint8_t responseCount = 0;
-    std::string hexString;
-    do
-    {
-        if (++responseCount >= maxLoopCount)
+    using controllerhspoll::ControllerHealth;
+    constexpr size_t pageEntries = controllerhspoll::maxEntriesPerPage;
+    // Every page but the last, empty one advances the start ID
+    constexpr size_t maxPages = std::numeric_limits<uint16_t>::max() + 2;
+    std::vector<ControllerHealth> controllers;
+    controllers.reserve(pageEntries);
+    std::optional<uint16_t> nextStartId = 0;
+    for (size_t page = 0; nextStartId; page++)
+    {
+        if (page == maxPages)
         {
             phosphor::logging::log<phosphor::logging::level::ERR>(
                 "GetControllerHSPollResponse: exceed limit");
@@ -380,63 +1010,86 @@ std::optional<nlohmann::json>
             Request::minSize + sizeof(Request::CRC32C), 0x00);
         Request msg(requestBuffer);
         msg.setMiOpCode(nvmemi::protocol::MiOpCode::controllerHealthStatusPoll);
-        auto dword0 =
-            reinterpret_cast<nvmemi::protocol::controllerhspoll::DWord0*>(
-                msg.getDWord0());
+        auto dword0 = reinterpret_cast<controllerhspoll::DWord0*>(
+            msg.getDWord0());
 
-        dword0->maxEntries = maximumEntries;
-        dword0->startId = nextStartId;
-        dword0->reportAll = true;
+        uint16_t startId = *nextStartId;
+        *dword0 = controllerhspoll::getPageRequest(startId, pageEntries);
         msg.setCRC();
 
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            ("GetControllerHSPollResponse request " +
-             getHexString(requestBuffer.begin(), requestBuffer.end()))
-                .c_str());
+        logMessage("GetControllerHSPollResponse request ",
+                   requestBuffer.begin(), requestBuffer.end());
 
-        auto [ec, response] = wrapper.sendReceiveYield(
-            yield, eid, requestBuffer, normalRespTimeout);
+        auto [ec, response] = sendReceive(transport, eid, yield, requestBuffer,
+                                          ResponseClass::normal);
         if (ec)
         {
             phosphor::logging::log<phosphor::logging::level::ERR>(
                 ("GetControllerHSPollResponse: " + ec.message()).c_str());
             return std::nullopt;
         }
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            ("GetControllerHSPollResponse response " +
-             getHexString(response.begin(), response.end()))
-                .c_str());
+        logMessage("GetControllerHSPollResponse response ", response.begin(),
+                   response.end());
 
         nvmemi::protocol::ManagementInterfaceResponse miRsp(response);
+        if (miRsp.getStatus() != 0)
+        {
+            phosphor::logging::log<phosphor::logging::level::ERR>(
+                "GetControllerHSPollResponse: Error status",
+                phosphor::logging::entry("STATUS=%d", miRsp.getStatus()),
+                phosphor::logging::entry("STARTID=%d", startId));
+            return std::nullopt;
+        }
         auto nvmeMiResponse = miRsp.getNVMeManagementResponse();
-        respEntries = nvmeMiResponse.first[2];
-        totalRespEntries += respEntries;
-        nextStartId += respEntries;
-
-        // TODO Check status code
+        size_t respEntries = nvmeMiResponse.first[2];
         auto [data, len] = miRsp.getOptionalResponseData();
-        if (len <= 0)
+        size_t available =
+            len > 0 ? static_cast<size_t>(len) / sizeof(ControllerHealth) : 0;
+        if (available < respEntries)
         {
-            uint8_t startId = dword0->startId;
             phosphor::logging::log<phosphor::logging::level::WARNING>(
-                "GetControllerHSPollResponse: Optional data not found for",
+                "GetControllerHSPollResponse: Entries missing for",
                 phosphor::logging::entry("STARTID=%d", startId));
-
-            continue;
+            respEntries = available;
+        }
+        if (respEntries == 0)
+        {
+            break;
         }
-        hexString += getHexString(data, data + len);
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            ("Optional data " + hexString).c_str());
-    } while (maximumEntries == respEntries);
 
+        size_t first = controllers.size();
+        controllers.resize(first + respEntries);
+        std::memcpy(controllers.data() + first, data,
+                    respEntries * sizeof(ControllerHealth));
+        nextStartId = controllerhspoll::getNextStartId(
+            startId, respEntries, le16toh(controllers.back().controllerId));
+    }
+
+    nlohmann::json controllersJson = nlohmann::json::array();
+    for (const auto& controller : controllers)
+    {
+        nlohmann::json controllerJson;
+        controllerJson["ControllerId"] = le16toh(controller.controllerId);
+        controllerJson["Status"] = le16toh(controller.controllerStatus);
+        controllerJson["CompositeTemperature"] =
+            le16toh(controller.compositeTemperature);
+        controllerJson["PercentageUsed"] = controller.percentageUsed;
+        controllerJson["AvailableSpare"] = controller.availableSpare;
+        controllerJson["CriticalWarning"] = controller.criticalWarning;
+        controllerJson["ChangedFlags"] = le16toh(controller.changedFlags);
+        controllersJson.emplace_back(std::move(controllerJson));
+    }
+    auto bytes = reinterpret_cast<const uint8_t*>(controllers.data());
     nlohmann::json jsonObject;
-    jsonObject["Entries"] = totalRespEntries;
-    jsonObject["Data"] = hexString;
+    jsonObject["Entries"] = controllers.size();
+    jsonObject["Data"] = getHexString(
+        bytes, bytes + controllers.size() * sizeof(ControllerHealth));
+    jsonObject["Controllers"] = std::move(controllersJson);
     return jsonObject;
 }
 
 std::string
-    getSubsystemHealthStatusPollResponse(mctpw::MCTPWrapper& wrapper,
+    getSubsystemHealthStatusPollResponse(nvmemi::Transport& transport,
                                          mctpw::eid_t eid,
                                          boost::asio::yield_context yield)
 {
@@ -450,21 +1103,17 @@ std::string
             msg.getDWord1());
     dword1->clearStatus = false;
     msg.setCRC();
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        ("SubsystemHealthStatusPollResponse request " +
-         getHexString(requestBuffer.begin(), requestBuffer.end()))
-            .c_str());
+    logMessage("SubsystemHealthStatusPollResponse request ",
+               requestBuffer.begin(), requestBuffer.end());
 
-    auto [ec, response] =
-        wrapper.sendReceiveYield(yield, eid, requestBuffer, normalRespTimeout);
+    auto [ec, response] = sendReceive(transport, eid, yield, requestBuffer,
+                                      ResponseClass::normal);
     if (ec)
     {
         throw boost::system::system_error(ec);
     }
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        ("SubsystemHealthStatusPollResponse response " +
-         getHexString(response.begin(), response.end()))
-            .c_str());
+    logMessage("SubsystemHealthStatusPollResponse response ", response.begin(),
+               response.end());
 
     nvmemi::protocol::ManagementInterfaceResponse miRsp(response);
     // TODO Check status code
@@ -476,35 +1125,36 @@ std::string
     return getHexString(data, data + len);
 }
 
-std::vector<uint8_t> getNVMeMiResponseData(mctpw::MCTPWrapper& wrapper,
-                                           mctpw::eid_t eid,
-                                           boost::asio::yield_context yield,
-                                           const uint32_t dword0,
-                                           const uint32_t dword1 = 0)
+/**
+ * @brief Send a Configuration Get or Configuration Set request
+ *
+ * @return nvmemi::ResponseBuffer NVMe management response of the response
+ */
+nvmemi::ResponseBuffer getNVMeMiResponseData(
+    nvmemi::Transport& transport, mctpw::eid_t eid,
+    boost::asio::yield_context yield, const uint32_t dword0,
+    const uint32_t dword1 = 0,
+    nvmemi::protocol::MiOpCode opCode = nvmemi::protocol::MiOpCode::configGet)
 {
     using Request = nvmemi::protocol::ManagementInterfaceMessage<uint8_t*>;
     std::vector<uint8_t> requestBuffer(
         Request::minSize + sizeof(Request::CRC32C), 0x00);
-    Request msg(requestBuffer, nvmemi::protocol::MiOpCode::configGet);
+    Request msg(requestBuffer, opCode);
     msg->dword0 = htole32(dword0);
     msg->dword1 = htole32(dword1);
     msg.setCRC();
 
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        ("getNVMeMiResponseData request " +
-         getHexString(requestBuffer.begin(), requestBuffer.end()))
-            .c_str());
+    logMessage("getNVMeMiResponseData request ", requestBuffer.begin(),
+               requestBuffer.end());
 
-    auto [ec, response] =
-        wrapper.sendReceiveYield(yield, eid, requestBuffer, normalRespTimeout);
+    auto [ec, response] = sendReceive(transport, eid, yield, requestBuffer,
+                                      ResponseClass::normal);
     if (ec)
     {
         throw boost::system::system_error(ec);
     }
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        ("getNVMeMiResponseData response " +
-         getHexString(response.begin(), response.end()))
-            .c_str());
+    logMessage("getNVMeMiResponseData response ", response.begin(),
+               response.end());
 
     nvmemi::protocol::ManagementInterfaceResponse miRsp(response);
     if (miRsp.getStatus() != 0)
@@ -513,10 +1163,11 @@ std::vector<uint8_t> getNVMeMiResponseData(mctpw::MCTPWrapper& wrapper,
     }
 
     auto [data, len] = miRsp.getNVMeManagementResponse();
-    return std::vector<uint8_t>(data, data + len);
+    return nvmemi::ResponseBuffer(std::move(response),
+                                  nvmemi::ByteView(data, len));
 }
 
-uint8_t getSMBusI2CFrequency(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+uint8_t getSMBusI2CFrequency(nvmemi::Transport& transport, mctpw::eid_t eid,
                              boost::asio::yield_context yield, uint8_t portId)
 {
     static constexpr uint8_t configGetSMBus = 0x01;
@@ -530,11 +1181,12 @@ uint8_t getSMBusI2CFrequency(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
     auto dword0 = reinterpret_cast<RequestDword*>(&reqData);
     dword0->cfgId = configGetSMBus;
     dword0->portId = portId;
-    auto data = getNVMeMiResponseData(wrapper, eid, yield, reqData);
+    auto data = getNVMeMiResponseData(transport, eid, yield, reqData);
     return data[0] & 0xF;
 }
 
-uint16_t getMCTPTransportUnitSize(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+uint16_t getMCTPTransportUnitSize(nvmemi::Transport& transport,
+                                  mctpw::eid_t eid,
                                   boost::asio::yield_context yield,
                                   uint8_t portId)
 {
@@ -549,57 +1201,195 @@ uint16_t getMCTPTransportUnitSize(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
     auto dword0 = reinterpret_cast<RequestDword*>(&reqData);
     dword0->cfgId = configGetMCTPUnit;
     dword0->portId = portId;
-    auto data = getNVMeMiResponseData(wrapper, eid, yield, reqData);
-    auto mctpUnitSize = reinterpret_cast<uint16_t*>(data.data());
+    auto data = getNVMeMiResponseData(transport, eid, yield, reqData);
 
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        ("MCTPUnit response " + getHexString(data.begin(), data.end()))
-            .c_str());
-    return le16toh(*mctpUnitSize);
+    logMessage("MCTPUnit response ", data.begin(), data.end());
+    if (data.size() < sizeof(uint16_t))
+    {
+        throw std::runtime_error("Expected more bytes for MCTP unit size");
+    }
+    return static_cast<uint16_t>(data[0] | data[1] << 8);
 }
 
-uint32_t getAdminGetFeaturesCQDWord0(mctpw::MCTPWrapper& wrapper,
-                                     mctpw::eid_t eid,
-                                     boost::asio::yield_context yield,
-                                     nvmemi::protocol::FeatureID feature,
-                                     uint32_t dword11 = 0)
+void setSMBusI2CFrequency(nvmemi::Transport& transport, mctpw::eid_t eid,
+                          boost::asio::yield_context yield, uint8_t portId,
+                          SMBusFrequency frequency)
+{
+    namespace configuration = nvmemi::protocol::configuration;
+    uint32_t reqData = 0;
+    auto dword0 = reinterpret_cast<configuration::RequestDWord0*>(&reqData);
+    dword0->configurationId =
+        static_cast<uint8_t>(configuration::ConfigurationId::smbusFrequency);
+    dword0->smbusFrequency = static_cast<uint8_t>(frequency);
+    dword0->portId = portId;
+    getNVMeMiResponseData(transport, eid, yield, reqData, 0,
+                          nvmemi::protocol::MiOpCode::configSet);
+}
+
+void setMCTPTransportUnitSize(nvmemi::Transport& transport, mctpw::eid_t eid,
+                              boost::asio::yield_context yield,
+                              uint8_t portId, uint16_t unitSize)
+{
+    namespace configuration = nvmemi::protocol::configuration;
+    uint32_t reqData = 0;
+    auto dword0 = reinterpret_cast<configuration::RequestDWord0*>(&reqData);
+    dword0->configurationId =
+        static_cast<uint8_t>(configuration::ConfigurationId::mctpUnitSize);
+    dword0->portId = portId;
+    getNVMeMiResponseData(transport, eid, yield, reqData, unitSize,
+                          nvmemi::protocol::MiOpCode::configSet);
+}
+
+/**
+ * @brief Read the VPD of the drive from offset 0 in chunks of vpdChunkSize
+ * bytes. The size to read is taken from the FRU headers read so far.
+ *
+ * @return std::vector<uint8_t> VPD bytes
+ */
+static std::vector<uint8_t> readVpd(nvmemi::Transport& transport,
+                                    mctpw::eid_t eid,
+                                    boost::asio::yield_context yield)
+{
+    static constexpr size_t vpdChunkSize = 256;
+    using Request = nvmemi::protocol::ManagementInterfaceMessage<uint8_t*>;
+    std::vector<uint8_t> vpd;
+    size_t required = nvmemi::fru::getRequiredSize(vpd.data(), vpd.size());
+    while (required > vpd.size())
+    {
+        auto length = std::min(required - vpd.size(), vpdChunkSize);
+        std::vector<uint8_t> requestBuffer(
+            Request::minSize + sizeof(Request::CRC32C), 0x00);
+        Request msg(requestBuffer, nvmemi::protocol::MiOpCode::vpdRead);
+        msg->dword0 = htole32(static_cast<uint32_t>(vpd.size()));
+        msg->dword1 = htole32(static_cast<uint32_t>(length));
+        msg.setCRC();
+
+        auto [ec, response] = sendReceive(transport, eid, yield,
+                                          requestBuffer, ResponseClass::normal);
+        if (ec)
+        {
+            throw boost::system::system_error(ec);
+        }
+        logMessage("readVpd response ", response.begin(), response.end());
+        nvmemi::protocol::ManagementInterfaceResponse miRsp(response);
+        if (miRsp.getStatus() != 0)
+        {
+            throw std::runtime_error("Received error response");
+        }
+        auto [data, len] = miRsp.getOptionalResponseData();
+        if (len <= 0 || static_cast<size_t>(len) > length)
+        {
+            throw std::runtime_error("Unexpected VPD data length");
+        }
+        vpd.insert(vpd.end(), data, data + len);
+        required = nvmemi::fru::getRequiredSize(vpd.data(), vpd.size());
+    }
+    return vpd;
+}
+
+/**
+ * @brief Change a configuration value and read it back. The previous value
+ * is set again if the change fails or does not read back.
+ *
+ * @return true if the new value is in effect
+ */
+template <typename T, typename Getter, typename Setter>
+static bool changeConfiguration(T previous, T target, Getter&& get,
+                                Setter&& set)
+{
+    try
+    {
+        set(target);
+        if (get() == target)
+        {
+            return true;
+        }
+        phosphor::logging::log<phosphor::logging::level::WARNING>(
+            "Configuration value did not read back");
+    }
+    catch (const std::exception& e)
+    {
+        phosphor::logging::log<phosphor::logging::level::WARNING>(
+            "Error changing configuration",
+            phosphor::logging::entry("MSG=%s", e.what()));
+    }
+    try
+    {
+        set(previous);
+    }
+    catch (const std::exception& e)
+    {
+        phosphor::logging::log<phosphor::logging::level::ERR>(
+            "Error restoring configuration",
+            phosphor::logging::entry("MSG=%s", e.what()));
+    }
+    return false;
+}
+
+/**
+ * @brief Send a Get Features or Set Features admin command for a feature of
+ * all namespaces and return the response. Get Features reads the current
+ * value and Set Features does not save the value.
+ */
+static std::vector<uint8_t>
+    sendAdminFeatures(nvmemi::Transport& transport, mctpw::eid_t eid,
+                      boost::asio::yield_context yield,
+                      nvmemi::protocol::AdminOpCode opCode,
+                      nvmemi::protocol::FeatureID feature, uint32_t dword11)
 {
     static constexpr uint32_t namespaceId = 0xFFFFFFFF;
-    static constexpr uint8_t selectCurrent = 0x00;
     using Request = nvmemi::protocol::AdminCommand<uint8_t*>;
     std::vector<uint8_t> requestBuffer(
         Request::minSize + sizeof(Request::CRC32C), 0x00);
     Request msg(requestBuffer);
-    msg.setAdminOpCode(nvmemi::protocol::AdminOpCode::getFeatures);
+    msg.setAdminOpCode(opCode);
+    // Select of Get Features and Save of Set Features are left 0
     struct DWord10
     {
         uint8_t featureId;
-        uint8_t select : 3;
-        uint32_t reserved : 21;
+        uint32_t reserved : 24;
     } __attribute__((packed));
     auto dwordPtr = reinterpret_cast<DWord10*>(msg.getSQDword10());
     dwordPtr->featureId = static_cast<uint8_t>(feature);
-    dwordPtr->select = selectCurrent;
     msg->sqdword1 = htole32(namespaceId);
     msg->sqdword11 = htole32(dword11);
     msg.setCRC();
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        ("getAdminGetFeaturesCQDWord0 request " +
-         getHexString(requestBuffer.begin(), requestBuffer.end()))
-            .c_str());
+    logMessage("sendAdminFeatures request ", requestBuffer.begin(),
+               requestBuffer.end());
 
-    auto [ec, response] = wrapper.sendReceiveYield(
-        yield, eid, requestBuffer, std::chrono::milliseconds(600));
+    auto [ec, response] = sendReceive(transport, eid, yield, requestBuffer,
+                                      ResponseClass::normal);
     if (ec)
     {
         throw boost::system::system_error(ec);
     }
-    phosphor::logging::log<phosphor::logging::level::DEBUG>(
-        ("getAdminGetFeaturesCQDWord0 response " +
-         getHexString(response.begin(), response.end()))
-            .c_str());
+    logMessage("sendAdminFeatures response ", response.begin(), response.end());
+    return std::move(response);
+}
 
+uint32_t getAdminGetFeaturesCQDWord0(nvmemi::Transport& transport,
+                                     mctpw::eid_t eid,
+                                     boost::asio::yield_context yield,
+                                     nvmemi::protocol::FeatureID feature,
+                                     uint32_t dword11 = 0)
+{
+    auto response = sendAdminFeatures(
+        transport, eid, yield, nvmemi::protocol::AdminOpCode::getFeatures,
+        feature, dword11);
     nvmemi::protocol::AdminCommandResponse adminRsp(response);
+    // With a selector in dword 11, as the threshold select of the temperature
+    // threshold, Invalid Field can be about the selector only. The feature
+    // is marked unsupported by reads without one.
+    bool unsupported =
+        dword11 == 0
+            ? checkUnsupported(eid, CapabilityKind::feature,
+                               static_cast<uint8_t>(feature), adminRsp)
+            : nvmemi::capabilities::isUnsupportedStatus(
+                  adminRsp.getStatus(), le32toh(adminRsp->sqdword3));
+    if (unsupported)
+    {
+        throw std::runtime_error("Feature not supported");
+    }
     if (adminRsp.getStatus() != 0)
     {
         throw std::runtime_error("Error status set in response message");
@@ -618,13 +1408,18 @@ std::string getHexString(const T& val, size_t width = sizeof(T) * 2,
 
 template <nvmemi::protocol::FeatureID feature>
 std::optional<std::string>
-    getFeatureString(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    getFeatureString(nvmemi::Transport& transport, mctpw::eid_t eid,
                      boost::asio::yield_context yield, uint32_t dword11 = 0)
 {
+    if (isUnsupported(eid, CapabilityKind::feature,
+                      static_cast<uint8_t>(feature)))
+    {
+        return std::nullopt;
+    }
     try
     {
-        auto dword0 =
-            getAdminGetFeaturesCQDWord0(wrapper, eid, yield, feature, dword11);
+        auto dword0 = getAdminGetFeaturesCQDWord0(transport, eid, yield,
+                                                  feature, dword11);
         return getHexString(dword0);
     }
     catch (const std::exception& e)
@@ -637,83 +1432,140 @@ std::optional<std::string>
     }
 }
 
+struct TemperatureThresholdDWord11
+{
+    uint16_t temperatureThreshold;
+    uint8_t temperatureSelect : 4;
+    uint8_t typeSelect : 2;
+    uint16_t reserved : 10;
+} __attribute__((packed));
+
 std::optional<std::string> getFeatureTemperatureThreshold(
-    mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    nvmemi::Transport& transport, mctpw::eid_t eid,
     boost::asio::yield_context yield, bool over = true)
 {
-    struct DWord11
-    {
-        uint16_t temperatureThreshold;
-        uint8_t temperatureSelect : 4;
-        uint8_t typeSelect : 2;
-        uint16_t reserved : 10;
-    } __attribute__((packed));
-
     uint32_t dword11Val = 0;
-    auto dword11Ptr = reinterpret_cast<DWord11*>(&dword11Val);
+    auto dword11Ptr =
+        reinterpret_cast<TemperatureThresholdDWord11*>(&dword11Val);
     dword11Ptr->typeSelect = over ? 0 : 1;
     return getFeatureString<nvmemi::protocol::FeatureID::temperatureThreshold>(
-        wrapper, eid, yield, dword11Val);
+        transport, eid, yield, dword11Val);
 }
 
-std::optional<std::string>
-    getLogPageResponse(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
-                       boost::asio::yield_context yield,
-                       nvmemi::protocol::getlog::LogPage logPageId,
-                       uint32_t expectedBytes, uint64_t offset = 0)
+/**
+ * @brief Set the over or under temperature threshold of the composite
+ * temperature. The drive raises the temperature critical warning when the
+ * threshold is crossed.
+ *
+ * @param kelvin Threshold in Kelvin
+ */
+void setFeatureTemperatureThreshold(nvmemi::Transport& transport,
+                                    mctpw::eid_t eid,
+                                    boost::asio::yield_context yield,
+                                    uint16_t kelvin, bool over)
+{
+    uint32_t dword11Val = 0;
+    auto dword11Ptr =
+        reinterpret_cast<TemperatureThresholdDWord11*>(&dword11Val);
+    dword11Ptr->temperatureThreshold = kelvin;
+    dword11Ptr->typeSelect = over ? 0 : 1;
+    auto response = sendAdminFeatures(
+        transport, eid, yield, nvmemi::protocol::AdminOpCode::setFeatures,
+        nvmemi::protocol::FeatureID::temperatureThreshold, dword11Val);
+    nvmemi::protocol::AdminCommandResponse adminRsp(response);
+    if (adminRsp.getStatus() != 0)
+    {
+        throw std::runtime_error("Error status set in response message");
+    }
+}
+
+/**
+ * @brief Read a log page in chunks of logPageChunkSize bytes. Each chunk is a
+ * separate Get Log Page for its slice only, selected with the log page offset
+ * and number of dwords, so that health polls can be sent between the
+ * chunks. Log pages the drive does not support are not requested.
+ *
+ * @param offset Log page offset of the first byte to read
+ */
+static std::optional<std::vector<uint8_t>>
+    getLogPageData(nvmemi::Transport& transport, mctpw::eid_t eid,
+                   boost::asio::yield_context yield,
+                   nvmemi::protocol::getlog::LogPage logPageId,
+                   uint32_t expectedBytes, uint64_t offset = 0)
 {
+    static constexpr uint32_t logPageChunkSize = 512;
+    if (isUnsupported(eid, CapabilityKind::logPage,
+                      static_cast<uint8_t>(logPageId)))
+    {
+        return std::nullopt;
+    }
+    std::vector<uint8_t> logPage;
     try
     {
-        constexpr auto logPageTimeout = std::chrono::milliseconds(3000);
         using LogPageRequest = nvmemi::protocol::getlog::Request;
         static constexpr uint32_t namespaceId = 0xFFFFFFFF;
         using Request = nvmemi::protocol::AdminCommand<uint8_t*>;
-        std::vector<uint8_t> requestBuffer(
-            Request::minSize + sizeof(Request::CRC32C), 0x00);
-        Request msg(requestBuffer);
-        msg.setAdminOpCode(nvmemi::protocol::AdminOpCode::getLogPage);
-        msg.setContainsLength(true);
-        if (offset > 0)
+        for (uint32_t dataOffset = 0; dataOffset < expectedBytes;
+             dataOffset += logPageChunkSize)
         {
-            msg.setContainsOffset(true);
-            msg.setOffset(offset);
-        }
-        msg.setLength(expectedBytes);
-
-        auto dwordPtr = reinterpret_cast<LogPageRequest*>(msg.getSQDword10());
-        dwordPtr->logPageId = static_cast<uint8_t>(logPageId);
-        dwordPtr->numberOfDwords = htole32(expectedBytes / sizeof(uint32_t));
-        dwordPtr->logPageOffset = htole64(offset);
-        msg->sqdword1 = htole32(namespaceId);
-        msg.setCRC();
-
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            ("getLogPageResponse request " +
-             getHexString(requestBuffer.begin(), requestBuffer.end()))
-                .c_str());
-
-        auto [ec, response] =
-            wrapper.sendReceiveYield(yield, eid, requestBuffer, logPageTimeout);
-        if (ec)
-        {
-            throw boost::system::system_error(ec);
-        }
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            ("getLogPageResponse response " +
-             getHexString(response.begin(), response.end()))
-                .c_str());
-
-        nvmemi::protocol::AdminCommandResponse adminRsp(response);
-        if (adminRsp.getStatus() != 0)
-        {
-            throw std::runtime_error("Error status set in response message");
-        }
-        auto [data, len] = adminRsp.getAdminResponseData();
-        if (len <= 0)
-        {
-            throw std::runtime_error("No data in admin response");
+            uint32_t chunkSize =
+                std::min(logPageChunkSize, expectedBytes - dataOffset);
+            std::vector<uint8_t> requestBuffer(
+                Request::minSize + sizeof(Request::CRC32C), 0x00);
+            Request msg(requestBuffer);
+            msg.setAdminOpCode(nvmemi::protocol::AdminOpCode::getLogPage);
+            msg.setContainsLength(true);
+            msg.setLength(chunkSize);
+
+            auto dwordPtr =
+                reinterpret_cast<LogPageRequest*>(msg.getSQDword10());
+            dwordPtr->logPageId = static_cast<uint8_t>(logPageId);
+            // Asynchronous events are left for the host to clear
+            dwordPtr->retainAsyncEvents = true;
+            dwordPtr->numberOfDwords = htole32(chunkSize / sizeof(uint32_t));
+            dwordPtr->logPageOffset = htole64(offset + dataOffset);
+            msg->sqdword1 = htole32(namespaceId);
+            msg.setCRC();
+
+            logMessage("getLogPageResponse request ", requestBuffer.begin(),
+                       requestBuffer.end());
+
+            auto [ec, response] = sendReceive(transport, eid, yield,
+                                              requestBuffer,
+                                              ResponseClass::logPage);
+            if (ec)
+            {
+                throw boost::system::system_error(ec);
+            }
+            logMessage("getLogPageResponse response ", response.begin(),
+                       response.end());
+
+            nvmemi::protocol::AdminCommandResponse adminRsp(response);
+            // Later chunks can be rejected for reading past a short log page
+            if (dataOffset == 0 && offset == 0 &&
+                checkUnsupported(eid, CapabilityKind::logPage,
+                                 static_cast<uint8_t>(logPageId), adminRsp))
+            {
+                throw std::runtime_error("Log page not supported");
+            }
+            if (adminRsp.getStatus() != 0)
+            {
+                throw std::runtime_error(
+                    "Error status set in response message");
+            }
+            auto [data, len] = adminRsp.getAdminResponseData();
+            if (len <= 0)
+            {
+                throw std::runtime_error("No data in admin response");
+            }
+            logPage.insert(logPage.end(), data, data + len);
+            // Log page is shorter than expected
+            if (static_cast<uint32_t>(len) < chunkSize)
+            {
+                break;
+            }
         }
-        return getHexString(data, data + len);
+        return logPage;
     }
     catch (const std::exception& e)
     {
@@ -725,62 +1577,77 @@ std::optional<std::string>
     }
 }
 
-std::optional<std::string> getLogPageError(mctpw::MCTPWrapper& wrapper,
+std::optional<std::string>
+    getLogPageResponse(nvmemi::Transport& transport, mctpw::eid_t eid,
+                       boost::asio::yield_context yield,
+                       nvmemi::protocol::getlog::LogPage logPageId,
+                       uint32_t expectedBytes, uint64_t offset = 0)
+{
+    auto logPage =
+        getLogPageData(transport, eid, yield, logPageId, expectedBytes, offset);
+    if (!logPage)
+    {
+        return std::nullopt;
+    }
+    return getHexString(logPage->begin(), logPage->end());
+}
+
+std::optional<std::string> getLogPageError(nvmemi::Transport& transport,
                                            mctpw::eid_t eid,
                                            boost::asio::yield_context yield)
 {
     static constexpr size_t singleErrorPageSize = 64;
     static constexpr size_t errorPages = 2;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::errorInformation,
         (errorPages * singleErrorPageSize));
 }
 std::optional<std::string>
-    getLogPageSMARTHealth(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    getLogPageSMARTHealth(nvmemi::Transport& transport, mctpw::eid_t eid,
                           boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 512;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::smartHealthInformation,
         responseSize);
 }
 std::optional<std::string>
-    getLogPageFirmwareSlotInfo(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    getLogPageFirmwareSlotInfo(nvmemi::Transport& transport, mctpw::eid_t eid,
                                boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 512;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::firmwareSlotInformation,
         responseSize);
 }
 std::optional<std::string>
-    getLogPageChangedNamespaces(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    getLogPageChangedNamespaces(nvmemi::Transport& transport, mctpw::eid_t eid,
                                 boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 1024;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::changedNamespaceList, responseSize);
 }
 std::optional<std::string>
-    getLogPageCmdSupportedAndEffects(mctpw::MCTPWrapper& wrapper,
+    getLogPageCmdSupportedAndEffects(nvmemi::Transport& transport,
                                      mctpw::eid_t eid,
                                      boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 2048;
     size_t offset = 0;
     auto rsp1 = getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::commandsSupportedEffects,
         responseSize);
     if (rsp1)
     {
         offset += 2048;
         auto rsp2 = getLogPageResponse(
-            wrapper, eid, yield,
+            transport, eid, yield,
             nvmemi::protocol::getlog::LogPage::commandsSupportedEffects,
             responseSize, offset);
         if (rsp2)
@@ -791,104 +1658,104 @@ std::optional<std::string>
     return std::nullopt;
 }
 std::optional<std::string>
-    getLogPageDeviceSelfTest(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    getLogPageDeviceSelfTest(nvmemi::Transport& transport, mctpw::eid_t eid,
                              boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 564;
-    return getLogPageResponse(wrapper, eid, yield,
+    return getLogPageResponse(transport, eid, yield,
                               nvmemi::protocol::getlog::LogPage::deviceSelfTest,
                               responseSize);
 }
 std::optional<std::string>
-    getLogPageTelemetryHostInitiated(mctpw::MCTPWrapper& wrapper,
+    getLogPageTelemetryHostInitiated(nvmemi::Transport& transport,
                                      mctpw::eid_t eid,
                                      boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 2048;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::telemetryHostInitiated,
         responseSize);
 }
 std::optional<std::string>
-    getLogPageTelemetryControllerInitiated(mctpw::MCTPWrapper& wrapper,
+    getLogPageTelemetryControllerInitiated(nvmemi::Transport& transport,
                                            mctpw::eid_t eid,
                                            boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 2048;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::telemetryControllerInitiated,
         responseSize);
 }
 std::optional<std::string>
-    getLogPageEnduranceGroupInformation(mctpw::MCTPWrapper& wrapper,
+    getLogPageEnduranceGroupInformation(nvmemi::Transport& transport,
                                         mctpw::eid_t eid,
                                         boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 512;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::enduranceGroupInformation,
         responseSize);
 }
 std::optional<std::string>
-    getLogPagePredictableLatencyPerNVMSet(mctpw::MCTPWrapper& wrapper,
+    getLogPagePredictableLatencyPerNVMSet(nvmemi::Transport& transport,
                                           mctpw::eid_t eid,
                                           boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 512;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::predictableLatencyPerNVMSet,
         responseSize);
 }
 std::optional<std::string>
-    getLogPagePredictableLatencyEventAggregate(mctpw::MCTPWrapper& wrapper,
+    getLogPagePredictableLatencyEventAggregate(nvmemi::Transport& transport,
                                                mctpw::eid_t eid,
                                                boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 1024;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::predictableLatencyEventAggregate,
         responseSize);
 }
 std::optional<std::string>
-    getLogPageAsymmetricNamespaceAccess(mctpw::MCTPWrapper& wrapper,
+    getLogPageAsymmetricNamespaceAccess(nvmemi::Transport& transport,
                                         mctpw::eid_t eid,
                                         boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 1024;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::asymmetricNamespaceAccess,
         responseSize);
 }
 std::optional<std::string>
-    getLogPagePersistentEventLog(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    getLogPagePersistentEventLog(nvmemi::Transport& transport, mctpw::eid_t eid,
                                  boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 1024;
     // TODO Handle Log Specific Field
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::persistentEventLog, responseSize);
 }
 std::optional<std::string>
-    getLogPageEnduranceGroupEventAggregate(mctpw::MCTPWrapper& wrapper,
+    getLogPageEnduranceGroupEventAggregate(nvmemi::Transport& transport,
                                            mctpw::eid_t eid,
                                            boost::asio::yield_context yield)
 {
     static constexpr size_t responseSize = 1024;
     return getLogPageResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::getlog::LogPage::enduranceGroupEventAggregate,
         responseSize);
 }
 
-std::optional<std::string> getIdentifyResponse(
-    mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+std::optional<nvmemi::ResponseBuffer> getIdentifyData(
+    nvmemi::Transport& transport, mctpw::eid_t eid,
     boost::asio::yield_context yield,
     nvmemi::protocol::identify::ControllerNamespaceStruct cns,
     uint32_t expectedBytes, uint32_t namespaceId, uint16_t controllerId = 0,
@@ -916,21 +1783,17 @@ std::optional<std::string> getIdentifyResponse(
         msg->sqdword1 = htole32(namespaceId);
         msg.setCRC();
 
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            ("Identify request " +
-             getHexString(requestBuffer.begin(), requestBuffer.end()))
-                .c_str());
+        logMessage("Identify request ", requestBuffer.begin(),
+                   requestBuffer.end());
 
-        auto [ec, response] = wrapper.sendReceiveYield(
-            yield, eid, requestBuffer, longRespTimeout);
+        auto [ec, response] =
+            sendReceive(transport, eid, yield, requestBuffer,
+                        ResponseClass::longResponse);
         if (ec)
         {
             throw boost::system::system_error(ec);
         }
-        phosphor::logging::log<phosphor::logging::level::DEBUG>(
-            ("Identify response " +
-             getHexString(response.begin(), response.end()))
-                .c_str());
+        logMessage("Identify response ", response.begin(), response.end());
 
         nvmemi::protocol::AdminCommandResponse adminRsp(response);
         if (adminRsp.getStatus() != 0)
@@ -942,7 +1805,8 @@ std::optional<std::string> getIdentifyResponse(
         {
             throw std::runtime_error("No data in admin response");
         }
-        return getHexString(data, data + len);
+        return nvmemi::ResponseBuffer(std::move(response),
+                                      nvmemi::ByteView(data, len));
     }
     catch (const std::exception& e)
     {
@@ -954,8 +1818,24 @@ std::optional<std::string> getIdentifyResponse(
     }
 }
 
+std::optional<std::string> getIdentifyResponse(
+    nvmemi::Transport& transport, mctpw::eid_t eid,
+    boost::asio::yield_context yield,
+    nvmemi::protocol::identify::ControllerNamespaceStruct cns,
+    uint32_t expectedBytes, uint32_t namespaceId, uint16_t controllerId = 0,
+    uint32_t offset = 0)
+{
+    auto data = getIdentifyData(transport, eid, yield, cns, expectedBytes,
+                                namespaceId, controllerId, offset);
+    if (!data)
+    {
+        return std::nullopt;
+    }
+    return getHexString(data->begin(), data->end());
+}
+
 std::vector<uint32_t>
-    getIdentifyActiveNamespaceIdList(mctpw::MCTPWrapper& wrapper,
+    getIdentifyActiveNamespaceIdList(nvmemi::Transport& transport,
                                      mctpw::eid_t eid,
                                      boost::asio::yield_context yield)
 {
@@ -964,7 +1844,7 @@ std::vector<uint32_t>
         maxNamespacesExpected * sizeof(uint32_t);
     std::vector<uint32_t> nsIds;
     auto rsp = getIdentifyResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::identify::ControllerNamespaceStruct::activeNamespace,
         bytesExpected, 0);
     // TODO Continue processing if max namespaces returned
@@ -992,367 +1872,439 @@ std::vector<uint32_t>
 }
 
 std::optional<std::string>
-    getIdentifyController(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    getIdentifyController(nvmemi::Transport& transport, mctpw::eid_t eid,
                           boost::asio::yield_context yield,
                           uint16_t controllerId)
 {
     static constexpr uint16_t controllerInfoSize = 536;
     return getIdentifyResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::identify::ControllerNamespaceStruct::
             controllerIdentify,
         controllerInfoSize, clearedNamespaceId, controllerId);
 }
 
 std::optional<std::string>
-    getIdentifyCommonNamespace(mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    getIdentifyCommonNamespace(nvmemi::Transport& transport, mctpw::eid_t eid,
                                boost::asio::yield_context yield)
 {
     static constexpr uint16_t namespaceDescriptorSize = 256;
     return getIdentifyResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::identify::ControllerNamespaceStruct::
             namespaceCapablities,
         namespaceDescriptorSize, globalNamespaceId);
 }
 
 std::optional<std::string> getIdentifyNamespaceIdDescList(
-    mctpw::MCTPWrapper& wrapper, mctpw::eid_t eid,
+    nvmemi::Transport& transport, mctpw::eid_t eid,
     boost::asio::yield_context yield, uint32_t nsId)
 {
     static constexpr uint16_t bytesExpected = 1024;
     // TODO Handle namespace count greater than 256
     return getIdentifyResponse(
-        wrapper, eid, yield,
+        transport, eid, yield,
         nvmemi::protocol::identify::ControllerNamespaceStruct::
             namespaceIdDescriptorList,
         bytesExpected, nsId);
 }
 
-std::tuple<int, std::string>
-    Drive::collectDriveLog(boost::asio::yield_context yield)
+/**
+ * @brief Get a space padded ASCII field of an Identify data structure
+ *
+ */
+static std::string getIdentifyString(const nvmemi::ResponseBuffer& data,
+                                     size_t offset, size_t size)
 {
-    enum ErrorStatus : uint8_t
+    if (offset >= data.size())
     {
-        success = 0,
-        fileSystem,
-        emptyJson,
-    };
-
-    nlohmann::json jsonObject;
-    std::optional<nvmemi::protocol::readnvmeds::SubsystemInfo> subsystemInfo =
-        std::nullopt;
-    try
-    {
-        subsystemInfo =
-            getSubsystemInfo(*this->mctpWrapper, this->mctpEid, yield);
-        nlohmann::json subsystemJson;
-        subsystemJson["Major"] = static_cast<int>(subsystemInfo->majorVersion);
-        subsystemJson["Minor"] = static_cast<int>(subsystemInfo->minorVersion);
-        subsystemJson["Ports"] =
-            static_cast<int>(subsystemInfo->numberOfPorts + 1);
-        jsonObject["NVM_Subsystem_Info"] = subsystemJson;
+        return std::string();
     }
-    catch (const std::exception& e)
-    {
-        phosphor::logging::log<phosphor::logging::level::WARNING>(
-            "Error getting NVM subsystem information",
-            phosphor::logging::entry("MSG=%s", e.what()));
-    }
-    if (subsystemInfo)
-    {
-        nlohmann::json portInfoJson;
-        for (uint8_t currentPort = 0;
-             currentPort <= subsystemInfo->numberOfPorts; currentPort++)
+    size = std::min(size, data.size() - offset);
+    std::string field(reinterpret_cast<const char*>(data.data() + offset),
+                      size);
+    field.erase(field.find_last_not_of(std::string(" \0", 2)) + 1);
+    return field;
+}
+
+std::optional<std::string>
+    Drive::readSubsystemId(nvmemi::Transport& transport, mctpw::eid_t eid,
+                           boost::asio::yield_context yield)
+{
+    using nvmemi::protocol::identify::ControllerNamespaceStruct;
+    // Offsets in the Identify Controller data structure
+    static constexpr size_t serialNumberOffset = 4;
+    static constexpr size_t serialNumberSize = 20;
+    static constexpr size_t modelNumberOffset = 24;
+    static constexpr size_t modelNumberSize = 40;
+    static constexpr uint32_t subsystemNqnOffset = 768;
+    static constexpr uint32_t subsystemNqnSize = 256;
+
+    auto nqnData = getIdentifyData(
+        transport, eid, yield, ControllerNamespaceStruct::controllerIdentify,
+        subsystemNqnSize, clearedNamespaceId, 0, subsystemNqnOffset);
+    if (nqnData)
+    {
+        std::string nqn = getIdentifyString(*nqnData, 0, subsystemNqnSize);
+        if (!nqn.empty())
         {
-            auto portInfo = getPortInfo(*this->mctpWrapper, this->mctpEid,
-                                        currentPort, yield);
-            if (!portInfo)
-            {
-                continue;
-            }
-            portInfoJson["Port" + std::to_string(currentPort)] =
-                portInfo.value();
+            return nqn;
         }
-        jsonObject["Ports"] = portInfoJson;
     }
-    std::optional<std::vector<uint16_t>> controllerIds;
-    try
+    // NQN was added in NVMe 1.2.1, older controllers are told apart by the
+    // serial and model numbers
+    auto data = getIdentifyData(
+        transport, eid, yield, ControllerNamespaceStruct::controllerIdentify,
+        modelNumberOffset + modelNumberSize, clearedNamespaceId);
+    if (!data)
     {
-        auto controllerList =
-            getControllerList(*this->mctpWrapper, this->mctpEid, yield);
-        controllerIds = controllerList;
-        jsonObject["Controllers"] = controllerList;
-        nlohmann::json controllerInfoJson;
-        for (uint16_t controllerId : controllerList)
-        {
-            auto controllerHexString = getControllerInfo(
-                *this->mctpWrapper, this->mctpEid, controllerId, yield);
-            if (controllerHexString)
-            {
-                controllerInfoJson["Controller" +
-                                   std::to_string(controllerId)] =
-                    controllerHexString.value();
-            }
-        }
-        jsonObject["ControllerInfo"] = controllerInfoJson;
+        return std::nullopt;
     }
-    catch (const std::exception& e)
+    std::string serialNumber =
+        getIdentifyString(*data, serialNumberOffset, serialNumberSize);
+    if (serialNumber.empty())
     {
-        phosphor::logging::log<phosphor::logging::level::WARNING>(
-            "Error getting controller list",
-            phosphor::logging::entry("MSG=%s", e.what()));
+        return std::nullopt;
     }
-    try
-    {
-        auto optionalCommands =
-            getOptionalCommands(*this->mctpWrapper, this->mctpEid, yield);
-        std::vector<nlohmann::json> optionalCommandsJson{};
-        for (const auto& [msgType, cmd] : optionalCommands)
+    return "sn:" + serialNumber + ":mn:" +
+           getIdentifyString(*data, modelNumberOffset, modelNumberSize);
+}
+
+/**
+ * @brief Data shared between the log sections of one collection
+ *
+ */
+struct LogContext
+{
+    nlohmann::json jsonObject;
+    nvmemi::ResponseStruct<SubsystemInfo> subsystemInfo;
+    std::optional<std::vector<uint16_t>> controllerIds;
+};
+
+static void collectSubsystemInfoSection(nvmemi::Transport& transport,
+                                        mctpw::eid_t eid,
+                                        boost::asio::yield_context yield,
+                                        LogContext& context)
+{
+    context.subsystemInfo = getSubsystemInfo(transport, eid, yield);
+    nlohmann::json subsystemJson;
+    subsystemJson["Major"] =
+        static_cast<int>(context.subsystemInfo->majorVersion);
+    subsystemJson["Minor"] =
+        static_cast<int>(context.subsystemInfo->minorVersion);
+    subsystemJson["Ports"] =
+        static_cast<int>(context.subsystemInfo->numberOfPorts + 1);
+    context.jsonObject["NVM_Subsystem_Info"] = subsystemJson;
+
+    nlohmann::json portInfoJson;
+    for (uint8_t currentPort = 0;
+         currentPort <= context.subsystemInfo->numberOfPorts; currentPort++)
+    {
+        auto portInfo = getPortInfo(transport, eid, currentPort, yield);
+        if (!portInfo)
         {
-            nlohmann::json cmdJson;
-            cmdJson["Type"] = msgType;
-            cmdJson["OpCode"] = cmd;
-            optionalCommandsJson.emplace_back(cmdJson);
+            continue;
         }
-        jsonObject["OptionalCommands"] = optionalCommandsJson;
-    }
-    catch (const std::exception& e)
-    {
-        phosphor::logging::log<phosphor::logging::level::WARNING>(
-            "Error getting optional commands",
-            phosphor::logging::entry("MSG=%s", e.what()));
+        portInfoJson["Port" + std::to_string(currentPort)] = portInfo.value();
     }
-    try
-    {
-        auto controllerHS = getControllerHSPollResponse(*this->mctpWrapper,
-                                                        this->mctpEid, yield);
-        if (controllerHS)
+    context.jsonObject["Ports"] = portInfoJson;
+}
+
+static void collectControllersSection(nvmemi::Transport& transport,
+                                      mctpw::eid_t eid,
+                                      boost::asio::yield_context yield,
+                                      LogContext& context)
+{
+    auto controllerList = getControllerList(transport, eid, yield);
+    context.controllerIds = controllerList;
+    context.jsonObject["Controllers"] = controllerList;
+    nlohmann::json controllerInfoJson;
+    for (uint16_t controllerId : controllerList)
+    {
+        auto controllerHexString =
+            getControllerInfo(transport, eid, controllerId, yield);
+        if (controllerHexString)
         {
-            jsonObject["ControllerHSPoll"] = controllerHS.value();
+            controllerInfoJson["Controller" + std::to_string(controllerId)] =
+                controllerHexString.value();
         }
     }
-    catch (const std::exception& e)
+    context.jsonObject["ControllerInfo"] = controllerInfoJson;
+}
+
+static void collectOptionalCommandsSection(nvmemi::Transport& transport,
+                                           mctpw::eid_t eid,
+                                           boost::asio::yield_context yield,
+                                           LogContext& context)
+{
+    auto optionalCommands = getOptionalCommands(transport, eid, yield);
+    std::vector<nlohmann::json> optionalCommandsJson{};
+    for (const auto& [msgType, cmd] : optionalCommands)
     {
-        phosphor::logging::log<phosphor::logging::level::WARNING>(
-            "Error getting controller hs poll",
-            phosphor::logging::entry("MSG=%s", e.what()));
+        nlohmann::json cmdJson;
+        cmdJson["Type"] = msgType;
+        cmdJson["OpCode"] = cmd;
+        optionalCommandsJson.emplace_back(cmdJson);
     }
-    try
+    context.jsonObject["OptionalCommands"] = optionalCommandsJson;
+}
+
+static void collectControllerHSPollSection(nvmemi::Transport& transport,
+                                           mctpw::eid_t eid,
+                                           boost::asio::yield_context yield,
+                                           LogContext& context)
+{
+    auto controllerHS = getControllerHSPollResponse(transport, eid, yield);
+    if (controllerHS)
     {
-        auto subsystemHS = getSubsystemHealthStatusPollResponse(
-            *this->mctpWrapper, this->mctpEid, yield);
-        jsonObject["SubsystemHSPoll"] = subsystemHS;
+        context.jsonObject["ControllerHSPoll"] = controllerHS.value();
     }
-    catch (const std::exception& e)
+}
+
+static void collectSubsystemHSPollSection(nvmemi::Transport& transport,
+                                          mctpw::eid_t eid,
+                                          boost::asio::yield_context yield,
+                                          LogContext& context)
+{
+    context.jsonObject["SubsystemHSPoll"] =
+        getSubsystemHealthStatusPollResponse(transport, eid, yield);
+}
+
+static void collectConfigGetSection(nvmemi::Transport& transport,
+                                    mctpw::eid_t eid,
+                                    boost::asio::yield_context yield,
+                                    LogContext& context)
+{
+    if (!context.subsystemInfo)
     {
-        phosphor::logging::log<phosphor::logging::level::WARNING>(
-            "Error getting subsystem hs poll",
-            phosphor::logging::entry("MSG=%s", e.what()));
+        context.subsystemInfo = getSubsystemInfo(transport, eid, yield);
     }
-    if (subsystemInfo)
+    nlohmann::json portInfoJson;
+    for (uint8_t currentPort = 0;
+         currentPort <= context.subsystemInfo->numberOfPorts; currentPort++)
     {
-        nlohmann::json portInfoJson;
-        for (uint8_t currentPort = 0;
-             currentPort <= subsystemInfo->numberOfPorts; currentPort++)
+        try
         {
-            try
-            {
-                nlohmann::json configGetJson;
-                uint8_t i2cFreq = getSMBusI2CFrequency(
-                    *this->mctpWrapper, this->mctpEid, yield, currentPort);
-                configGetJson["I2C_SMBus_Frequency"] = i2cFreq;
-                uint8_t mctpUnitSize = getMCTPTransportUnitSize(
-                    *this->mctpWrapper, this->mctpEid, yield, currentPort);
-                configGetJson["MCTP_Unit_Size"] = mctpUnitSize;
-                portInfoJson["Port" + std::to_string(currentPort)] =
-                    configGetJson;
-            }
-            catch (const std::exception& e)
-            {
-                phosphor::logging::log<phosphor::logging::level::WARNING>(
-                    "Error getting config get response",
-                    phosphor::logging::entry("MSG=%s", e.what()));
-            }
+            nlohmann::json configGetJson;
+            uint8_t i2cFreq =
+                getSMBusI2CFrequency(transport, eid, yield, currentPort);
+            configGetJson["I2C_SMBus_Frequency"] = i2cFreq;
+            uint16_t mctpUnitSize =
+                getMCTPTransportUnitSize(transport, eid, yield, currentPort);
+            configGetJson["MCTP_Unit_Size"] = mctpUnitSize;
+            portInfoJson["Port" + std::to_string(currentPort)] = configGetJson;
+        }
+        catch (const std::exception& e)
+        {
+            phosphor::logging::log<phosphor::logging::level::WARNING>(
+                "Error getting config get response",
+                phosphor::logging::entry("MSG=%s", e.what()));
         }
-        jsonObject["ConfigGet"] = portInfoJson;
     }
+    context.jsonObject["ConfigGet"] = portInfoJson;
+}
+
+static void collectGetFeaturesSection(nvmemi::Transport& transport,
+                                      mctpw::eid_t eid,
+                                      boost::asio::yield_context yield,
+                                      LogContext& context)
+{
     nlohmann::json getFeaturesJson;
     auto arbitration =
-        getFeatureString<nvmemi::protocol::FeatureID::arbitration>(
-            *this->mctpWrapper, this->mctpEid, yield);
+        getFeatureString<nvmemi::protocol::FeatureID::arbitration>(transport,
+                                                                   eid, yield);
     if (arbitration)
     {
         getFeaturesJson["Arbitration"] = arbitration.value();
     }
     auto tempThresholdUpper =
-        getFeatureString<nvmemi::protocol::FeatureID::arbitration>(
-            *this->mctpWrapper, this->mctpEid, yield);
+        getFeatureString<nvmemi::protocol::FeatureID::arbitration>(transport,
+                                                                   eid, yield);
     if (tempThresholdUpper)
     {
         getFeaturesJson["ThresholdUpper"] = tempThresholdUpper.value();
     }
-    auto tempThresholdLower = getFeatureTemperatureThreshold(
-        *this->mctpWrapper, this->mctpEid, yield, false);
+    auto tempThresholdLower =
+        getFeatureTemperatureThreshold(transport, eid, yield, false);
     if (tempThresholdLower)
     {
         getFeaturesJson["ThresholdLower"] = tempThresholdLower.value();
     }
-    auto powerFeature = getFeatureString<nvmemi::protocol::FeatureID::power>(
-        *this->mctpWrapper, this->mctpEid, yield);
+    auto powerFeature =
+        getFeatureString<nvmemi::protocol::FeatureID::power>(transport, eid,
+                                                             yield);
     if (powerFeature)
     {
         getFeaturesJson["Power"] = powerFeature.value();
     }
     auto errorRecovery =
         getFeatureString<nvmemi::protocol::FeatureID::errorRecovery>(
-            *this->mctpWrapper, this->mctpEid, yield);
+            transport, eid, yield);
     if (errorRecovery)
     {
         getFeaturesJson["ErrorRecovery"] = errorRecovery.value();
     }
     auto numberOfQueues =
         getFeatureString<nvmemi::protocol::FeatureID::numberOfQueues>(
-            *this->mctpWrapper, this->mctpEid, yield);
+            transport, eid, yield);
     if (numberOfQueues)
     {
         getFeaturesJson["NumberOfQueues"] = numberOfQueues.value();
     }
     auto interruptCoalescing =
         getFeatureString<nvmemi::protocol::FeatureID::interruptCoalescing>(
-            *this->mctpWrapper, this->mctpEid, yield);
+            transport, eid, yield);
     if (interruptCoalescing)
     {
         getFeaturesJson["InterruptCoalescing"] = interruptCoalescing.value();
     }
     auto interruptVector = getFeatureString<
         nvmemi::protocol::FeatureID::interruptVectorConfiguration>(
-        *this->mctpWrapper, this->mctpEid, yield);
+        transport, eid, yield);
     if (interruptVector)
     {
         getFeaturesJson["InterruptVector"] = interruptVector.value();
     }
     auto writeAtomicity =
         getFeatureString<nvmemi::protocol::FeatureID::writeAtomicityNormal>(
-            *this->mctpWrapper, this->mctpEid, yield);
+            transport, eid, yield);
     if (writeAtomicity)
     {
         getFeaturesJson["WriteAtomicity"] = writeAtomicity.value();
     }
     auto asyncEventConfig = getFeatureString<
         nvmemi::protocol::FeatureID::asynchronousEventConfiguration>(
-        *this->mctpWrapper, this->mctpEid, yield);
+        transport, eid, yield);
     if (asyncEventConfig)
     {
         getFeaturesJson["AsyncEventConfig"] = asyncEventConfig.value();
     }
-    jsonObject["GetFeatures"] = getFeaturesJson;
+    context.jsonObject["GetFeatures"] = getFeaturesJson;
+}
 
-    nlohmann::json getLogPage;
-    auto logErr = getLogPageError(*this->mctpWrapper, this->mctpEid, yield);
+static void collectErrorLogSection(nvmemi::Transport& transport,
+                                  mctpw::eid_t eid,
+                                  boost::asio::yield_context yield,
+                                  LogContext& context)
+{
+    auto logErr = getLogPageError(transport, eid, yield);
     if (logErr)
     {
-        getLogPage["Error"] = logErr.value();
+        context.jsonObject["GetLogPage"]["Error"] = logErr.value();
     }
-    auto logSmartHealth =
-        getLogPageSMARTHealth(*this->mctpWrapper, this->mctpEid, yield);
+}
+
+static void collectSMARTHealthLogSection(nvmemi::Transport& transport,
+                                         mctpw::eid_t eid,
+                                         boost::asio::yield_context yield,
+                                         LogContext& context)
+{
+    auto logSmartHealth = getLogPageSMARTHealth(transport, eid, yield);
     if (logSmartHealth)
     {
-        getLogPage["SMARTHealth"] = logSmartHealth.value();
+        context.jsonObject["GetLogPage"]["SMARTHealth"] =
+            logSmartHealth.value();
     }
-    auto logFirmwareSlot =
-        getLogPageFirmwareSlotInfo(*this->mctpWrapper, this->mctpEid, yield);
+}
+
+static void collectOtherLogPagesSection(nvmemi::Transport& transport,
+                                        mctpw::eid_t eid,
+                                        boost::asio::yield_context yield,
+                                        LogContext& context)
+{
+    nlohmann::json& getLogPage = context.jsonObject["GetLogPage"];
+    auto logFirmwareSlot = getLogPageFirmwareSlotInfo(transport, eid, yield);
     if (logFirmwareSlot)
     {
         getLogPage["FirmwareSlot"] = logFirmwareSlot.value();
     }
     auto logChangedNamespace =
-        getLogPageChangedNamespaces(*this->mctpWrapper, this->mctpEid, yield);
+        getLogPageChangedNamespaces(transport, eid, yield);
     if (logChangedNamespace)
     {
         getLogPage["ChangedNamespaces"] = logChangedNamespace.value();
     }
-    auto logCommandSUpported = getLogPageCmdSupportedAndEffects(
-        *this->mctpWrapper, this->mctpEid, yield);
+    auto logCommandSUpported =
+        getLogPageCmdSupportedAndEffects(transport, eid, yield);
     if (logCommandSUpported)
     {
         getLogPage["CommandSupported"] = logCommandSUpported.value();
     }
-    auto logDeviceSelfTest =
-        getLogPageDeviceSelfTest(*this->mctpWrapper, this->mctpEid, yield);
+    auto logDeviceSelfTest = getLogPageDeviceSelfTest(transport, eid, yield);
     if (logDeviceSelfTest)
     {
         getLogPage["DeviceSelfTest"] = logDeviceSelfTest.value();
     }
-    auto logTelemetryHostInitiated = getLogPageTelemetryHostInitiated(
-        *this->mctpWrapper, this->mctpEid, yield);
+    auto logTelemetryHostInitiated =
+        getLogPageTelemetryHostInitiated(transport, eid, yield);
     if (logTelemetryHostInitiated)
     {
         getLogPage["TelemetryHostInitiated"] =
             logTelemetryHostInitiated.value();
     }
     auto logTelemetryControllerInitiated =
-        getLogPageTelemetryControllerInitiated(*this->mctpWrapper,
-                                               this->mctpEid, yield);
+        getLogPageTelemetryControllerInitiated(transport, eid, yield);
     if (logTelemetryControllerInitiated)
     {
         getLogPage["TelemetryControllerInitiated"] =
             logTelemetryControllerInitiated.value();
     }
-    auto logEnduranceGroupInformation = getLogPageEnduranceGroupInformation(
-        *this->mctpWrapper, this->mctpEid, yield);
+    auto logEnduranceGroupInformation =
+        getLogPageEnduranceGroupInformation(transport, eid, yield);
     if (logEnduranceGroupInformation)
     {
         getLogPage["EnduranceGroupInformation"] =
             logEnduranceGroupInformation.value();
     }
-    auto logPredictableLatencyPerNVMSet = getLogPagePredictableLatencyPerNVMSet(
-        *this->mctpWrapper, this->mctpEid, yield);
+    auto logPredictableLatencyPerNVMSet =
+        getLogPagePredictableLatencyPerNVMSet(transport, eid, yield);
     if (logPredictableLatencyPerNVMSet)
     {
         getLogPage["PredictableLatencyPerNVMSet"] =
             logPredictableLatencyPerNVMSet.value();
     }
     auto logPredictableLatencyEventAggregate =
-        getLogPagePredictableLatencyEventAggregate(*this->mctpWrapper,
-                                                   this->mctpEid, yield);
+        getLogPagePredictableLatencyEventAggregate(transport, eid, yield);
     if (logPredictableLatencyEventAggregate)
     {
         getLogPage["PredictableLatencyEventAggregate"] =
             logPredictableLatencyEventAggregate.value();
     }
-    auto logAsymmetricNamespaceAccess = getLogPageAsymmetricNamespaceAccess(
-        *this->mctpWrapper, this->mctpEid, yield);
+    auto logAsymmetricNamespaceAccess =
+        getLogPageAsymmetricNamespaceAccess(transport, eid, yield);
     if (logAsymmetricNamespaceAccess)
     {
         getLogPage["AsymmetricNamespaceAccess"] =
             logAsymmetricNamespaceAccess.value();
     }
     auto logPersistentEventLog =
-        getLogPagePersistentEventLog(*this->mctpWrapper, this->mctpEid, yield);
+        getLogPagePersistentEventLog(transport, eid, yield);
     if (logPersistentEventLog)
     {
         getLogPage["PersistentEventLog"] = logPersistentEventLog.value();
     }
     auto logEnduranceGroupEventAggregate =
-        getLogPageEnduranceGroupEventAggregate(*this->mctpWrapper,
-                                               this->mctpEid, yield);
+        getLogPageEnduranceGroupEventAggregate(transport, eid, yield);
     if (logEnduranceGroupEventAggregate)
     {
         getLogPage["EnduranceGroupEventAggregate"] =
             logEnduranceGroupEventAggregate.value();
     }
-    jsonObject["GetLogPage"] = getLogPage;
+}
 
+static void collectIdentifySection(nvmemi::Transport& transport,
+                                   mctpw::eid_t eid,
+                                   boost::asio::yield_context yield,
+                                   LogContext& context)
+{
     nlohmann::json identifyJson;
-    auto activeNamespaces = getIdentifyActiveNamespaceIdList(
-        *this->mctpWrapper, this->mctpEid, yield);
+    auto activeNamespaces =
+        getIdentifyActiveNamespaceIdList(transport, eid, yield);
     identifyJson["ActiveNamespaces"] = activeNamespaces;
     nlohmann::json namespaceJson;
     for (auto nsId : activeNamespaces)
     {
-        auto rsp = getIdentifyNamespaceIdDescList(*this->mctpWrapper,
-                                                  this->mctpEid, yield, nsId);
+        auto rsp = getIdentifyNamespaceIdDescList(transport, eid, yield, nsId);
         if (rsp)
         {
             namespaceJson["Namespace" + std::to_string(nsId)] = rsp.value();
@@ -1360,12 +2312,11 @@ std::tuple<int, std::string>
     }
     identifyJson["NamespaceIdDescList"] = namespaceJson;
     nlohmann::json controllerIdentify;
-    if (controllerIds.has_value())
+    if (context.controllerIds.has_value())
     {
-        for (auto cntrlId : controllerIds.value())
+        for (auto cntrlId : context.controllerIds.value())
         {
-            auto rsp = getIdentifyController(*this->mctpWrapper, this->mctpEid,
-                                             yield, cntrlId);
+            auto rsp = getIdentifyController(transport, eid, yield, cntrlId);
             if (rsp)
             {
                 controllerIdentify["Controller" + std::to_string(cntrlId)] =
@@ -1374,46 +2325,481 @@ std::tuple<int, std::string>
         }
         identifyJson["Controllers"] = controllerIdentify;
     }
-    auto namespaceCapablity =
-        getIdentifyCommonNamespace(*this->mctpWrapper, this->mctpEid, yield);
+    auto namespaceCapablity = getIdentifyCommonNamespace(transport, eid, yield);
     if (namespaceCapablity)
     {
         identifyJson["CommonNamespaceCapablity"] = namespaceCapablity.value();
     }
-    jsonObject["Identify"] = identifyJson;
+    context.jsonObject["Identify"] = identifyJson;
+}
+
+/**
+ * @brief Build the capability map of the drive from the optional commands
+ * list, Identify Controller and the Commands Supported and Effects log. Runs
+ * once per drive; entries that could not be read stay unknown and are learnt
+ * from the errors of the requests instead.
+ *
+ */
+static void discoverCapabilities(nvmemi::Transport& transport,
+                                 mctpw::eid_t eid,
+                                 boost::asio::yield_context yield)
+{
+    auto capabilities = nvmemi::capabilities::getEndpoint(eid);
+    if (capabilities == nullptr || capabilities->isDiscovered())
+    {
+        return;
+    }
+    capabilities->setDiscovered();
+    try
+    {
+        std::vector<std::pair<uint8_t, uint8_t>> commands;
+        for (const auto& [msgType, cmd] :
+             getOptionalCommands(transport, eid, yield))
+        {
+            commands.emplace_back(static_cast<uint8_t>(msgType), cmd);
+        }
+        capabilities->setOptionalCommands(commands);
+    }
+    catch (const std::exception& e)
+    {
+        phosphor::logging::log<phosphor::logging::level::WARNING>(
+            "Error getting optional commands",
+            phosphor::logging::entry("MSG=%s", e.what()));
+    }
+    try
+    {
+        static constexpr uint16_t identifySize = 512;
+        auto controllers = getControllerList(transport, eid, yield);
+        if (!controllers.empty())
+        {
+            auto identify = getIdentifyData(
+                transport, eid, yield,
+                nvmemi::protocol::identify::ControllerNamespaceStruct::
+                    controllerIdentify,
+                identifySize, clearedNamespaceId, controllers.front());
+            if (identify)
+            {
+                capabilities->setIdentifyController(identify->data(),
+                                                    identify->size());
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        phosphor::logging::log<phosphor::logging::level::WARNING>(
+            "Error getting controller capabilities",
+            phosphor::logging::entry("MSG=%s", e.what()));
+    }
+    // Admin command entries only, the I/O command entries are not needed
+    static constexpr uint32_t adminEntriesSize = 256 * sizeof(uint32_t);
+    auto commandsSupported = getLogPageData(
+        transport, eid, yield,
+        nvmemi::protocol::getlog::LogPage::commandsSupportedEffects,
+        adminEntriesSize);
+    if (commandsSupported)
+    {
+        capabilities->setCommandsSupported(commandsSupported->data(),
+                                           commandsSupported->size());
+    }
+}
+
+using Section = nvmemi::logprofile::Section;
+using LogSectionCollector = void (*)(nvmemi::Transport&, mctpw::eid_t,
+                                     boost::asio::yield_context, LogContext&);
 
+struct LogSection
+{
+    const char* name;
+    nvmemi::logprofile::Section section;
+    LogSectionCollector collect;
+};
+
+/**
+ * @brief Log sections in the order they are collected. Later sections can use
+ * data cached in LogContext by the earlier ones.
+ *
+ */
+static const std::array<LogSection, 11> logSections = {
+    LogSection{"SubsystemInfo", Section::subsystemInfo,
+               collectSubsystemInfoSection},
+    LogSection{"Controllers", Section::controllers, collectControllersSection},
+    LogSection{"OptionalCommands", Section::optionalCommands,
+               collectOptionalCommandsSection},
+    LogSection{"ControllerHSPoll", Section::controllerHSPoll,
+               collectControllerHSPollSection},
+    LogSection{"SubsystemHSPoll", Section::subsystemHSPoll,
+               collectSubsystemHSPollSection},
+    LogSection{"ConfigGet", Section::configGet, collectConfigGetSection},
+    LogSection{"GetFeatures", Section::getFeatures, collectGetFeaturesSection},
+    LogSection{"ErrorLog", Section::errorLog, collectErrorLogSection},
+    LogSection{"SMARTHealthLog", Section::smartHealthLog,
+               collectSMARTHealthLogSection},
+    LogSection{"OtherLogPages", Section::otherLogPages,
+               collectOtherLogPagesSection},
+    LogSection{"Identify", Section::identify, collectIdentifySection}};
+
+void Drive::programTemperatureThresholds(boost::asio::yield_context yield)
+{
+    using nvmemi::thresholds::Direction;
+    using nvmemi::thresholds::Level;
+    if (isUnsupported(
+            mctpEid, CapabilityKind::adminCommand,
+            static_cast<uint8_t>(nvmemi::protocol::AdminOpCode::setFeatures)))
+    {
+        return;
+    }
+    for (bool over : {true, false})
+    {
+        auto celsius = subsystemTemp.getThreshold(
+            Level::warning, over ? Direction::high : Direction::low);
+        if (!celsius || std::isnan(*celsius))
+        {
+            continue;
+        }
+        auto kelvin = static_cast<uint16_t>(std::clamp<long>(
+            std::lround(*celsius + 273.0), 0,
+            std::numeric_limits<uint16_t>::max()));
+        try
+        {
+            setFeatureTemperatureThreshold(*transport, mctpEid, yield, kelvin,
+                                           over);
+        }
+        catch (const std::exception& e)
+        {
+            phosphor::logging::log<phosphor::logging::level::WARNING>(
+                "Error setting temperature threshold",
+                phosphor::logging::entry("DRIVE=%s", this->name.c_str()),
+                phosphor::logging::entry("OVER=%d", over),
+                phosphor::logging::entry("MSG=%s", e.what()));
+        }
+    }
+}
+
+void Drive::refreshInventory(boost::asio::yield_context yield)
+{
+    if (isUnsupported(
+            mctpEid, CapabilityKind::miCommand,
+            static_cast<uint8_t>(nvmemi::protocol::MiOpCode::vpdRead)))
+    {
+        return;
+    }
+    std::vector<uint8_t> data;
+    try
+    {
+        data = readVpd(*transport, mctpEid, yield);
+    }
+    catch (const std::exception& e)
+    {
+        phosphor::logging::log<phosphor::logging::level::WARNING>(
+            "Error reading VPD",
+            phosphor::logging::entry("DRIVE=%s", name.c_str()),
+            phosphor::logging::entry("MSG=%s", e.what()));
+        return;
+    }
+    if (assetInterface && data == vpd)
+    {
+        return;
+    }
+    auto fru = nvmemi::fru::parse(data.data(), data.size());
+    if (!fru)
+    {
+        phosphor::logging::log<phosphor::logging::level::WARNING>(
+            "VPD is not in the FRU format",
+            phosphor::logging::entry("DRIVE=%s", name.c_str()));
+        return;
+    }
+    vpd = std::move(data);
+    // Product info describes the drive, board info is the fallback
+    auto pick = [](const std::string& product, const std::string& board) {
+        return product.empty() ? board : product;
+    };
+    std::array<std::pair<const char*, std::string>, 4> properties = {{
+        {"Manufacturer",
+         pick(fru->productManufacturer, fru->boardManufacturer)},
+        {"Model", pick(fru->productName, fru->boardProductName)},
+        {"PartNumber", pick(fru->productPartNumber, fru->boardPartNumber)},
+        {"SerialNumber",
+         pick(fru->productSerialNumber, fru->boardSerialNumber)},
+    }};
+    if (!assetInterface)
+    {
+        assetInterface = objectServer.add_unique_interface(
+            nvmemi::constants::openBmcDBusPrefix + name,
+            "xyz.openbmc_project.Inventory.Decorator.Asset");
+        for (const auto& [property, value] : properties)
+        {
+            assetInterface->register_property(property, value);
+        }
+        assetInterface->initialize();
+    }
+    else
+    {
+        for (const auto& [property, value] : properties)
+        {
+            assetInterface->set_property(property, value);
+        }
+    }
+    phosphor::logging::log<phosphor::logging::level::INFO>(
+        "Drive inventory updated from VPD",
+        phosphor::logging::entry("DRIVE=%s", name.c_str()),
+        phosphor::logging::entry("SIZE=%zu", vpd.size()));
+}
+
+void Drive::negotiatePortSettings(boost::asio::yield_context yield)
+{
+    namespace configuration = nvmemi::protocol::configuration;
+    using nvmemi::protocol::readnvmeds::PortInfo;
+    using nvmemi::protocol::readnvmeds::PortType;
+    if (isUnsupported(
+            mctpEid, CapabilityKind::miCommand,
+            static_cast<uint8_t>(nvmemi::protocol::MiOpCode::configSet)))
+    {
+        return;
+    }
+    try
+    {
+        auto subsystemInfo = getSubsystemInfo(*transport, mctpEid, yield);
+        for (size_t portIdx = 0; portIdx <= subsystemInfo->numberOfPorts;
+             portIdx++)
+        {
+            auto portId = static_cast<uint8_t>(portIdx);
+            nvmemi::ResponseStruct<PortInfo> port(
+                getNVMeDatastructOptionalData(*transport, mctpEid, yield,
+                                              DataStructureType::portInfo,
+                                              portId, 0));
+            if (port->portType != PortType::smbus)
+            {
+                continue;
+            }
+            if (maxSMBusFrequency != SMBusFrequency::notSupported)
+            {
+                auto current = static_cast<SMBusFrequency>(
+                    getSMBusI2CFrequency(*transport, mctpEid, yield, portId));
+                auto target = configuration::negotiateFrequency(
+                    current,
+                    static_cast<SMBusFrequency>(
+                        port->managementEndpointMaxFrequency & 0x0F),
+                    maxSMBusFrequency);
+                if (target != current &&
+                    changeConfiguration(
+                        current, target,
+                        [&]() {
+                            return static_cast<SMBusFrequency>(
+                                getSMBusI2CFrequency(*transport, mctpEid,
+                                                     yield, portId));
+                        },
+                        [&](SMBusFrequency frequency) {
+                            setSMBusI2CFrequency(*transport, mctpEid, yield,
+                                                 portId, frequency);
+                        }))
+                {
+                    phosphor::logging::log<phosphor::logging::level::INFO>(
+                        "SMBus frequency raised",
+                        phosphor::logging::entry("DRIVE=%s", name.c_str()),
+                        phosphor::logging::entry("PORT=%d", portId),
+                        phosphor::logging::entry("FREQUENCY=%d",
+                                                 static_cast<int>(target)));
+                }
+            }
+            if (maxMctpUnitSize != 0)
+            {
+                uint16_t current = getMCTPTransportUnitSize(
+                    *transport, mctpEid, yield, portId);
+                uint16_t target = configuration::negotiateUnitSize(
+                    current, le16toh(port->maxMctpUnitSize), maxMctpUnitSize);
+                if (target != current &&
+                    changeConfiguration(
+                        current, target,
+                        [&]() {
+                            return getMCTPTransportUnitSize(
+                                *transport, mctpEid, yield, portId);
+                        },
+                        [&](uint16_t unitSize) {
+                            setMCTPTransportUnitSize(*transport, mctpEid,
+                                                     yield, portId, unitSize);
+                        }))
+                {
+                    phosphor::logging::log<phosphor::logging::level::INFO>(
+                        "MCTP transmission unit size raised",
+                        phosphor::logging::entry("DRIVE=%s", name.c_str()),
+                        phosphor::logging::entry("PORT=%d", portId),
+                        phosphor::logging::entry("SIZE=%d", target));
+                }
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        phosphor::logging::log<phosphor::logging::level::WARNING>(
+            "Error negotiating port settings",
+            phosphor::logging::entry("DRIVE=%s", name.c_str()),
+            phosphor::logging::entry("MSG=%s", e.what()));
+    }
+}
+
+std::vector<std::string> Drive::getLogSectionNames(uint32_t sectionMask)
+{
+    std::vector<std::string> names;
+    for (const auto& section : logSections)
+    {
+        if ((sectionMask & section.section) != 0)
+        {
+            names.emplace_back(section.name);
+        }
+    }
+    return names;
+}
+
+std::string Drive::startCollectLogJob(boost::asio::yield_context yield,
+                                      uint32_t sectionMask)
+{
+    // Keep the most recent finished jobs so that clients can still read the
+    // result after the Completed signal
+    size_t finishedJobs = std::count_if(
+        logJobs.begin(), logJobs.end(),
+        [](const auto& job) { return job->isFinished(); });
+    for (auto it = logJobs.begin();
+         it != logJobs.end() && finishedJobs >= maxFinishedLogJobs;)
+    {
+        if ((*it)->isFinished())
+        {
+            it = logJobs.erase(it);
+            finishedJobs--;
+        }
+        else
+        {
+            it++;
+        }
+    }
+
+    std::string objectPath = nvmemi::constants::openBmcDBusPrefix + name +
+                             "/collect_log/" +
+                             std::to_string(logJobCounter++);
+    std::weak_ptr<Drive> weakDrive = weak_from_this();
+    auto job = std::make_shared<CollectLogJob>(
+        objectServer, objectPath, getLogSectionNames(sectionMask),
+        [weakDrive, sectionMask](
+            boost::asio::yield_context jobYield,
+            CollectLogJob& self) -> std::tuple<int, std::string> {
+            auto drive = weakDrive.lock();
+            if (!drive)
+            {
+                return std::make_tuple(-1, "Drive removed");
+            }
+            std::tuple<int, std::string> status;
+            try
+            {
+                status =
+                    drive->collectDriveLog(jobYield, sectionMask, &self);
+            }
+            catch (const std::exception& e)
+            {
+                status = std::make_tuple(-1, std::string(e.what()));
+            }
+            return status;
+        });
+    logJobs.emplace_back(job);
+    nvmemi::collectlog::enqueue(job, yield);
+    return objectPath;
+}
+
+std::tuple<int, std::string>
+    Drive::collectDriveLog(boost::asio::yield_context yield,
+                           uint32_t sectionMask, CollectLogJob* job)
+{
+    enum ErrorStatus : uint8_t
+    {
+        success = 0,
+        fileSystem,
+        emptyJson,
+        cancelled,
+    };
+    using SectionStatus = CollectLogJob::SectionStatus;
+
+    // Optional log pages are the requests pruned by the discovery, the
+    // others are only skipped once the drive rejected them
+    if ((sectionMask & Section::otherLogPages) != 0)
+    {
+        discoverCapabilities(*this->transport, this->mctpEid, yield);
+    }
+    LogContext context;
+    for (const auto& section : logSections)
+    {
+        if ((sectionMask & section.section) == 0)
+        {
+            continue;
+        }
+        if (job != nullptr && job->isCancelRequested())
+        {
+            return std::make_tuple(ErrorStatus::cancelled, "Cancelled");
+        }
+        if (job != nullptr)
+        {
+            job->setSectionStatus(section.name, SectionStatus::running);
+        }
+        SectionStatus status = SectionStatus::completed;
+        try
+        {
+            section.collect(*this->transport, this->mctpEid, yield,
+                            context);
+        }
+        catch (const std::exception& e)
+        {
+            phosphor::logging::log<phosphor::logging::level::WARNING>(
+                "Error collecting log section",
+                phosphor::logging::entry("SECTION=%s", section.name),
+                phosphor::logging::entry("MSG=%s", e.what()));
+            status = SectionStatus::failed;
+        }
+        if (job != nullptr)
+        {
+            job->setSectionStatus(section.name, status);
+        }
+    }
+    nlohmann::json& jsonObject = context.jsonObject;
     if (jsonObject.empty())
     {
-        std::make_tuple(ErrorStatus::emptyJson,
+        return std::make_tuple(ErrorStatus::emptyJson,
                         "All commands failed to get response");
     }
 
-    unsigned long fileCount =
-        std::chrono::system_clock::now().time_since_epoch() /
-        std::chrono::milliseconds(1);
-    std::string fileName =
-        "/tmp/nvmemi_jsondump_" + std::to_string(fileCount) + ".json";
-    std::fstream jsonDump(fileName, std::ios::out);
-    if (!jsonDump.is_open())
+    try
     {
-        std::string errString =
-            "Error opening " + fileName + ". " + strerror(errno);
-        return std::make_tuple(ErrorStatus::fileSystem, errString);
+        // Serializing and compressing a full dump takes long enough to delay
+        // the health polls, so it runs on a worker thread
+        auto dump = nvmemi::workers::offload(yield, [&jsonObject]() {
+            return nvmemi::dumpstore::get().add(jsonObject.dump(
+                2, ' ', true, nlohmann::json::error_handler_t::replace));
+        });
+        return std::make_tuple(ErrorStatus::success, dump.path.string());
+    }
+    catch (const std::exception& e)
+    {
+        return std::make_tuple(ErrorStatus::fileSystem,
+                               std::string("Error writing dump. ") + e.what());
     }
-    jsonDump << jsonObject.dump(2, ' ', true,
-                                nlohmann::json::error_handler_t::replace);
-    return std::make_tuple(ErrorStatus::success, fileName);
 }
 
 bool Drive::validateResponse(const std::vector<uint8_t>& response)
 {
-    nvmemi::protocol::NVMeResponse respMsg(response);
-    if (respMsg.getStatus() !=
+    std::optional<nvmemi::protocol::NVMeResponse<const uint8_t*>> respMsg;
+    try
+    {
+        respMsg.emplace(response.data(), response.size());
+    }
+    catch (const std::exception& e)
+    {
+        phosphor::logging::log<phosphor::logging::level::ERR>(
+            "Invalid NVMe response",
+            phosphor::logging::entry("MSG=%s", e.what()));
+        return false;
+    }
+    if (respMsg->getStatus() !=
         static_cast<uint8_t>(nvmemi::protocol::Status::success))
     {
         phosphor::logging::log<phosphor::logging::level::ERR>(
             "NVMe Response error",
-            phosphor::logging::entry("STATUSCODE=%d", respMsg.getStatus()));
+            phosphor::logging::entry("STATUSCODE=%d", respMsg->getStatus()));
         return false;
     }
     return true;
@@ -16,11 +16,21 @@
 
 #pragma once
 
+#include "collect_log_job.hpp"
+#include "drive_state.hpp"
+#include "health_history.hpp"
 #include "numeric_sensor.hpp"
+#include "protocol/mi/configuration.hpp"
+#include "protocol/mi/subsystem_hs_poll.hpp"
+#include "transport.hpp"
 
+#include <chrono>
+#include <deque>
 #include <mctp_wrapper.hpp>
+#include <optional>
 #include <sdbusplus/asio/object_server.hpp>
 #include <string>
+#include <vector>
 
 namespace nvmemi
 {
@@ -28,7 +38,7 @@ namespace nvmemi
  * @brief Represents NVMe drive
  *
  */
-class Drive
+class Drive : public std::enable_shared_from_this<Drive>
 {
   public:
     /**
@@ -38,33 +48,201 @@ class Drive
      * @param eid MCTP EID of the drive
      * @param objServer Existing sdbusplus object_server
      * @param wrapper shared_ptr to MCTPWrapper
+     * @param mctpTransport Transport for the requests. Requests go through
+     * the wrapper if not set.
      */
     Drive(const std::string& driveName, mctpw::eid_t eid,
           sdbusplus::asio::object_server& objServer,
-          std::shared_ptr<mctpw::MCTPWrapper> wrapper);
+          std::shared_ptr<mctpw::MCTPWrapper> wrapper,
+          std::shared_ptr<Transport> mctpTransport = nullptr);
+    Drive(const Drive&) = delete;
+    Drive& operator=(const Drive&) = delete;
+    ~Drive();
     /**
      * @brief Send MCTP request for NVM Subsystem health status poll and receive
      * response
      *
      * @param yield yield_context object to wait on mctp transfers
+     * @return true if the drive answered with a health status, false if the
+     * poll was skipped or failed
      */
-    void pollSubsystemHealthStatus(boost::asio::yield_context yield);
+    bool pollSubsystemHealthStatus(boost::asio::yield_context yield);
+    /**
+     * @brief Poll with clearStatus set and act on the change flags of the
+     * composite controller status instead of re-reading the levels. Drives
+     * without changes are polled less often.
+     *
+     * @param enable true to read and clear the status on every poll
+     */
+    static void setClearStatusPolling(bool enable);
+    /**
+     * @brief Program the warning thresholds of the temperature sensor into
+     * the over and under temperature thresholds of the drive, so that the
+     * drive raises the critical warning itself. Thresholds are programmed
+     * after the first poll, after a controller reset and when they are
+     * changed over DBus.
+     *
+     * @param enable true to program the thresholds
+     */
+    static void setThresholdProgramming(bool enable);
+    /**
+     * @brief Log every request and response in hex at DEBUG level
+     *
+     * @param enable true to log the messages
+     */
+    static void setMessageLogging(bool enable);
+    /**
+     * @brief Set the highest SMBus frequency and MCTP transmission unit size
+     * the platform supports. After the first poll of a drive, each of its
+     * SMBus ports is raised to the highest values both sides support. Each
+     * change is read back and undone if it did not take effect.
+     *
+     * @param smbusFrequency Frequency limit. notSupported keeps the frequency
+     * of the drives.
+     * @param mctpUnitSize Unit size limit in bytes. 0 keeps the unit size of
+     * the drives.
+     */
+    static void setPortLimits(
+        nvmemi::protocol::configuration::SMBusFrequency smbusFrequency,
+        uint16_t mctpUnitSize);
+    /**
+     * @brief Mark the drive as present or absent. While absent the sensor
+     * reports no reading. A drive that comes back gets a fresh error budget.
+     *
+     * @param present true if the drive is reachable again
+     */
+    void setPresence(bool present);
+    /**
+     * @brief Read the identity of the NVM subsystem behind an EID. This is
+     * the NQN of the subsystem, or the serial and model numbers if the
+     * controller does not report an NQN. EIDs with the same identity lead to
+     * the same subsystem, for example the two ports of a dual port drive.
+     *
+     * @param transport Transport for the requests
+     * @param eid MCTP EID to identify
+     * @param yield yield_context object to wait on mctp transfers
+     * @return std::optional<std::string> nullopt if Identify failed
+     */
+    static std::optional<std::string>
+        readSubsystemId(Transport& transport, mctpw::eid_t eid,
+                        boost::asio::yield_context yield);
+    /**
+     * @brief Add an other EID through which the drive is reachable. Requests
+     * go through the active path only and move to the next path when a
+     * health status poll fails on the active one.
+     *
+     * @param eid MCTP EID of the path
+     * @param wrapper shared_ptr to MCTPWrapper the EID was found through
+     */
+    void addPath(mctpw::eid_t eid,
+                 const std::shared_ptr<mctpw::MCTPWrapper>& wrapper);
+    /**
+     * @brief Remove a path of the drive. The last path is never removed.
+     *
+     * @param eid MCTP EID of the path
+     * @return true if the path was removed and the drive is still reachable
+     * through an other path
+     */
+    bool removePath(mctpw::eid_t eid);
+    /**
+     * @brief Get the EID of the active path
+     *
+     */
+    mctpw::eid_t getEid() const;
+    const std::vector<mctpw::eid_t>& getPaths() const;
+    const std::optional<std::string>& getSubsystemId() const;
+    void setSubsystemId(std::optional<std::string> id);
+    const std::string& getName() const;
+    /**
+     * @brief Get the snapshot of the drive to be saved in the state file
+     *
+     */
+    DriveState getState() const;
+    /**
+     * @brief Publish the readings of a snapshot from the previous run right
+     * away. The drive is marked stale until the next successful poll.
+     *
+     * @param state Snapshot of the drive
+     * @param maxAge Readings older than this are not published
+     */
+    void restoreState(const DriveState& state, std::chrono::seconds maxAge);
+    /**
+     * @brief Get the names of the log sections selected by a section mask
+     *
+     * @param sectionMask Bitwise OR of nvmemi::logprofile::Section values
+     */
+    static std::vector<std::string> getLogSectionNames(uint32_t sectionMask);
 
   private:
     std::tuple<int, std::string>
-        collectDriveLog(boost::asio::yield_context yield);
+        collectDriveLog(boost::asio::yield_context yield, uint32_t sectionMask,
+                        CollectLogJob* job = nullptr);
+    std::string startCollectLogJob(boost::asio::yield_context yield,
+                                   uint32_t sectionMask);
 
     std::string name{};
-    std::shared_ptr<mctpw::MCTPWrapper> mctpWrapper{};
+    std::shared_ptr<Transport> transport{};
+    sdbusplus::asio::object_server& objectServer;
     NumericSensor subsystemTemp;
+    /** @brief EID of the active path */
     mctpw::eid_t mctpEid{};
-    static constexpr std::chrono::milliseconds hsPollTimeout{100};
+    /** @brief EIDs of all the paths to the drive, in order of preference */
+    std::vector<mctpw::eid_t> paths{};
+    std::optional<std::string> subsystemId{};
     bool cwarnState = false;
     std::unique_ptr<sdbusplus::asio::dbus_interface> driveLogInterface{};
-    static inline bool pausePollRequested = false;
+    std::deque<std::shared_ptr<CollectLogJob>> logJobs{};
+    size_t logJobCounter = 0;
+    /** @brief Number of finished jobs kept on DBus for each drive */
+    static constexpr size_t maxFinishedLogJobs = 4;
     static constexpr uint8_t maxHealthStatusCount = 10;
     uint8_t curErrorCount = 0;
+    bool pollInProgress = false;
+    /** @brief runPendingSetup is running */
+    bool setupInProgress = false;
+    /** @brief Next clearStatus poll treats every status as changed */
+    bool refreshPending = true;
+    /** @brief Consecutive clearStatus polls without a change */
+    uint8_t quietPolls = 0;
+    uint8_t skippedPolls = 0;
+    static constexpr uint8_t quietPollsBeforeSlowdown = 10;
+    /** @brief Quiet drives are polled on every slowPollDivider-th sweep */
+    static constexpr uint8_t slowPollDivider = 5;
+    /** @brief Temperature thresholds to be programmed after the next poll */
+    bool thresholdsPending = false;
+    /** @brief Port settings to be negotiated after the next poll */
+    bool portsPending = false;
+    /** @brief VPD to be read after the next poll */
+    bool inventoryPending = false;
+    /** @brief VPD published on the Asset interface */
+    std::vector<uint8_t> vpd{};
+    std::unique_ptr<sdbusplus::asio::dbus_interface> assetInterface{};
+    HealthHistory healthHistory{};
+    std::optional<HealthSample> lastHealth{};
+    void setStale(bool stale);
+    void failOver();
+    /**
+     * @brief Count a failed health status poll and switch to the next path.
+     * The drive is excluded from the polling at maxHealthStatusCount.
+     */
+    void onPollFailure();
+    void publishPaths();
+    void registerPath(mctpw::eid_t eid,
+                      const std::shared_ptr<mctpw::MCTPWrapper>& wrapper);
+    void unregisterPath(mctpw::eid_t eid);
     void logCWarnState(bool cwarn);
+    void programTemperatureThresholds(boost::asio::yield_context yield);
+    void negotiatePortSettings(boost::asio::yield_context yield);
+    void refreshInventory(boost::asio::yield_context yield);
+    /**
+     * @brief Negotiate the ports, read the VPD and program the thresholds if
+     * pending. Health status polls of the drive are skipped while the ports
+     * are negotiated.
+     */
+    void runPendingSetup(boost::asio::yield_context yield);
+    static bool isPortNegotiationEnabled();
+    void handleStatusChanges(
+        const nvmemi::protocol::subsystemhs::ResponseData& health);
     static bool validateResponse(const std::vector<uint8_t>& response);
 };
 } // namespace nvmemi
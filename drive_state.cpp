@@ -0,0 +1,220 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "drive_state.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+using nvmemi::DaemonState;
+using nvmemi::DriveState;
+
+static constexpr int stateFileVersion = 1;
+
+/**
+ * @brief Write a file and flush it to the storage before returning, so that
+ * it can replace the previous state file
+ *
+ * @return true on success
+ */
+static bool writeSynced(const std::filesystem::path& path,
+                        const std::string& content)
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    const char* data = content.data();
+    size_t remaining = content.size();
+    while (remaining > 0)
+    {
+        ssize_t written = ::write(fd, data, remaining);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    bool synced = ::fsync(fd) == 0;
+    return ::close(fd) == 0 && synced;
+}
+
+/**
+ * @brief Flush a directory entry change, e.g. a rename, to the storage
+ */
+static void syncDirectory(const std::filesystem::path& dir)
+{
+    int fd = ::open(dir.empty() ? "." : dir.c_str(),
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+    ::fsync(fd);
+    ::close(fd);
+}
+
+const DriveState* DaemonState::findByName(const std::string& name) const
+{
+    for (const auto& drive : drives)
+    {
+        if (drive.name == name)
+        {
+            return &drive;
+        }
+    }
+    return nullptr;
+}
+
+const DriveState* DaemonState::findByEid(uint8_t eid) const
+{
+    for (const auto& drive : drives)
+    {
+        if (drive.eid == eid)
+        {
+            return &drive;
+        }
+    }
+    return nullptr;
+}
+
+bool DaemonState::sameDurableState(const DaemonState& other) const
+{
+    if (driveCounter != other.driveCounter ||
+        drives.size() != other.drives.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < drives.size(); i++)
+    {
+        const DriveState& lhs = drives[i];
+        const DriveState& rhs = other.drives[i];
+        if (lhs.name != rhs.name || lhs.eid != rhs.eid ||
+            lhs.criticalWarning != rhs.criticalWarning ||
+            lhs.errorCount != rhs.errorCount)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace nvmemi::statefile
+{
+DaemonState load(const std::filesystem::path& path)
+{
+    DaemonState state;
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        if (!std::filesystem::exists(path))
+        {
+            return state;
+        }
+        throw std::runtime_error("Error opening " + path.string());
+    }
+    try
+    {
+        nlohmann::json json = nlohmann::json::parse(file);
+        if (json.at("Version").get<int>() != stateFileVersion)
+        {
+            throw std::runtime_error("Unsupported state file version");
+        }
+        state.driveCounter = json.at("DriveCounter").get<size_t>();
+        for (const auto& driveJson : json.at("Drives"))
+        {
+            DriveState drive{};
+            drive.name = driveJson.at("Name").get<std::string>();
+            drive.eid = driveJson.at("EID").get<uint8_t>();
+            drive.criticalWarning =
+                driveJson.at("CriticalWarning").get<bool>();
+            drive.errorCount = driveJson.at("ErrorCount").get<uint8_t>();
+            if (driveJson.contains("Health"))
+            {
+                HealthSample sample{};
+                sample.timestamp =
+                    driveJson.at("HealthTimestamp").get<uint32_t>();
+                sample.data = driveJson.at("Health")
+                                  .get<decltype(HealthSample::data)>();
+                drive.lastHealth = sample;
+            }
+            state.drives.emplace_back(std::move(drive));
+        }
+    }
+    catch (const nlohmann::json::exception& e)
+    {
+        throw std::runtime_error("Invalid state file " + path.string() +
+                                 ". " + e.what());
+    }
+    return state;
+}
+
+void save(const std::filesystem::path& path, const DaemonState& state)
+{
+    nlohmann::json json;
+    json["Version"] = stateFileVersion;
+    json["DriveCounter"] = state.driveCounter;
+    json["Drives"] = nlohmann::json::array();
+    for (const auto& drive : state.drives)
+    {
+        nlohmann::json driveJson;
+        driveJson["Name"] = drive.name;
+        driveJson["EID"] = drive.eid;
+        driveJson["CriticalWarning"] = drive.criticalWarning;
+        driveJson["ErrorCount"] = drive.errorCount;
+        if (drive.lastHealth)
+        {
+            driveJson["HealthTimestamp"] = drive.lastHealth->timestamp;
+            driveJson["Health"] = drive.lastHealth->data;
+        }
+        json["Drives"].emplace_back(std::move(driveJson));
+    }
+
+    std::error_code ec;
+    if (path.has_parent_path())
+    {
+        std::filesystem::create_directories(path.parent_path(), ec);
+    }
+    std::filesystem::path tmpPath = path;
+    tmpPath += ".tmp";
+    // The data must be on the storage before the rename, or a power loss
+    // can leave an empty file in place of the previous state
+    if (!writeSynced(tmpPath, json.dump()))
+    {
+        std::filesystem::remove(tmpPath, ec);
+        throw std::runtime_error("Error writing " + tmpPath.string());
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tmpPath, ec);
+        throw std::runtime_error("Error replacing " + path.string());
+    }
+    syncDirectory(path.parent_path());
+}
+} // namespace nvmemi::statefile
@@ -0,0 +1,96 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include "health_history.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace nvmemi
+{
+/**
+ * @brief Snapshot of a drive kept across daemon restarts
+ *
+ */
+struct DriveState
+{
+    std::string name;
+    uint8_t eid;
+    /** @brief Last subsystem health status poll result */
+    std::optional<HealthSample> lastHealth;
+    bool criticalWarning;
+    /** @brief Consecutive poll errors, polling stops at the limit */
+    uint8_t errorCount;
+};
+
+/**
+ * @brief State of the daemon written to the state file
+ *
+ */
+struct DaemonState
+{
+    /** @brief Next number for drives named by counter */
+    size_t driveCounter = 1;
+    std::vector<DriveState> drives;
+
+    /**
+     * @brief Find the snapshot of a drive by name
+     *
+     * @return const DriveState* nullptr if there is none
+     */
+    const DriveState* findByName(const std::string& name) const;
+    /**
+     * @brief Find the snapshot of a drive by EID
+     *
+     * @return const DriveState* nullptr if there is none
+     */
+    const DriveState* findByEid(uint8_t eid) const;
+    /**
+     * @brief Compare the fields that are worth a write of the state file:
+     * drive counter and the name, EID, critical warning and error count of
+     * every drive. Health readings are not compared as they change on
+     * every poll.
+     *
+     * @return true if the durable fields of both states are equal
+     */
+    bool sameDurableState(const DaemonState& other) const;
+};
+
+namespace statefile
+{
+/**
+ * @brief Read the state file
+ *
+ * @param path Path of the state file
+ * @return DaemonState Saved state, empty if the file does not exist
+ * @throws std::runtime_error if the file can not be read or parsed
+ */
+DaemonState load(const std::filesystem::path& path);
+/**
+ * @brief Write the state file. The file is replaced atomically so that a
+ * reset while writing leaves the previous state.
+ *
+ * @param path Path of the state file. The directory is created if missing.
+ * @param state State to be written
+ * @throws std::runtime_error if the file can not be written
+ */
+void save(const std::filesystem::path& path, const DaemonState& state);
+} // namespace statefile
+} // namespace nvmemi
@@ -0,0 +1,341 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "dump_store.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <phosphor-logging/log.hpp>
+#include <system_error>
+
+#ifdef NVME_DUMP_GZIP
+#include <zlib.h>
+#endif
+
+using nvmemi::DumpStore;
+
+static constexpr std::string_view jsonSuffix = ".json";
+static constexpr std::string_view gzipSuffix = ".json.gz";
+
+static bool endsWith(std::string_view str, std::string_view suffix)
+{
+    return str.size() >= suffix.size() &&
+           str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+DumpStore::DumpStore(const std::filesystem::path& directoryIn,
+                     uintmax_t quotaIn, Compression compressionIn) :
+    directory(directoryIn),
+    quota(quotaIn), compression(compressionIn)
+{
+    std::filesystem::create_directories(directory);
+    scan();
+    rotate();
+}
+
+void DumpStore::scan()
+{
+    std::vector<std::pair<std::filesystem::file_time_type, Entry>> found;
+    for (const auto& file : std::filesystem::directory_iterator(directory))
+    {
+        std::string fileName = file.path().filename().string();
+        if (!file.is_regular_file() || fileName.rfind(filePrefix, 0) != 0)
+        {
+            continue;
+        }
+        std::string_view suffix;
+        if (endsWith(fileName, gzipSuffix))
+        {
+            suffix = gzipSuffix;
+        }
+        else if (endsWith(fileName, jsonSuffix))
+        {
+            suffix = jsonSuffix;
+        }
+        else
+        {
+            continue;
+        }
+        std::string id = fileName.substr(
+            std::string_view(filePrefix).size(),
+            fileName.size() - std::string_view(filePrefix).size() -
+                suffix.size());
+        found.emplace_back(file.last_write_time(),
+                           Entry{id, file.path(), file.file_size(), 0});
+    }
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    for (auto& [mtime, entry] : found)
+    {
+        entry.lastUsed = ++useCounter;
+        usedBytes += entry.size;
+        entries.insert_or_assign(entry.id, entry);
+    }
+}
+
+void DumpStore::rotate()
+{
+    if (usedBytes <= quota)
+    {
+        return;
+    }
+    std::vector<const Entry*> byUse;
+    for (const auto& [id, entry] : entries)
+    {
+        byUse.emplace_back(&entry);
+    }
+    std::sort(byUse.begin(), byUse.end(), [](const Entry* a, const Entry* b) {
+        return a->lastUsed < b->lastUsed;
+    });
+    // The most recent dump is kept even if it alone exceeds the quota. Dumps
+    // that can not be deleted stay and count against the quota.
+    std::vector<std::string> lruIds;
+    for (size_t i = 0; i + 1 < byUse.size(); i++)
+    {
+        lruIds.emplace_back(byUse[i]->id);
+    }
+    for (const auto& id : lruIds)
+    {
+        if (usedBytes <= quota)
+        {
+            break;
+        }
+        phosphor::logging::log<phosphor::logging::level::INFO>(
+            "Rotating out dump file",
+            phosphor::logging::entry("FILE=%s",
+                                     entries.at(id).path.string().c_str()));
+        removeEntry(id);
+    }
+}
+
+std::string DumpStore::createId() const
+{
+    uint64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+    std::string id = std::to_string(now);
+    for (size_t suffix = 1;
+         entries.count(id) != 0 || pendingIds.count(id) != 0; suffix++)
+    {
+        id = std::to_string(now) + "_" + std::to_string(suffix);
+    }
+    return id;
+}
+
+DumpStore::Entry DumpStore::add(std::string_view content)
+{
+    std::string id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = createId();
+        pendingIds.insert(id);
+    }
+    try
+    {
+        Entry entry = write(id, content);
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingIds.erase(id);
+        entry.lastUsed = ++useCounter;
+        usedBytes += entry.size;
+        entries.insert_or_assign(id, entry);
+        // Rotate once the dump is written since the compressed size is not
+        // known up front
+        rotate();
+        return entry;
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingIds.erase(id);
+        throw;
+    }
+}
+
+DumpStore::Entry DumpStore::write(const std::string& id,
+                                  std::string_view content) const
+{
+    std::filesystem::path path =
+        directory / (filePrefix + id +
+                     std::string(compression == Compression::gzip
+                                     ? gzipSuffix
+                                     : jsonSuffix));
+    if (compression == Compression::gzip)
+    {
+#ifdef NVME_DUMP_GZIP
+        gzFile file = gzopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            throw std::runtime_error("Error opening " + path.string());
+        }
+        int written = gzwrite(file, content.data(),
+                              static_cast<unsigned>(content.size()));
+        if (gzclose(file) != Z_OK ||
+            written != static_cast<int>(content.size()))
+        {
+            std::filesystem::remove(path);
+            throw std::runtime_error("Error writing " + path.string());
+        }
+#else
+        throw std::runtime_error("gzip compression is not supported");
+#endif
+    }
+    else
+    {
+        std::ofstream file(path, std::ios::out | std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Error opening " + path.string() + ". " +
+                                     strerror(errno));
+        }
+        file.write(content.data(),
+                   static_cast<std::streamsize>(content.size()));
+        file.close();
+        if (!file)
+        {
+            std::filesystem::remove(path);
+            throw std::runtime_error("Error writing " + path.string());
+        }
+    }
+    return Entry{id, path, std::filesystem::file_size(path), 0};
+}
+
+int DumpStore::open(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(id);
+    if (it == entries.end())
+    {
+        throw std::invalid_argument("Unknown dump " + id);
+    }
+    int fd = ::open(it->second.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Error opening " + it->second.path.string());
+    }
+    it->second.lastUsed = ++useCounter;
+    return fd;
+}
+
+bool DumpStore::remove(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return removeEntry(id);
+}
+
+bool DumpStore::removeEntry(const std::string& id)
+{
+    auto it = entries.find(id);
+    if (it == entries.end())
+    {
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::remove(it->second.path, ec);
+    if (ec)
+    {
+        phosphor::logging::log<phosphor::logging::level::ERR>(
+            "Error deleting dump file",
+            phosphor::logging::entry("FILE=%s",
+                                     it->second.path.string().c_str()),
+            phosphor::logging::entry("MSG=%s", ec.message().c_str()));
+        return false;
+    }
+    usedBytes -= it->second.size;
+    entries.erase(it);
+    return true;
+}
+
+std::vector<DumpStore::Entry> DumpStore::list() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Entry> all;
+    for (const auto& [id, entry] : entries)
+    {
+        all.emplace_back(entry);
+    }
+    return all;
+}
+
+uintmax_t DumpStore::getUsedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return usedBytes;
+}
+
+uintmax_t DumpStore::getQuota() const
+{
+    return quota;
+}
+
+DumpStore::Compression DumpStore::getCompression() const
+{
+    return compression;
+}
+
+const std::filesystem::path& DumpStore::getDirectory() const
+{
+    return directory;
+}
+
+namespace nvmemi::dumpstore
+{
+static constexpr uintmax_t defaultQuota = 2 * 1024 * 1024;
+static std::unique_ptr<DumpStore> store{};
+static std::mutex storeMutex;
+
+void configure(const std::filesystem::path& directory, uintmax_t quota,
+               DumpStore::Compression compression)
+{
+    auto newStore = std::make_unique<DumpStore>(directory, quota, compression);
+    std::lock_guard<std::mutex> lock(storeMutex);
+    store = std::move(newStore);
+}
+
+DumpStore& get()
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    if (!store)
+    {
+        store = std::make_unique<DumpStore>("/tmp", defaultQuota,
+                                            DumpStore::Compression::none);
+    }
+    return *store;
+}
+
+std::optional<DumpStore::Compression> parseCompression(std::string_view name)
+{
+    if (name == "none")
+    {
+        return DumpStore::Compression::none;
+    }
+#ifdef NVME_DUMP_GZIP
+    if (name == "gzip")
+    {
+        return DumpStore::Compression::gzip;
+    }
+#endif
+    return std::nullopt;
+}
+} // namespace nvmemi::dumpstore
@@ -0,0 +1,140 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nvmemi
+{
+/**
+ * @brief Directory of CollectLog dump files limited by a size quota. When a
+ * new dump does not fit, the least recently written or opened dumps are
+ * deleted. Dumps can be added from worker threads; files are written without
+ * holding the lock.
+ *
+ */
+class DumpStore
+{
+  public:
+    enum class Compression : uint8_t
+    {
+        none,
+        gzip
+    };
+
+    struct Entry
+    {
+        std::string id;
+        std::filesystem::path path;
+        uintmax_t size;
+        uint64_t lastUsed;
+    };
+
+    /**
+     * @brief Construct a new DumpStore object. Dumps already present in the
+     * directory are taken over, oldest first, and rotated to fit the quota.
+     *
+     * @param directory Directory for the dump files. Created if missing.
+     * @param quota Maximum total size of the dump files in bytes
+     * @param compression Compression applied to new dumps
+     */
+    DumpStore(const std::filesystem::path& directory, uintmax_t quota,
+              Compression compression);
+
+    /**
+     * @brief Write a new dump
+     *
+     * @param content Dump content
+     * @return Entry Entry of the new dump
+     * @throws std::runtime_error if the file can not be written
+     */
+    Entry add(std::string_view content);
+    /**
+     * @brief Open a dump for reading. Marks the dump as recently used.
+     *
+     * @param id Dump ID
+     * @return int File descriptor. Closing it is up to the caller.
+     * @throws std::invalid_argument for unknown IDs
+     * @throws std::system_error if the file can not be opened
+     */
+    int open(const std::string& id);
+    /**
+     * @brief Delete a dump. A dump whose file can not be deleted is kept
+     * and still counts against the quota.
+     *
+     * @param id Dump ID
+     * @return true if the dump was deleted, false for unknown IDs and
+     * files that could not be deleted
+     */
+    bool remove(const std::string& id);
+    std::vector<Entry> list() const;
+    uintmax_t getUsedBytes() const;
+    uintmax_t getQuota() const;
+    Compression getCompression() const;
+    const std::filesystem::path& getDirectory() const;
+
+    static constexpr const char* filePrefix = "nvmemi_jsondump_";
+
+  private:
+    void scan();
+    void rotate();
+    bool removeEntry(const std::string& id);
+    Entry write(const std::string& id, std::string_view content) const;
+    std::string createId() const;
+
+    std::filesystem::path directory;
+    uintmax_t quota;
+    Compression compression;
+    mutable std::mutex mutex;
+    std::map<std::string, Entry> entries{};
+    /** @brief IDs of the dumps being written */
+    std::set<std::string> pendingIds{};
+    uintmax_t usedBytes = 0;
+    uint64_t useCounter = 0;
+};
+
+namespace dumpstore
+{
+/**
+ * @brief Replace the daemon wide dump store
+ *
+ */
+void configure(const std::filesystem::path& directory, uintmax_t quota,
+               DumpStore::Compression compression);
+/**
+ * @brief Get the daemon wide dump store. Uses /tmp with a 2 MiB quota and no
+ * compression unless configured.
+ *
+ */
+DumpStore& get();
+/**
+ * @brief Parse a compression name
+ *
+ * @param name none or gzip
+ * @return std::optional<DumpStore::Compression> std::nullopt if the name is
+ * unknown or the compression is not supported by this build
+ */
+std::optional<DumpStore::Compression> parseCompression(std::string_view name);
+} // namespace dumpstore
+} // namespace nvmemi
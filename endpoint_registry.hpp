@@ -0,0 +1,115 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <array>
+#include <limits>
+#include <mctp_wrapper.hpp>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace nvmemi
+{
+/**
+ * @brief Per EID state indexed directly by the EID, so that lookups on the
+ * request path do not allocate or search. Each entry remembers the object it
+ * was registered for, so that a drive going away does not free the entry of
+ * a drive registered for the same EID since.
+ *
+ * @tparam T Type of the per EID state
+ */
+template <typename T>
+class EndpointRegistry
+{
+  public:
+    static constexpr size_t maxEndpoints =
+        std::numeric_limits<mctpw::eid_t>::max() + 1;
+
+    /**
+     * @brief Create the entry of an endpoint. An entry registered for the
+     * same owner is kept as it is.
+     *
+     * @param eid MCTP EID
+     * @param owner Object the endpoint is registered for
+     * @param args Arguments for the constructor of T
+     * @return T& Entry of the endpoint
+     */
+    template <typename... Args>
+    T& add(mctpw::eid_t eid, const void* owner, Args&&... args)
+    {
+        auto& entry = entries[eid];
+        if (!entry || owners[eid] != owner)
+        {
+            entry = std::make_shared<T>(std::forward<Args>(args)...);
+            owners[eid] = owner;
+        }
+        return *entry;
+    }
+    /**
+     * @brief Free the entry of an endpoint
+     *
+     * @param eid MCTP EID
+     * @param owner Owner given to add. The entry is kept if the endpoint was
+     * registered for an other owner since. nullptr frees it anyway.
+     * @return true if the entry was freed
+     */
+    bool remove(mctpw::eid_t eid, const void* owner) noexcept
+    {
+        if (owner != nullptr && owners[eid] != owner)
+        {
+            return false;
+        }
+        entries[eid].reset();
+        owners[eid] = nullptr;
+        return true;
+    }
+    /**
+     * @brief Get the entry of an endpoint
+     *
+     * @return T* nullptr if the endpoint is not registered
+     */
+    T* get(mctpw::eid_t eid) const noexcept
+    {
+        return entries[eid].get();
+    }
+    /**
+     * @brief Get the entry of an endpoint for use beyond its registration,
+     * e.g. across a suspension of the calling coroutine
+     *
+     */
+    std::shared_ptr<T> share(mctpw::eid_t eid) const noexcept
+    {
+        return entries[eid];
+    }
+    std::vector<mctpw::eid_t> getEids() const
+    {
+        std::vector<mctpw::eid_t> eids;
+        for (size_t eid = 0; eid < maxEndpoints; eid++)
+        {
+            if (entries[eid])
+            {
+                eids.emplace_back(static_cast<mctpw::eid_t>(eid));
+            }
+        }
+        return eids;
+    }
+
+  private:
+    std::array<std::shared_ptr<T>, maxEndpoints> entries{};
+    std::array<const void*, maxEndpoints> owners{};
+};
+} // namespace nvmemi
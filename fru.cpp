@@ -0,0 +1,261 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "fru.hpp"
+
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <numeric>
+#include <utility>
+
+namespace nvmemi::fru
+{
+static constexpr uint8_t formatVersion = 0x01;
+static constexpr uint8_t endOfFields = 0xC1;
+static constexpr size_t multiRecordHeaderSize = 5;
+static constexpr uint8_t endOfList = 0x80;
+
+enum HeaderOffset : size_t
+{
+    chassisArea = 2,
+    boardArea = 3,
+    productArea = 4,
+    multiRecordArea = 5,
+};
+
+static uint8_t checksum(const uint8_t* data, size_t size)
+{
+    return std::accumulate(data, data + size, uint8_t{0},
+                           [](uint8_t sum, uint8_t byte) {
+                               return static_cast<uint8_t>(sum + byte);
+                           });
+}
+
+static bool isHeaderValid(const uint8_t* data, size_t size)
+{
+    return size >= headerSize && (data[0] & 0x0F) == formatVersion &&
+           checksum(data, headerSize) == 0;
+}
+
+size_t getRequiredSize(const uint8_t* data, size_t size) noexcept
+{
+    if (size < headerSize)
+    {
+        return headerSize;
+    }
+    if (!isHeaderValid(data, size))
+    {
+        return size;
+    }
+    size_t required = headerSize;
+    // Internal use area has no length and is not parsed
+    for (size_t area : {chassisArea, boardArea, productArea})
+    {
+        size_t offset = data[area] * 8;
+        if (offset == 0)
+        {
+            continue;
+        }
+        if (size < offset + 2)
+        {
+            required = std::max(required, offset + 2);
+            continue;
+        }
+        required = std::max(required, offset + data[offset + 1] * 8);
+    }
+    size_t pos = data[multiRecordArea] * 8;
+    while (pos != 0 && pos < maxVpdSize)
+    {
+        if (size < pos + multiRecordHeaderSize)
+        {
+            required = std::max(required, pos + multiRecordHeaderSize);
+            break;
+        }
+        bool last = (data[pos + 1] & endOfList) != 0;
+        pos += multiRecordHeaderSize + data[pos + 2];
+        required = std::max(required, pos);
+        if (last)
+        {
+            break;
+        }
+    }
+    return std::min(required, maxVpdSize);
+}
+
+/**
+ * @brief Decode a type/length field and move past it
+ *
+ * @return std::optional<std::string> std::nullopt at the end of the fields
+ */
+static std::optional<std::string> readField(const uint8_t*& pos,
+                                            const uint8_t* end)
+{
+    if (pos >= end || *pos == endOfFields)
+    {
+        return std::nullopt;
+    }
+    uint8_t type = *pos >> 6;
+    size_t length = *pos & 0x3F;
+    pos++;
+    if (length > static_cast<size_t>(end - pos))
+    {
+        return std::nullopt;
+    }
+    const uint8_t* field = pos;
+    pos += length;
+    std::string value;
+    switch (type)
+    {
+        case 0: {
+            // Binary
+            static constexpr std::array<char, 16> hex = {
+                '0', '1', '2', '3', '4', '5', '6', '7',
+                '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+            for (size_t idx = 0; idx < length; idx++)
+            {
+                value += hex[field[idx] >> 4];
+                value += hex[field[idx] & 0x0F];
+            }
+            return value;
+        }
+        case 1: {
+            // BCD plus
+            static constexpr std::array<char, 16> bcdPlus = {
+                '0', '1', '2', '3', '4', '5', '6', '7',
+                '8', '9', ' ', '-', '.', '?', '?', '?'};
+            for (size_t idx = 0; idx < length; idx++)
+            {
+                value += bcdPlus[field[idx] >> 4];
+                value += bcdPlus[field[idx] & 0x0F];
+            }
+            break;
+        }
+        case 2: {
+            // 6-bit ASCII, four characters packed in three bytes
+            uint32_t bits = 0;
+            size_t bitCount = 0;
+            for (size_t idx = 0; idx < length; idx++)
+            {
+                bits |= static_cast<uint32_t>(field[idx]) << bitCount;
+                bitCount += 8;
+                while (bitCount >= 6)
+                {
+                    value += static_cast<char>(0x20 + (bits & 0x3F));
+                    bits >>= 6;
+                    bitCount -= 6;
+                }
+            }
+            break;
+        }
+        default:
+            value.assign(reinterpret_cast<const char*>(field), length);
+            break;
+    }
+    value.erase(value.find_last_not_of(std::string(" \0", 2)) + 1);
+    return value;
+}
+
+/**
+ * @brief Get the bytes of an info area if its checksum is valid
+ *
+ * @return std::pair Start and end of the area, both nullptr if not valid
+ */
+static std::pair<const uint8_t*, const uint8_t*>
+    getArea(const uint8_t* data, size_t size, HeaderOffset area)
+{
+    size_t offset = data[area] * 8;
+    if (offset == 0 || size < offset + 2)
+    {
+        return {nullptr, nullptr};
+    }
+    size_t length = data[offset + 1] * 8;
+    if (length == 0 || size < offset + length ||
+        checksum(data + offset, length) != 0)
+    {
+        return {nullptr, nullptr};
+    }
+    return {data + offset, data + offset + length};
+}
+
+/**
+ * @brief Read the fields of an info area in order until the end marker or
+ * until all outputs are filled
+ *
+ */
+static void readFields(const uint8_t* pos, const uint8_t* end,
+                       std::initializer_list<std::string*> fields)
+{
+    for (std::string* field : fields)
+    {
+        auto value = readField(pos, end);
+        if (!value)
+        {
+            return;
+        }
+        *field = std::move(*value);
+    }
+}
+
+std::optional<Fru> parse(const uint8_t* data, size_t size)
+{
+    if (!isHeaderValid(data, size))
+    {
+        return std::nullopt;
+    }
+    Fru fru;
+    // Version, length, language code and manufacturing date come first
+    static constexpr size_t boardFieldsOffset = 6;
+    auto [board, boardEnd] = getArea(data, size, boardArea);
+    if (board != nullptr)
+    {
+        readFields(board + boardFieldsOffset, boardEnd,
+                   {&fru.boardManufacturer, &fru.boardProductName,
+                    &fru.boardSerialNumber, &fru.boardPartNumber});
+    }
+    // Version, length and language code come first
+    static constexpr size_t productFieldsOffset = 3;
+    auto [product, productEnd] = getArea(data, size, productArea);
+    if (product != nullptr)
+    {
+        readFields(product + productFieldsOffset, productEnd,
+                   {&fru.productManufacturer, &fru.productName,
+                    &fru.productPartNumber, &fru.productVersion,
+                    &fru.productSerialNumber, &fru.productAssetTag});
+    }
+    size_t pos = data[multiRecordArea] * 8;
+    while (pos != 0 && pos + multiRecordHeaderSize <= size)
+    {
+        const uint8_t* header = data + pos;
+        size_t length = header[2];
+        if (checksum(header, multiRecordHeaderSize) != 0 ||
+            pos + multiRecordHeaderSize + length > size ||
+            static_cast<uint8_t>(
+                checksum(header + multiRecordHeaderSize, length) +
+                header[3]) != 0)
+        {
+            break;
+        }
+        fru.recordTypes.emplace_back(header[0]);
+        if ((header[1] & endOfList) != 0)
+        {
+            break;
+        }
+        pos += multiRecordHeaderSize + length;
+    }
+    return fru;
+}
+} // namespace nvmemi::fru
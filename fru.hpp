@@ -0,0 +1,82 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace nvmemi::fru
+{
+/** @brief Size of the IPMI FRU common header */
+static constexpr size_t headerSize = 8;
+/** @brief Largest VPD image read from a drive */
+static constexpr size_t maxVpdSize = 4096;
+
+/**
+ * @brief Multirecord types defined for the NVMe VPD
+ *
+ */
+enum RecordType : uint8_t
+{
+    nvme = 0x0B,
+    nvmePciePort = 0x0C,
+    topology = 0x0D,
+};
+
+/**
+ * @brief Content of the VPD of a drive. The VPD is in the IPMI FRU format,
+ * with the NVMe records in the multirecord area. Fields missing from the VPD
+ * are left empty.
+ *
+ */
+struct Fru
+{
+    std::string boardManufacturer;
+    std::string boardProductName;
+    std::string boardSerialNumber;
+    std::string boardPartNumber;
+    std::string productManufacturer;
+    std::string productName;
+    std::string productPartNumber;
+    std::string productVersion;
+    std::string productSerialNumber;
+    std::string productAssetTag;
+    /** @brief Type of each valid record of the multirecord area */
+    std::vector<uint8_t> recordTypes;
+};
+
+/**
+ * @brief Get the number of VPD bytes needed to parse the areas found so far.
+ * Called again after reading up to the returned size, since the length of an
+ * area or record is only known once its header is read. The VPD is complete
+ * when the returned size is not larger than the size read.
+ *
+ * @param data VPD bytes read from offset 0
+ * @param size Number of bytes read
+ * @return size_t Number of bytes needed, at most maxVpdSize
+ */
+size_t getRequiredSize(const uint8_t* data, size_t size) noexcept;
+
+/**
+ * @brief Parse the VPD. Areas with a bad checksum are skipped.
+ *
+ * @return std::optional<Fru> std::nullopt if the common header is not valid
+ */
+std::optional<Fru> parse(const uint8_t* data, size_t size);
+} // namespace nvmemi::fru
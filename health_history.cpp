@@ -0,0 +1,265 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "health_history.hpp"
+
+#include <cstring>
+
+using nvmemi::HealthHistory;
+using nvmemi::HealthSample;
+
+enum RecordTag : uint8_t
+{
+    keyframe = 0x00,
+    run = 0x10,
+    temperatureDelta = 0x20,
+    full = 0x30,
+};
+
+static constexpr uint8_t tagMask = 0xF0;
+static constexpr size_t maxVarintSize = 5;
+static constexpr size_t timestampSize = sizeof(uint32_t);
+static constexpr size_t sampleSize = sizeof(HealthSample::data);
+static constexpr size_t keyframeSize = 1 + timestampSize + sampleSize;
+static constexpr size_t maxRunSize = 1 + 2 * maxVarintSize;
+static constexpr size_t maxRecordSize = 1 + maxVarintSize + sampleSize;
+
+static_assert(keyframeSize + maxRunSize <= HealthHistory::blockSize);
+
+static size_t putVarint(uint8_t* out, uint32_t value)
+{
+    size_t size = 0;
+    while (value >= 0x80)
+    {
+        out[size++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+static uint32_t getVarint(const uint8_t*& pos, const uint8_t* end)
+{
+    uint32_t value = 0;
+    for (unsigned shift = 0; pos < end && shift < 35; shift += 7)
+    {
+        uint8_t byte = *pos++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            break;
+        }
+    }
+    return value;
+}
+
+void HealthHistory::add(const HealthSample& sample)
+{
+    // Clock going backwards can not be expressed as a delta
+    if (usedBlocks == 0 || sample.timestamp < lastTimestamp)
+    {
+        flushRun();
+        startBlock(sample);
+        return;
+    }
+    uint32_t elapsed = sample.timestamp - lastTimestamp;
+    if (sample.data == lastRecord.data)
+    {
+        runSamples++;
+        runSeconds += elapsed;
+        lastTimestamp = sample.timestamp;
+        return;
+    }
+    flushRun();
+
+    bool onlyTemperature = true;
+    for (size_t idx = 0; idx < sampleSize; idx++)
+    {
+        if (idx != HealthSample::temperatureIdx &&
+            sample.data[idx] != lastRecord.data[idx])
+        {
+            onlyTemperature = false;
+        }
+    }
+    auto delta = static_cast<int8_t>(
+        sample.data[HealthSample::temperatureIdx] -
+        lastRecord.data[HealthSample::temperatureIdx]);
+
+    std::array<uint8_t, maxRecordSize> record{};
+    size_t size = 0;
+    if (onlyTemperature && delta >= -8 && delta <= 7)
+    {
+        record[size++] = temperatureDelta | (delta & 0x0F);
+        size += putVarint(&record[size], elapsed);
+    }
+    else
+    {
+        record[size++] = full;
+        size += putVarint(&record[size], elapsed);
+        std::memcpy(&record[size], sample.data.data(), sampleSize);
+        size += sampleSize;
+    }
+    // Keep room for the run record that can follow
+    const Block& block = blocks[(firstBlock + usedBlocks - 1) % blockCount];
+    if (block.size + size + maxRunSize > blockSize)
+    {
+        startBlock(sample);
+        return;
+    }
+    append(record.data(), size);
+    lastRecord = sample;
+    lastTimestamp = sample.timestamp;
+}
+
+void HealthHistory::startBlock(const HealthSample& sample)
+{
+    if (usedBlocks == blockCount)
+    {
+        firstBlock = (firstBlock + 1) % blockCount;
+        usedBlocks--;
+    }
+    blocks[(firstBlock + usedBlocks) % blockCount].size = 0;
+    usedBlocks++;
+
+    std::array<uint8_t, keyframeSize> record{};
+    record[0] = keyframe;
+    for (size_t idx = 0; idx < timestampSize; idx++)
+    {
+        record[1 + idx] = static_cast<uint8_t>(sample.timestamp >> (8 * idx));
+    }
+    std::memcpy(&record[1 + timestampSize], sample.data.data(), sampleSize);
+    append(record.data(), record.size());
+    lastRecord = sample;
+    lastTimestamp = sample.timestamp;
+}
+
+void HealthHistory::flushRun()
+{
+    if (runSamples == 0)
+    {
+        return;
+    }
+    std::array<uint8_t, maxRunSize> record{};
+    size_t size = 0;
+    record[size++] = run;
+    size += putVarint(&record[size], runSamples);
+    size += putVarint(&record[size], runSeconds);
+    append(record.data(), size);
+    runSamples = 0;
+    runSeconds = 0;
+}
+
+void HealthHistory::append(const uint8_t* record, size_t size)
+{
+    Block& block = blocks[(firstBlock + usedBlocks - 1) % blockCount];
+    std::memcpy(&block.data[block.size], record, size);
+    block.size += size;
+}
+
+std::vector<HealthSample> HealthHistory::read(uint32_t since) const
+{
+    std::vector<HealthSample> samples;
+    HealthSample current{};
+    auto emit = [&samples, since](const HealthSample& sample) {
+        if (sample.timestamp >= since)
+        {
+            samples.emplace_back(sample);
+        }
+    };
+    auto emitRun = [&current, &emit](uint32_t count, uint32_t seconds) {
+        uint32_t base = current.timestamp;
+        for (uint32_t idx = 1; idx <= count; idx++)
+        {
+            current.timestamp = static_cast<uint32_t>(
+                base + static_cast<uint64_t>(seconds) * idx / count);
+            emit(current);
+        }
+    };
+    auto keyframeTime = [](const Block& block) {
+        uint32_t timestamp = 0;
+        for (size_t idx = 0; idx < timestampSize; idx++)
+        {
+            timestamp |= static_cast<uint32_t>(block.data[1 + idx])
+                         << (8 * idx);
+        }
+        return timestamp;
+    };
+
+    for (size_t blockIdx = 0; blockIdx < usedBlocks; blockIdx++)
+    {
+        const Block& block = blocks[(firstBlock + blockIdx) % blockCount];
+        // Every sample of the block is older than the next keyframe
+        if (blockIdx + 1 < usedBlocks &&
+            keyframeTime(blocks[(firstBlock + blockIdx + 1) % blockCount]) <
+                since)
+        {
+            continue;
+        }
+        const uint8_t* pos = block.data.data();
+        const uint8_t* end = pos + block.size;
+        while (pos < end)
+        {
+            uint8_t tag = *pos++;
+            switch (tag & tagMask)
+            {
+                case keyframe:
+                    current.timestamp = keyframeTime(block);
+                    pos += timestampSize;
+                    std::memcpy(current.data.data(), pos, sampleSize);
+                    pos += sampleSize;
+                    emit(current);
+                    break;
+                case run: {
+                    uint32_t count = getVarint(pos, end);
+                    uint32_t seconds = getVarint(pos, end);
+                    emitRun(count, seconds);
+                }
+                break;
+                case temperatureDelta: {
+                    auto delta = static_cast<int8_t>(tag & 0x0F);
+                    if ((delta & 0x08) != 0)
+                    {
+                        delta = static_cast<int8_t>(delta - 16);
+                    }
+                    current.timestamp += getVarint(pos, end);
+                    current.data[HealthSample::temperatureIdx] += delta;
+                    emit(current);
+                }
+                break;
+                case full:
+                    current.timestamp += getVarint(pos, end);
+                    std::memcpy(current.data.data(), pos, sampleSize);
+                    pos += sampleSize;
+                    emit(current);
+                    break;
+                default:
+                    return samples;
+            }
+        }
+    }
+    emitRun(runSamples, runSeconds);
+    return samples;
+}
+
+size_t HealthHistory::getUsedBytes() const
+{
+    size_t used = 0;
+    for (size_t blockIdx = 0; blockIdx < usedBlocks; blockIdx++)
+    {
+        used += blocks[(firstBlock + blockIdx) % blockCount].size;
+    }
+    return used;
+}
@@ -0,0 +1,95 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nvmemi
+{
+/**
+ * @brief One subsystem health status poll result
+ *
+ */
+struct HealthSample
+{
+    /** @brief Seconds since epoch */
+    uint32_t timestamp;
+    /**
+     * @brief First bytes of the health status poll response: NVM subsystem
+     * status, SMART warnings, composite temperature, percentage drive life
+     * used and composite controller status (2 bytes, little endian)
+     */
+    std::array<uint8_t, 6> data;
+
+    static constexpr size_t temperatureIdx = 2;
+};
+
+/**
+ * @brief Fixed size history of health samples. Samples are stored as
+ * records in a ring of blocks:
+ *
+ * - keyframe: tag, 4 byte timestamp and the full sample. Starts each block.
+ * - run: tag, count and duration. Samples equal to the previous one.
+ * - temperature delta: tag with a 4 bit delta and the time since the
+ *   previous sample. Only the temperature changed.
+ * - full: tag, time since the previous sample and the full sample.
+ *
+ * Counts and times are LEB128 varints. When all the blocks are used the
+ * oldest one is dropped.
+ *
+ */
+class HealthHistory
+{
+  public:
+    static constexpr size_t blockSize = 256;
+    static constexpr size_t blockCount = 32;
+
+    void add(const HealthSample& sample);
+    /**
+     * @brief Decode the stored samples. Timestamps of samples within a run
+     * are spread evenly over the run.
+     *
+     * @param since Oldest timestamp to return
+     * @return std::vector<HealthSample> Samples, oldest first
+     */
+    std::vector<HealthSample> read(uint32_t since = 0) const;
+    size_t getUsedBytes() const;
+
+  private:
+    struct Block
+    {
+        std::array<uint8_t, blockSize> data;
+        size_t size = 0;
+    };
+
+    void startBlock(const HealthSample& sample);
+    void flushRun();
+    void append(const uint8_t* record, size_t size);
+
+    std::array<Block, blockCount> blocks{};
+    size_t firstBlock = 0;
+    size_t usedBlocks = 0;
+    /** @brief Last sample stored as a record, base of deltas and runs */
+    HealthSample lastRecord{};
+    /** @brief Timestamp of the latest sample, including the pending run */
+    uint32_t lastTimestamp = 0;
+    uint32_t runSamples = 0;
+    uint32_t runSeconds = 0;
+};
+} // namespace nvmemi
@@ -0,0 +1,97 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace nvmemi::logprofile
+{
+/**
+ * @brief Bits of the CollectLog section mask
+ *
+ */
+enum Section : uint32_t
+{
+    subsystemInfo = 1 << 0,
+    controllers = 1 << 1,
+    optionalCommands = 1 << 2,
+    controllerHSPoll = 1 << 3,
+    subsystemHSPoll = 1 << 4,
+    configGet = 1 << 5,
+    getFeatures = 1 << 6,
+    errorLog = 1 << 7,
+    smartHealthLog = 1 << 8,
+    otherLogPages = 1 << 9,
+    identify = 1 << 10,
+};
+
+static constexpr uint32_t allSections = (1 << 11) - 1;
+
+/**
+ * @brief Get the section mask of a named profile
+ *
+ * @param profile health, inventory or full
+ * @return std::optional<uint32_t> std::nullopt for unknown profiles
+ */
+inline std::optional<uint32_t> getProfileMask(std::string_view profile)
+{
+    if (profile == "health")
+    {
+        return errorLog | smartHealthLog;
+    }
+    if (profile == "inventory")
+    {
+        return subsystemInfo | controllers | optionalCommands | identify;
+    }
+    if (profile == "full")
+    {
+        return allSections;
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief Combine a profile and a section mask to the sections to collect.
+ * Everything is collected when both are empty.
+ *
+ * @param profile Name of the profile. Empty to use the mask only
+ * @param sectionMask Additional sections to collect
+ * @return uint32_t Sections to collect
+ */
+inline uint32_t resolveSections(std::string_view profile, uint32_t sectionMask)
+{
+    if ((sectionMask & ~allSections) != 0)
+    {
+        throw std::invalid_argument("Unknown log section in mask");
+    }
+    uint32_t sections = sectionMask;
+    if (!profile.empty())
+    {
+        auto profileMask = getProfileMask(profile);
+        if (!profileMask)
+        {
+            throw std::invalid_argument("Unknown log profile " +
+                                        std::string(profile));
+        }
+        sections |= *profileMask;
+    }
+    return sections == 0 ? allSections : sections;
+}
+} // namespace nvmemi::logprofile
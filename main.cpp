@@ -14,10 +14,24 @@
 // limitations under the License.
 */
 
+#include "bus_scheduler.hpp"
+#include "collect_log_job.hpp"
 #include "drive.hpp"
+#include "drive_state.hpp"
+#include "dump_store.hpp"
+#include "metrics.hpp"
+#include "mctp_socket_transport.hpp"
+#include "retry_policy.hpp"
+#include "rtt_estimator.hpp"
+#include "single_flight.hpp"
+#include "utils.hpp"
+#include "worker_pool.hpp"
+
+#include <unistd.h>
 
 #include <boost/asio.hpp>
 #include <boost/bind/bind.hpp>
+#include <limits>
 #include <mctp_wrapper.hpp>
 #include <phosphor-logging/log.hpp>
 #include <sdbusplus/asio/connection.hpp>
@@ -41,6 +55,16 @@ class Application
 {
     using DriveMap =
         std::unordered_map<mctpw::eid_t, std::shared_ptr<nvmemi::Drive>>;
+    /**
+     * @brief Drive that is gone from the MCTP endpoint map but is kept until
+     * the grace timer expires in case it comes back
+     *
+     */
+    struct RemovedDrive
+    {
+        std::shared_ptr<nvmemi::Drive> drive;
+        std::shared_ptr<boost::asio::steady_timer> graceTimer;
+    };
 
   public:
     Application() :
@@ -69,36 +93,464 @@ class Application
                     DeviceUpdateHandler(*this, bindingType));
                 mctpWrappers.emplace(bindingType, wrapper);
                 wrapper->detectMctpEndpoints(yield);
-                for (auto& [eid, service] : wrapper->getEndpointMap())
+                // Endpoint map can change while yielding below
+                auto endpoints = wrapper->getEndpointMap();
+                size_t created = 0;
+                for (auto& [eid, service] : endpoints)
                 {
-                    auto drive = std::make_shared<nvmemi::Drive>(
-                        getDriveName(wrapper, eid), eid, *this->objectServer,
-                        wrapper);
-                    this->drives.emplace(eid, drive);
-                }
-                if (!this->drives.empty())
-                {
-                    resumeHealthStatusPolling();
+                    addEndpoint(wrapper, eid, true);
+                    // Let the first polls of the created drives and DBus
+                    // requests run before creating the next batch
+                    if (++created % driveBatchSize == 0)
+                    {
+                        boost::asio::post(*ioContext, yield);
+                    }
                 }
+                startupEnumerated = true;
+                checkStartupComplete();
             });
 
+        if (auto envPtr = std::getenv("NVME_SENSOR_PUBLISH"))
+        {
+            std::string value(envPtr);
+            if (value == "immediate")
+            {
+                batchSensorUpdates = false;
+            }
+        }
+
+        if (auto envPtr = std::getenv("NVME_POLL_CLEAR_STATUS"))
+        {
+            std::string value(envPtr);
+            if (value == "1")
+            {
+                nvmemi::Drive::setClearStatusPolling(true);
+            }
+        }
+
+        if (auto envPtr = std::getenv("NVME_MULTIPATH"))
+        {
+            std::string value(envPtr);
+            if (value == "1")
+            {
+                pathDeduplication = true;
+            }
+        }
+
+        if (auto envPtr = std::getenv("NVME_PROGRAM_TEMP_THRESHOLDS"))
+        {
+            std::string value(envPtr);
+            if (value == "1")
+            {
+                nvmemi::Drive::setThresholdProgramming(true);
+            }
+        }
+
+        if (auto envPtr = std::getenv("NVME_COLLECTLOG_JOBS"))
+        {
+            try
+            {
+                nvmemi::collectlog::setConcurrencyLimit(std::stoul(envPtr));
+            }
+            catch (const std::exception&)
+            {
+                phosphor::logging::log<phosphor::logging::level::ERR>(
+                    "Invalid NVME_COLLECTLOG_JOBS value",
+                    phosphor::logging::entry("VALUE=%s", envPtr));
+            }
+        }
+
+        if (auto envPtr = std::getenv("NVME_BUS_MAX_OUTSTANDING"))
+        {
+            try
+            {
+                nvmemi::scheduler::setMaxOutstanding(std::stoul(envPtr));
+            }
+            catch (const std::exception&)
+            {
+                phosphor::logging::log<phosphor::logging::level::ERR>(
+                    "Invalid NVME_BUS_MAX_OUTSTANDING value",
+                    phosphor::logging::entry("VALUE=%s", envPtr));
+            }
+        }
+
+        if (auto envPtr = std::getenv("NVME_RETRY_BUDGET"))
+        {
+            try
+            {
+                nvmemi::retry::setBudgetCapacity(std::stoul(envPtr));
+            }
+            catch (const std::exception&)
+            {
+                phosphor::logging::log<phosphor::logging::level::ERR>(
+                    "Invalid NVME_RETRY_BUDGET value",
+                    phosphor::logging::entry("VALUE=%s", envPtr));
+            }
+        }
+
+        size_t workerThreads = defaultWorkerThreads;
+        if (auto envPtr = std::getenv("NVME_WORKER_THREADS"))
+        {
+            try
+            {
+                workerThreads = std::stoul(envPtr);
+            }
+            catch (const std::exception&)
+            {
+                phosphor::logging::log<phosphor::logging::level::ERR>(
+                    "Invalid NVME_WORKER_THREADS value",
+                    phosphor::logging::entry("VALUE=%s", envPtr));
+            }
+        }
+        nvmemi::workers::start(workerThreads);
+
+        configureTransport();
+        configurePortLimits();
+        configureDumpStore();
+        initializeDumpStoreIntf();
+        loadState();
+
         if (auto envPtr = std::getenv("NVME_DEBUG"))
         {
             std::string value(envPtr);
             if (value == "1")
             {
                 initializeHealthStatusPollIntf();
+                initializeMetricsIntf();
+                nvmemi::Drive::setMessageLogging(true);
             }
         }
     }
+    /**
+     * @brief Add an EID found on MCTP. With path deduplication the NVM
+     * subsystem behind the EID is identified first, and an EID leading to
+     * the subsystem of a known drive becomes an other path of that drive
+     * instead of a drive of its own.
+     *
+     * @param wrapper MCTPWrapper through which the EID is reachable
+     * @param eid MCTP EID
+     * @param atStartup true if the EID was found during startup
+     */
+    void addEndpoint(std::shared_ptr<mctpw::MCTPWrapper> wrapper,
+                     mctpw::eid_t eid, bool atStartup = false)
+    {
+        if (!pathDeduplication || drives->count(eid) != 0 ||
+            removedDrives.count(eid) != 0)
+        {
+            // Counted before the first poll is spawned, which can complete
+            // before addDrive returns
+            if (atStartup)
+            {
+                startupPendingPolls++;
+            }
+            if (!addDrive(wrapper, eid, atStartup))
+            {
+                if (atStartup)
+                {
+                    startupPendingPolls--;
+                    checkStartupComplete();
+                }
+                return;
+            }
+            if (!atStartup)
+            {
+                phosphor::logging::log<phosphor::logging::level::INFO>(
+                    "New drive inserted",
+                    phosphor::logging::entry("EID=%d", eid));
+            }
+            return;
+        }
+        // Counted right away so that startup is not reported complete
+        // while the EID is identified
+        if (atStartup)
+        {
+            startupPendingPolls++;
+        }
+        boost::asio::spawn(*ioContext, [this, wrapper, eid, atStartup](
+                                           boost::asio::yield_context yield) {
+            nvmemi::MctpwTransport wrapperTransport(wrapper);
+            nvmemi::Transport& transport =
+                socketTransport ? *socketTransport : wrapperTransport;
+            auto subsystemId =
+                nvmemi::Drive::readSubsystemId(transport, eid, yield);
+            bool created = false;
+            // EID can be removed or added by an other event meanwhile
+            bool pending = wrapper->getEndpointMap().count(eid) != 0 &&
+                           drives->count(eid) == 0;
+            auto drive = pending ? findSubsystem(subsystemId) : nullptr;
+            if (drive)
+            {
+                drive->addPath(eid, wrapper);
+                updateDrives([&](DriveMap& map) { map.emplace(eid, drive); });
+                phosphor::logging::log<phosphor::logging::level::INFO>(
+                    "Drive path added",
+                    phosphor::logging::entry("DRIVE=%s",
+                                             drive->getName().c_str()),
+                    phosphor::logging::entry("EID=%d", eid));
+            }
+            else if (pending)
+            {
+                created = addDrive(wrapper, eid, atStartup, subsystemId);
+                if (created && !atStartup)
+                {
+                    phosphor::logging::log<phosphor::logging::level::INFO>(
+                        "New drive inserted",
+                        phosphor::logging::entry("EID=%d", eid));
+                }
+            }
+            // First poll of a created drive completes the startup count
+            if (atStartup && !created)
+            {
+                startupPendingPolls--;
+                checkStartupComplete();
+            }
+        });
+    }
+    /**
+     * @brief Find the drive of an NVM subsystem
+     *
+     * @param subsystemId Identity read by Drive::readSubsystemId
+     * @return std::shared_ptr<nvmemi::Drive> nullptr if there is none
+     */
+    std::shared_ptr<nvmemi::Drive>
+        findSubsystem(const std::optional<std::string>& subsystemId)
+    {
+        if (!subsystemId)
+        {
+            return nullptr;
+        }
+        auto it = std::find_if(
+            drives->begin(), drives->end(), [&](const auto& entry) {
+                return entry.second->getSubsystemId() == subsystemId;
+            });
+        return it != drives->end() ? it->second : nullptr;
+    }
+    /**
+     * @brief Create the drive for an EID and start polling it right away
+     *
+     * @param wrapper MCTPWrapper through which the drive is reachable
+     * @param eid MCTP EID of the drive
+     * @param atStartup true if the drive was found during startup
+     * @param subsystemId Identity of the NVM subsystem, if read
+     * @return true if a new drive was created
+     */
+    bool addDrive(std::shared_ptr<mctpw::MCTPWrapper> wrapper,
+                  mctpw::eid_t eid, bool atStartup = false,
+                  std::optional<std::string> subsystemId = std::nullopt)
+    {
+        if (drives->count(eid) != 0)
+        {
+            return false;
+        }
+        std::shared_ptr<nvmemi::Drive> drive = reclaimDrive(wrapper, eid);
+        if (!drive)
+        {
+            drive = std::make_shared<nvmemi::Drive>(
+                getDriveName(wrapper, eid, atStartup), eid, *objectServer,
+                wrapper, socketTransport);
+            // Only drives found at startup can be the ones saved before
+            if (atStartup)
+            {
+                if (auto state = savedState.findByName(drive->getName()))
+                {
+                    drive->restoreState(*state, maxStateAge);
+                }
+            }
+            drive->setSubsystemId(std::move(subsystemId));
+        }
+        updateDrives([&](DriveMap& map) { map.emplace(eid, drive); });
+        boost::asio::spawn(*ioContext, [this, drive, eid, atStartup](
+                                           boost::asio::yield_context yield) {
+            bool updated = false;
+            try
+            {
+                updated = drive->pollSubsystemHealthStatus(yield);
+            }
+            catch (const std::exception& e)
+            {
+                phosphor::logging::log<phosphor::logging::level::ERR>(
+                    "Drive poll failed",
+                    phosphor::logging::entry("DRIVE=%s",
+                                             drive->getName().c_str()),
+                    phosphor::logging::entry("MSG=%s", e.what()));
+            }
+            onFirstPollComplete(eid, atStartup, updated);
+        });
+        if (drives->size() == 1)
+        {
+            resumeHealthStatusPolling();
+        }
+        return true;
+    }
+    /**
+     * @brief Take the drive out of the poll loop. The Drive object and its
+     * DBus interfaces are kept for removalGracePeriod so that a drive
+     * bouncing on a flaky connection does not recreate them. A drive that
+     * is still reachable through an other path only loses the path.
+     *
+     * @param eid MCTP EID of the drive
+     * @return true if a drive was mapped to the EID
+     */
+    bool removeDrive(mctpw::eid_t eid)
+    {
+        auto it = drives->find(eid);
+        if (it == drives->end())
+        {
+            return false;
+        }
+        std::shared_ptr<nvmemi::Drive> drive = it->second;
+        updateDrives([eid](DriveMap& map) { map.erase(eid); });
+        if (drive->removePath(eid))
+        {
+            phosphor::logging::log<phosphor::logging::level::INFO>(
+                "Drive path removed",
+                phosphor::logging::entry("DRIVE=%s", drive->getName().c_str()),
+                phosphor::logging::entry("EID=%d", eid));
+            return true;
+        }
+        drive->setPresence(false);
+
+        auto timer = std::make_shared<boost::asio::steady_timer>(*ioContext);
+        timer->expires_after(removalGracePeriod);
+        timer->async_wait(
+            [this, eid, timer](const boost::system::error_code& ec) {
+                auto removed = removedDrives.find(eid);
+                if (ec || removed == removedDrives.end() ||
+                    removed->second.graceTimer != timer)
+                {
+                    return;
+                }
+                phosphor::logging::log<phosphor::logging::level::INFO>(
+                    "Drive removal grace period expired",
+                    phosphor::logging::entry("EID=%d", eid));
+                removedDrives.erase(removed);
+            });
+        removedDrives.insert_or_assign(eid, RemovedDrive{drive, timer});
+        return true;
+    }
+    /**
+     * @brief Get back a drive removed within the grace period if the EID
+     * still refers to the same device
+     *
+     * @return std::shared_ptr<nvmemi::Drive> nullptr if there is nothing to
+     * reuse
+     */
+    std::shared_ptr<nvmemi::Drive>
+        reclaimDrive(std::shared_ptr<mctpw::MCTPWrapper> wrapper,
+                     mctpw::eid_t eid)
+    {
+        auto removed = removedDrives.find(eid);
+        if (removed == removedDrives.end())
+        {
+            return nullptr;
+        }
+        std::shared_ptr<nvmemi::Drive> drive = removed->second.drive;
+        removed->second.graceTimer->cancel();
+        removedDrives.erase(removed);
+
+        // Drives without location are named by a counter and can not be
+        // told apart. Assume the EID still refers to the same drive.
+        std::optional<std::string> location = wrapper->getDeviceLocation(eid);
+        if (location.has_value() &&
+            drive->getName() !=
+                nvmemi::utils::sanitizeName(locationPrefix + *location))
+        {
+            return nullptr;
+        }
+        phosphor::logging::log<phosphor::logging::level::INFO>(
+            "Drive returned within removal grace period",
+            phosphor::logging::entry("EID=%d", eid));
+        drive->setPresence(true);
+        return drive;
+    }
+    /**
+     * @brief Publish a modified copy of the drive map. Poll sweeps hold on to
+     * the map they started with, so the map is never modified in place.
+     *
+     * @param modify Callable applied to the new map
+     */
+    template <typename Fn>
+    void updateDrives(Fn&& modify)
+    {
+        auto next = std::make_shared<DriveMap>(*drives);
+        modify(*next);
+        drives = std::move(next);
+    }
+    /**
+     * @brief Log the outcome of the first poll of a new drive
+     *
+     * @param eid MCTP EID of the drive
+     * @param atStartup true if the drive was found during startup
+     * @param updated true if the poll returned a reading, false if it was
+     * skipped or failed
+     */
+    void onFirstPollComplete(mctpw::eid_t eid, bool atStartup, bool updated)
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime);
+        if (updated)
+        {
+            phosphor::logging::log<phosphor::logging::level::INFO>(
+                "First health status poll complete",
+                phosphor::logging::entry("EID=%d", eid),
+                phosphor::logging::entry(
+                    "ELAPSED_MS=%lld",
+                    static_cast<long long>(elapsed.count())));
+        }
+        else
+        {
+            phosphor::logging::log<phosphor::logging::level::WARNING>(
+                "First health status poll failed or skipped",
+                phosphor::logging::entry("EID=%d", eid),
+                phosphor::logging::entry(
+                    "ELAPSED_MS=%lld",
+                    static_cast<long long>(elapsed.count())));
+        }
+        if (atStartup && startupPendingPolls > 0)
+        {
+            if (!updated)
+            {
+                startupFailedPolls++;
+            }
+            startupPendingPolls--;
+            checkStartupComplete();
+        }
+    }
+    void checkStartupComplete()
+    {
+        if (!startupEnumerated || startupPendingPolls != 0)
+        {
+            return;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime);
+        phosphor::logging::log<phosphor::logging::level::INFO>(
+            "Time to first poll for all drives found at startup",
+            phosphor::logging::entry("DRIVES=%zu", drives->size()),
+            phosphor::logging::entry("FAILED=%zu", startupFailedPolls),
+            phosphor::logging::entry("ELAPSED_MS=%lld",
+                                     static_cast<long long>(elapsed.count())));
+    }
     std::string getDriveName(std::shared_ptr<mctpw::MCTPWrapper> wrapper,
-                             mctpw::eid_t eid)
+                             mctpw::eid_t eid, bool atStartup = false)
     {
         std::optional<std::string> driveLocation =
             wrapper->getDeviceLocation(eid);
         if (driveLocation.has_value())
         {
-            return "NVMe_" + driveLocation.value();
+            return locationPrefix + driveLocation.value();
+        }
+        // Keep the counter name the drive had before the restart
+        if (auto state = savedState.findByEid(eid); atStartup && state)
+        {
+            bool inUse = std::any_of(
+                drives->begin(), drives->end(), [state](const auto& entry) {
+                    return entry.second->getName() == state->name;
+                });
+            if (!inUse && state->name.rfind(locationPrefix, 0) != 0)
+            {
+                return state->name;
+            }
         }
 
         std::string driveName =
@@ -106,6 +558,64 @@ class Application
         this->driveCounter++;
         return driveName;
     }
+    /**
+     * @brief Poll all the drives concurrently and wait until every poll is
+     * done. The bus scheduler keeps drives on the same bus in turn while
+     * separate buses are polled in parallel.
+     *
+     */
+    static void pollDrives(boost::asio::yield_context yield, Application* app,
+                           const DriveMap& sweepDrives)
+    {
+        // Drives reachable through several EIDs are polled once, on the
+        // active path
+        std::vector<std::shared_ptr<nvmemi::Drive>> sweep;
+        for (const auto& [eid, drive] : sweepDrives)
+        {
+            if (eid == drive->getEid())
+            {
+                sweep.emplace_back(drive);
+            }
+        }
+        if (sweep.empty())
+        {
+            return;
+        }
+        size_t pending = sweep.size();
+        boost::asio::steady_timer allDone(
+            *app->ioContext, std::chrono::steady_clock::time_point::max());
+        for (const auto& drive : sweep)
+        {
+            boost::asio::spawn(
+                *app->ioContext, [drive, &pending, &allDone](
+                                     boost::asio::yield_context pollYield) {
+                    try
+                    {
+                        drive->pollSubsystemHealthStatus(pollYield);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        phosphor::logging::log<phosphor::logging::level::ERR>(
+                            "Drive poll failed",
+                            phosphor::logging::entry(
+                                "DRIVE=%s", drive->getName().c_str()),
+                            phosphor::logging::entry("MSG=%s", e.what()));
+                    }
+                    if (--pending == 0)
+                    {
+                        allDone.cancel();
+                    }
+                });
+        }
+        // Polls that return without suspending finish within spawn, the
+        // cancel would then come before the wait
+        if (pending == 0)
+        {
+            return;
+        }
+        boost::system::error_code ec;
+        allDone.async_wait(yield[ec]);
+    }
     static void doPoll(boost::asio::yield_context yield, Application* app)
     {
         while (app->pollTimer != nullptr)
@@ -126,10 +636,19 @@ class Application
                 return;
             }
 
-            DriveMap copyDrives(app->drives);
-            for (auto& [eid, drive] : copyDrives)
+            // Map is replaced rather than modified on hot-plug, holding the
+            // current one keeps the sweep stable without copying it
+            std::shared_ptr<const DriveMap> sweepDrives = app->drives;
+            if (app->batchSensorUpdates)
+            {
+                nvmemi::NumericSensor::beginBatch();
+            }
+            pollDrives(yield, app, *sweepDrives);
+            // Publish the whole sweep together so that sensor consumers
+            // wake up once per poll interval
+            if (app->batchSensorUpdates)
             {
-                drive->pollSubsystemHealthStatus(yield);
+                nvmemi::NumericSensor::flushBatch();
             }
         }
         phosphor::logging::log<phosphor::logging::level::WARNING>(
@@ -186,9 +705,374 @@ class Application
             });
         healthStatusPollInterface->initialize();
     }
+    /**
+     * @brief Read the drive snapshots saved by the previous run and start
+     * checking periodically whether they need to be saved
+     *
+     */
+    void loadState()
+    {
+        if (auto envPtr = std::getenv("NVME_STATE_FILE"))
+        {
+            stateFile = envPtr;
+        }
+        try
+        {
+            savedState = nvmemi::statefile::load(stateFile);
+            lastSavedState = savedState;
+            driveCounter = std::max(driveCounter, savedState.driveCounter);
+        }
+        catch (const std::exception& e)
+        {
+            phosphor::logging::log<phosphor::logging::level::ERR>(
+                "Error loading the state file",
+                phosphor::logging::entry("MSG=%s", e.what()));
+        }
+        stateSaveTimer =
+            std::make_shared<boost::asio::steady_timer>(*ioContext);
+        scheduleStateSave();
+    }
+    void scheduleStateSave()
+    {
+        stateSaveTimer->expires_after(stateSaveInterval);
+        stateSaveTimer->async_wait(
+            [this](const boost::system::error_code& ec) {
+                if (ec)
+                {
+                    return;
+                }
+                saveState(false);
+                scheduleStateSave();
+            });
+    }
+    /**
+     * @brief Write the drive snapshots to the state file. Health readings
+     * change on every poll, so to spare the flash the file is only written
+     * when a durable field changed, when the refresh interval has passed or
+     * when forced at shutdown.
+     *
+     * @param force Write even if nothing durable changed
+     */
+    void saveState(bool force)
+    {
+        nvmemi::DaemonState state;
+        state.driveCounter = driveCounter;
+        for (const auto& [eid, drive] : *drives)
+        {
+            if (eid == drive->getEid())
+            {
+                state.drives.emplace_back(drive->getState());
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (!force && state.sameDurableState(lastSavedState) &&
+            now - lastStateSave < stateRefreshInterval)
+        {
+            return;
+        }
+        try
+        {
+            nvmemi::statefile::save(stateFile, state);
+            lastSavedState = std::move(state);
+            lastStateSave = now;
+        }
+        catch (const std::exception& e)
+        {
+            phosphor::logging::log<phosphor::logging::level::ERR>(
+                "Error saving the state file",
+                phosphor::logging::entry("MSG=%s", e.what()));
+        }
+    }
+    /**
+     * @brief Read the SMBus frequency in kHz and the MCTP transmission unit
+     * size in bytes the platform supports. The drives are left as they are
+     * if neither is set.
+     *
+     */
+    void configurePortLimits()
+    {
+        using SMBusFrequency = nvmemi::protocol::configuration::SMBusFrequency;
+        SMBusFrequency frequency = SMBusFrequency::notSupported;
+        uint16_t unitSize = 0;
+        if (auto envPtr = std::getenv("NVME_SMBUS_FREQUENCY"))
+        {
+            std::string value(envPtr);
+            if (value == "100")
+            {
+                frequency = SMBusFrequency::freq100kHz;
+            }
+            else if (value == "400")
+            {
+                frequency = SMBusFrequency::freq400kHz;
+            }
+            else if (value == "1000")
+            {
+                frequency = SMBusFrequency::freq1MHz;
+            }
+            else
+            {
+                phosphor::logging::log<phosphor::logging::level::ERR>(
+                    "Invalid NVME_SMBUS_FREQUENCY value",
+                    phosphor::logging::entry("VALUE=%s", envPtr));
+            }
+        }
+        if (auto envPtr = std::getenv("NVME_MCTP_UNIT_SIZE"))
+        {
+            try
+            {
+                unsigned long value = std::stoul(envPtr);
+                if (value < nvmemi::protocol::configuration::minMctpUnitSize ||
+                    value > std::numeric_limits<uint16_t>::max())
+                {
+                    throw std::out_of_range("MCTP unit size");
+                }
+                unitSize = static_cast<uint16_t>(value);
+            }
+            catch (const std::exception&)
+            {
+                phosphor::logging::log<phosphor::logging::level::ERR>(
+                    "Invalid NVME_MCTP_UNIT_SIZE value",
+                    phosphor::logging::entry("VALUE=%s", envPtr));
+            }
+        }
+        nvmemi::Drive::setPortLimits(frequency, unitSize);
+    }
+    /**
+     * @brief Send the requests on a kernel AF_MCTP socket instead of through
+     * mctpd if NVME_TRANSPORT is af_mctp. Endpoints are still discovered
+     * through mctpd.
+     *
+     */
+    void configureTransport()
+    {
+        auto envPtr = std::getenv("NVME_TRANSPORT");
+        if (envPtr == nullptr || std::string(envPtr) != "af_mctp")
+        {
+            return;
+        }
+#ifdef NVME_AF_MCTP
+        try
+        {
+            socketTransport = std::make_shared<nvmemi::SocketTransport>(
+                *ioContext, std::make_unique<nvmemi::MctpSocket>());
+        }
+        catch (const std::exception& e)
+        {
+            phosphor::logging::log<phosphor::logging::level::ERR>(
+                "Unable to use AF_MCTP transport, falling back to mctpd",
+                phosphor::logging::entry("MSG=%s", e.what()));
+        }
+#else
+        phosphor::logging::log<phosphor::logging::level::ERR>(
+            "AF_MCTP transport is not supported by this build");
+#endif
+    }
+
+    void configureDumpStore()
+    {
+        std::filesystem::path directory = "/tmp";
+        uintmax_t quota = defaultDumpQuotaKiB * 1024;
+        auto compression = nvmemi::DumpStore::Compression::none;
+        if (auto envPtr = std::getenv("NVME_DUMP_DIR"))
+        {
+            directory = envPtr;
+        }
+        if (auto envPtr = std::getenv("NVME_DUMP_QUOTA_KB"))
+        {
+            try
+            {
+                quota = std::stoull(envPtr) * 1024;
+            }
+            catch (const std::exception&)
+            {
+                phosphor::logging::log<phosphor::logging::level::ERR>(
+                    "Invalid NVME_DUMP_QUOTA_KB value",
+                    phosphor::logging::entry("VALUE=%s", envPtr));
+            }
+        }
+        if (auto envPtr = std::getenv("NVME_DUMP_COMPRESSION"))
+        {
+            if (auto parsed = nvmemi::dumpstore::parseCompression(envPtr))
+            {
+                compression = *parsed;
+            }
+            else
+            {
+                phosphor::logging::log<phosphor::logging::level::ERR>(
+                    "Unsupported NVME_DUMP_COMPRESSION value",
+                    phosphor::logging::entry("VALUE=%s", envPtr));
+            }
+        }
+        try
+        {
+            nvmemi::dumpstore::configure(directory, quota, compression);
+        }
+        catch (const std::exception& e)
+        {
+            phosphor::logging::log<phosphor::logging::level::ERR>(
+                "Error setting up dump directory",
+                phosphor::logging::entry("DIR=%s", directory.c_str()),
+                phosphor::logging::entry("MSG=%s", e.what()));
+        }
+    }
+    void initializeDumpStoreIntf()
+    {
+        const char* objPath = "/xyz/openbmc_project/nvme_mi/dumps";
+        dumpStoreInterface = objectServer->add_unique_interface(
+            objPath, "xyz.openbmc_project.NVM.DumpStore");
+        // ID, Size, Path
+        using DumpInfo = std::tuple<std::string, uint64_t, std::string>;
+        dumpStoreInterface->register_method("List", []() {
+            std::vector<DumpInfo> dumps;
+            for (const auto& entry : nvmemi::dumpstore::get().list())
+            {
+                dumps.emplace_back(entry.id, entry.size, entry.path.string());
+            }
+            return dumps;
+        });
+        dumpStoreInterface->register_method(
+            "Open", [this](const std::string& id) {
+                int fd = nvmemi::dumpstore::get().open(id);
+                // The reply carries a duplicate of the fd. Close ours once
+                // the reply is sent.
+                boost::asio::post(*ioContext, [fd]() { close(fd); });
+                return sdbusplus::message::unix_fd{fd};
+            });
+        dumpStoreInterface->register_method(
+            "Delete", [](const std::string& id) {
+                return nvmemi::dumpstore::get().remove(id);
+            });
+        dumpStoreInterface->initialize();
+    }
+    void initializeMetricsIntf()
+    {
+        if (metricsInterface != nullptr)
+        {
+            phosphor::logging::log<phosphor::logging::level::DEBUG>(
+                "metricsInterface already initialized");
+            return;
+        }
+
+        // Success, Timeout, CRCError, TransportError, BytesSent,
+        // BytesReceived, LatencySumMicroseconds, LatencyBuckets
+        using CommandStats =
+            std::tuple<std::string, uint64_t, uint64_t, uint64_t, uint64_t,
+                       uint64_t, uint64_t, uint64_t, std::vector<uint64_t>>;
+        const char* objPath = "/xyz/openbmc_project/metrics/nvme_mi";
+        metricsInterface = objectServer->add_unique_interface(
+            objPath, "xyz.openbmc_project.NVM.Metrics");
+        metricsInterface->register_method(
+            "GetEndpointStats", [](const uint8_t eid) {
+                auto endpoint = nvmemi::metrics::getEndpoint(eid);
+                if (endpoint == nullptr)
+                {
+                    throw std::invalid_argument("Unknown EID");
+                }
+                std::vector<CommandStats> allStats;
+                for (size_t idx = 0;
+                     idx < static_cast<size_t>(nvmemi::metrics::Command::count);
+                     idx++)
+                {
+                    auto cmd = static_cast<nvmemi::metrics::Command>(idx);
+                    const auto& stats = endpoint->get(cmd);
+                    auto buckets = stats.latency.getBuckets();
+                    allStats.emplace_back(
+                        nvmemi::metrics::getCommandName(cmd),
+                        stats.success.load(), stats.timeout.load(),
+                        stats.crcError.load(), stats.transportError.load(),
+                        stats.bytesSent.load(), stats.bytesReceived.load(),
+                        stats.latency.getSumMicroseconds(),
+                        std::vector<uint64_t>(buckets.begin(), buckets.end()));
+                }
+                return allStats;
+            });
+        metricsInterface->register_method("GetBucketBounds", []() {
+            const auto& bounds =
+                nvmemi::metrics::LatencyHistogram::bucketBounds;
+            return std::vector<uint32_t>(bounds.begin(), bounds.end());
+        });
+        // ResponseClass, TimeoutMilliseconds, SmoothedRttMicroseconds,
+        // RttVariationMicroseconds
+        using TimeoutStats =
+            std::tuple<std::string, uint32_t, int64_t, int64_t>;
+        metricsInterface->register_method(
+            "GetEndpointTimeouts", [](const uint8_t eid) {
+                using nvmemi::timeouts::ResponseClass;
+                std::vector<TimeoutStats> allTimeouts;
+                for (size_t idx = 0;
+                     idx < static_cast<size_t>(ResponseClass::count); idx++)
+                {
+                    auto responseClass = static_cast<ResponseClass>(idx);
+                    auto estimator =
+                        nvmemi::timeouts::getEstimator(eid, responseClass);
+                    if (estimator == nullptr)
+                    {
+                        throw std::invalid_argument("Unknown EID");
+                    }
+                    allTimeouts.emplace_back(
+                        nvmemi::timeouts::getResponseClassName(responseClass),
+                        static_cast<uint32_t>(estimator->getTimeout().count()),
+                        estimator->getSmoothedRtt().count(),
+                        estimator->getRttVariation().count());
+                }
+                return allTimeouts;
+            });
+        // Bus name, EIDs, outstanding transactions, waiting transactions
+        using BusStats =
+            std::tuple<std::string, std::vector<uint8_t>, uint32_t, uint32_t>;
+        metricsInterface->register_method("GetBuses", []() {
+            std::vector<BusStats> allBuses;
+            for (const auto& bus : nvmemi::scheduler::getBuses())
+            {
+                allBuses.emplace_back(bus.name, bus.endpoints,
+                                      static_cast<uint32_t>(bus.outstanding),
+                                      static_cast<uint32_t>(bus.waiting));
+            }
+            return allBuses;
+        });
+        metricsInterface->register_method("GetSharedRequests", []() {
+            return nvmemi::singleflight::getSharedCount();
+        });
+        // ErrorClass, retries made. Requests not retried because the budget
+        // was exhausted are reported as class "budget_exhausted".
+        using RetryStats = std::tuple<std::string, uint64_t>;
+        metricsInterface->register_method(
+            "GetEndpointRetries", [](const uint8_t eid) {
+                using nvmemi::retry::ErrorClass;
+                const auto* budget = nvmemi::retry::getEndpoint(eid);
+                if (budget == nullptr)
+                {
+                    throw std::invalid_argument("Unknown EID");
+                }
+                std::vector<RetryStats> allRetries;
+                for (size_t idx = 1;
+                     idx < static_cast<size_t>(ErrorClass::count); idx++)
+                {
+                    auto errorClass = static_cast<ErrorClass>(idx);
+                    allRetries.emplace_back(
+                        nvmemi::retry::getErrorClassName(errorClass),
+                        budget->getRetries(errorClass));
+                }
+                allRetries.emplace_back("budget_exhausted",
+                                        budget->getExhausted());
+                return allRetries;
+            });
+        metricsInterface->register_method("DumpPrometheus", []() {
+            return nvmemi::metrics::dumpPrometheus();
+        });
+        metricsInterface->register_method("Reset", []() {
+            for (auto eid : nvmemi::metrics::getRegisteredEndpoints())
+            {
+                nvmemi::metrics::getEndpoint(eid)->reset();
+            }
+        });
+        metricsInterface->initialize();
+    }
     void run()
     {
         this->ioContext->run();
+        saveState(true);
+        nvmemi::workers::stop();
     }
 
   private:
@@ -198,11 +1082,43 @@ class Application
     std::shared_ptr<sdbusplus::asio::object_server> objectServer{};
     std::unique_ptr<sdbusplus::asio::dbus_interface> healthStatusPollInterface =
         nullptr;
+    std::unique_ptr<sdbusplus::asio::dbus_interface> metricsInterface = nullptr;
+    std::unique_ptr<sdbusplus::asio::dbus_interface> dumpStoreInterface =
+        nullptr;
     std::unordered_map<mctpw::BindingType, std::shared_ptr<mctpw::MCTPWrapper>>
         mctpWrappers{};
-    DriveMap drives{};
+    /** @brief Transport of all drives, mctpd through the wrapper if null */
+    std::shared_ptr<nvmemi::Transport> socketTransport{};
+    std::shared_ptr<const DriveMap> drives = std::make_shared<DriveMap>();
+    std::unordered_map<mctpw::eid_t, RemovedDrive> removedDrives{};
     size_t driveCounter = 1;
+    std::filesystem::path stateFile = "/var/lib/nvme-mi/state.json";
+    nvmemi::DaemonState savedState{};
+    std::shared_ptr<boost::asio::steady_timer> stateSaveTimer;
+    /** @brief Durable fields of the state file as last written */
+    nvmemi::DaemonState lastSavedState{};
+    std::chrono::steady_clock::time_point lastStateSave =
+        std::chrono::steady_clock::now();
     std::shared_ptr<boost::asio::steady_timer> pollTimer;
+    bool batchSensorUpdates = true;
+    /** @brief Group the EIDs of the same NVM subsystem under one drive */
+    bool pathDeduplication = false;
+    std::chrono::steady_clock::time_point startTime =
+        std::chrono::steady_clock::now();
+    size_t startupPendingPolls = 0;
+    /** @brief First polls at startup that gave no reading */
+    size_t startupFailedPolls = 0;
+    bool startupEnumerated = false;
+    static constexpr size_t driveBatchSize = 4;
+    static constexpr uintmax_t defaultDumpQuotaKiB = 2048;
+    static constexpr size_t defaultWorkerThreads = 1;
+    static constexpr const char* locationPrefix = "NVMe_";
+    static const inline std::chrono::seconds removalGracePeriod{30};
+    static const inline std::chrono::seconds stateSaveInterval{60};
+    /** @brief Health readings are written at least this often */
+    static const inline std::chrono::seconds stateRefreshInterval{3600};
+    /** @brief Readings older than this are not restored at startup */
+    static const inline std::chrono::seconds maxStateAge{900};
     static constexpr const char* serviceName = "xyz.openbmc_project.nvme_mi";
     static const inline std::chrono::seconds subsystemHsPollInterval{1};
     friend struct DeviceUpdateHandler;
@@ -216,21 +1132,11 @@ void DeviceUpdateHandler::operator()(
     {
         case mctpw::Event::EventType::deviceAdded: {
             auto wrapper = app.mctpWrappers.at(bindingType);
-            auto drive = std::make_shared<nvmemi::Drive>(
-                app.getDriveName(wrapper, evt.eid), evt.eid, *app.objectServer,
-                wrapper);
-            app.drives.emplace(evt.eid, drive);
-            phosphor::logging::log<phosphor::logging::level::INFO>(
-                "New drive inserted",
-                phosphor::logging::entry("EID=%d", evt.eid));
-            if (app.drives.size() == 1)
-            {
-                app.resumeHealthStatusPolling();
-            }
+            app.addEndpoint(wrapper, evt.eid);
         }
         break;
         case mctpw::Event::EventType::deviceRemoved: {
-            if (app.drives.erase(evt.eid) == 1)
+            if (app.removeDrive(evt.eid))
             {
                 phosphor::logging::log<phosphor::logging::level::INFO>(
                     "Drive removed",
@@ -243,7 +1149,7 @@ void DeviceUpdateHandler::operator()(
                     phosphor::logging::entry("EID=%d", evt.eid));
             }
             // Timer cancellation if all drives are removed
-            if (app.drives.empty())
+            if (app.drives->empty())
             {
                 app.pauseHealthStatusPolling();
             }
@@ -0,0 +1,279 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "mctp_socket_transport.hpp"
+
+#include <boost/asio/error.hpp>
+#include <phosphor-logging/log.hpp>
+
+#ifdef NVME_AF_MCTP
+#include <linux/mctp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+#endif
+
+using nvmemi::SocketTransport;
+
+static uint16_t getKey(mctpw::eid_t eid, uint8_t tag)
+{
+    return static_cast<uint16_t>((eid << 8) | tag);
+}
+
+SocketTransport::SocketTransport(boost::asio::io_context& ioContext,
+                                 std::unique_ptr<MessageSocket> messageSocket) :
+    context(ioContext),
+    socket(std::move(messageSocket)), descriptor(ioContext, socket->getFd())
+{
+}
+
+SocketTransport::~SocketTransport()
+{
+    // The descriptor is closed by the socket
+    descriptor.release();
+}
+
+std::pair<boost::system::error_code, std::vector<uint8_t>>
+    SocketTransport::sendReceive(boost::asio::yield_context yield,
+                                 mctpw::eid_t eid,
+                                 const std::vector<uint8_t>& request,
+                                 std::chrono::milliseconds timeout)
+{
+    uint8_t tag = 0;
+    boost::system::error_code ec = socket->allocateTag(eid, tag);
+    if (ec)
+    {
+        return {ec, {}};
+    }
+    uint16_t key = getKey(eid, tag);
+    if (pending.count(key) != 0)
+    {
+        socket->releaseTag(eid, tag);
+        return {boost::asio::error::in_progress, {}};
+    }
+    // Lives on the coroutine stack until the response or the timeout
+    Pending entry(context);
+    pending.emplace(key, &entry);
+    ec = socket->send(eid, tag, request);
+    if (!ec)
+    {
+        startRead();
+        entry.timer.expires_after(timeout);
+        boost::system::error_code timerEc;
+        entry.timer.async_wait(yield[timerEc]);
+        if (!entry.done)
+        {
+            ec = boost::system::errc::make_error_code(
+                boost::system::errc::timed_out);
+        }
+    }
+    pending.erase(key);
+    socket->releaseTag(eid, tag);
+    // Nothing is read while no request waits, late responses are dropped
+    // with the next batch
+    if (pending.empty())
+    {
+        descriptor.cancel();
+    }
+    if (ec)
+    {
+        return {ec, {}};
+    }
+    return {ec, std::move(entry.response)};
+}
+
+void SocketTransport::startRead()
+{
+    if (reading)
+    {
+        return;
+    }
+    reading = true;
+    std::weak_ptr<SocketTransport> weak = weak_from_this();
+    descriptor.async_wait(
+        boost::asio::posix::stream_descriptor::wait_read,
+        [weak](const boost::system::error_code& ec) {
+            auto self = weak.lock();
+            if (!self)
+            {
+                return;
+            }
+            self->reading = false;
+            if (ec && ec != boost::asio::error::operation_aborted)
+            {
+                phosphor::logging::log<phosphor::logging::level::ERR>(
+                    "MCTP socket wait error",
+                    phosphor::logging::entry("MSG=%s", ec.message().c_str()));
+                return;
+            }
+            if (!ec)
+            {
+                self->readMessages();
+            }
+            // The wait is cancelled when the last request finishes, but a
+            // new one can be sent before the handler runs
+            if (!self->pending.empty())
+            {
+                self->startRead();
+            }
+        });
+}
+
+void SocketTransport::readMessages()
+{
+    while (true)
+    {
+        mctpw::eid_t eid = 0;
+        uint8_t tag = 0;
+        std::vector<uint8_t> message;
+        boost::system::error_code ec = socket->receive(eid, tag, message);
+        if (ec == boost::asio::error::would_block)
+        {
+            return;
+        }
+        if (ec)
+        {
+            phosphor::logging::log<phosphor::logging::level::ERR>(
+                "MCTP socket receive error",
+                phosphor::logging::entry("MSG=%s", ec.message().c_str()));
+            return;
+        }
+        auto it = pending.find(getKey(eid, tag));
+        if (it == pending.end() || it->second->done)
+        {
+            phosphor::logging::log<phosphor::logging::level::DEBUG>(
+                "Dropped MCTP message without a matching request",
+                phosphor::logging::entry("EID=%d", eid),
+                phosphor::logging::entry("TAG=%d", tag));
+            continue;
+        }
+        Pending& entry = *it->second;
+        entry.done = true;
+        entry.response = std::move(message);
+        entry.timer.cancel();
+    }
+}
+
+#ifdef NVME_AF_MCTP
+using nvmemi::MctpSocket;
+
+static constexpr size_t maxMessageSize = 64 * 1024;
+
+static boost::system::error_code getErrno()
+{
+    return boost::system::error_code(errno,
+                                     boost::system::system_category());
+}
+
+MctpSocket::MctpSocket(unsigned int network) : net(network)
+{
+    fd = ::socket(AF_MCTP, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Unable to open AF_MCTP socket");
+    }
+}
+
+MctpSocket::~MctpSocket()
+{
+    ::close(fd);
+}
+
+int MctpSocket::getFd() const
+{
+    return fd;
+}
+
+boost::system::error_code MctpSocket::allocateTag(mctpw::eid_t eid,
+                                                  uint8_t& tag)
+{
+    mctp_ioc_tag_ctl ctl{};
+    ctl.peer_addr = eid;
+    if (::ioctl(fd, SIOCMCTPALLOCTAG, &ctl) < 0)
+    {
+        return getErrno();
+    }
+    tag = ctl.tag & MCTP_TAG_MASK;
+    return {};
+}
+
+void MctpSocket::releaseTag(mctpw::eid_t eid, uint8_t tag)
+{
+    mctp_ioc_tag_ctl ctl{};
+    ctl.peer_addr = eid;
+    ctl.tag = static_cast<uint8_t>(MCTP_TAG_OWNER | MCTP_TAG_PREALLOC | tag);
+    if (::ioctl(fd, SIOCMCTPDROPTAG, &ctl) < 0)
+    {
+        phosphor::logging::log<phosphor::logging::level::WARNING>(
+            "Unable to release MCTP tag",
+            phosphor::logging::entry("EID=%d", eid),
+            phosphor::logging::entry("TAG=%d", tag));
+    }
+}
+
+boost::system::error_code MctpSocket::send(mctpw::eid_t eid, uint8_t tag,
+                                           const std::vector<uint8_t>& message)
+{
+    if (message.empty())
+    {
+        return boost::system::errc::make_error_code(
+            boost::system::errc::invalid_argument);
+    }
+    // The kernel puts the message type byte in front of the payload
+    sockaddr_mctp addr{};
+    addr.smctp_family = AF_MCTP;
+    addr.smctp_network = net;
+    addr.smctp_addr.s_addr = eid;
+    addr.smctp_type = message[0];
+    addr.smctp_tag =
+        static_cast<uint8_t>(MCTP_TAG_OWNER | MCTP_TAG_PREALLOC | tag);
+    if (::sendto(fd, message.data() + 1, message.size() - 1, 0,
+                 reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        return getErrno();
+    }
+    return {};
+}
+
+boost::system::error_code MctpSocket::receive(mctpw::eid_t& eid, uint8_t& tag,
+                                              std::vector<uint8_t>& message)
+{
+    message.resize(maxMessageSize);
+    sockaddr_mctp addr{};
+    socklen_t addrLen = sizeof(addr);
+    ssize_t len = ::recvfrom(fd, message.data() + 1, message.size() - 1,
+                             MSG_DONTWAIT | MSG_TRUNC,
+                             reinterpret_cast<sockaddr*>(&addr), &addrLen);
+    if (len < 0)
+    {
+        return getErrno();
+    }
+    if (static_cast<size_t>(len) >= message.size())
+    {
+        return boost::system::errc::make_error_code(
+            boost::system::errc::message_size);
+    }
+    message[0] = addr.smctp_type;
+    message.resize(static_cast<size_t>(len) + 1);
+    eid = addr.smctp_addr.s_addr;
+    tag = addr.smctp_tag & MCTP_TAG_MASK;
+    return {};
+}
+#endif
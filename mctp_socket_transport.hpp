@@ -0,0 +1,149 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include "transport.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <memory>
+#include <unordered_map>
+
+namespace nvmemi
+{
+/**
+ * @brief Datagram socket carrying MCTP messages tagged with the peer EID and
+ * the message tag
+ *
+ */
+class MessageSocket
+{
+  public:
+    virtual ~MessageSocket() = default;
+    /**
+     * @brief Descriptor to wait on for incoming messages. Must be non
+     * blocking.
+     *
+     */
+    virtual int getFd() const = 0;
+    /**
+     * @brief Reserve a message tag for a request to the EID. The tag stays
+     * owned until released.
+     *
+     */
+    virtual boost::system::error_code allocateTag(mctpw::eid_t eid,
+                                                  uint8_t& tag) = 0;
+    virtual void releaseTag(mctpw::eid_t eid, uint8_t tag) = 0;
+    virtual boost::system::error_code
+        send(mctpw::eid_t eid, uint8_t tag,
+             const std::vector<uint8_t>& message) = 0;
+    /**
+     * @brief Read one message without blocking
+     *
+     * @return would_block error if no message is queued
+     */
+    virtual boost::system::error_code
+        receive(mctpw::eid_t& eid, uint8_t& tag,
+                std::vector<uint8_t>& message) = 0;
+};
+
+/**
+ * @brief Transport sending the requests straight on a socket. Responses are
+ * read on the io_context and matched to the requests by EID and tag.
+ *
+ */
+class SocketTransport : public Transport,
+                        public std::enable_shared_from_this<SocketTransport>
+{
+  public:
+    /**
+     * @brief Construct a new SocketTransport object. Must be owned by a
+     * shared_ptr.
+     *
+     * @param ioContext io_context the responses are read on
+     * @param messageSocket Socket to send the requests on
+     */
+    SocketTransport(boost::asio::io_context& ioContext,
+                    std::unique_ptr<MessageSocket> messageSocket);
+    SocketTransport(const SocketTransport&) = delete;
+    SocketTransport& operator=(const SocketTransport&) = delete;
+    ~SocketTransport() override;
+
+    std::pair<boost::system::error_code, std::vector<uint8_t>>
+        sendReceive(boost::asio::yield_context yield, mctpw::eid_t eid,
+                    const std::vector<uint8_t>& request,
+                    std::chrono::milliseconds timeout) override;
+
+  private:
+    /** @brief Request waiting for its response */
+    struct Pending
+    {
+        explicit Pending(boost::asio::io_context& ioContext) : timer(ioContext)
+        {
+        }
+        boost::asio::steady_timer timer;
+        bool done = false;
+        std::vector<uint8_t> response;
+    };
+
+    void startRead();
+    void readMessages();
+
+    boost::asio::io_context& context;
+    std::unique_ptr<MessageSocket> socket;
+    boost::asio::posix::stream_descriptor descriptor;
+    bool reading = false;
+    /** @brief Requests keyed by EID and tag */
+    std::unordered_map<uint16_t, Pending*> pending;
+};
+
+#ifdef NVME_AF_MCTP
+/**
+ * @brief Kernel AF_MCTP socket. The kernel owns the routing, tags are
+ * reserved with SIOCMCTPALLOCTAG.
+ *
+ */
+class MctpSocket : public MessageSocket
+{
+  public:
+    /**
+     * @brief Open the socket. Responses to the requests sent with an owned
+     * tag are routed to the socket by the kernel, so it is not bound.
+     *
+     * @param network MCTP network ID, MCTP_NET_ANY (0) for the default one
+     */
+    explicit MctpSocket(unsigned int network = 0);
+    MctpSocket(const MctpSocket&) = delete;
+    MctpSocket& operator=(const MctpSocket&) = delete;
+    ~MctpSocket() override;
+
+    int getFd() const override;
+    boost::system::error_code allocateTag(mctpw::eid_t eid,
+                                          uint8_t& tag) override;
+    void releaseTag(mctpw::eid_t eid, uint8_t tag) override;
+    boost::system::error_code
+        send(mctpw::eid_t eid, uint8_t tag,
+             const std::vector<uint8_t>& message) override;
+    boost::system::error_code receive(mctpw::eid_t& eid, uint8_t& tag,
+                                      std::vector<uint8_t>& message) override;
+
+  private:
+    int fd = -1;
+    unsigned int net;
+};
+#endif
+} // namespace nvmemi
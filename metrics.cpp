@@ -0,0 +1,324 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "metrics.hpp"
+
+#include "endpoint_registry.hpp"
+#include "protocol/admin/admin_cmd.hpp"
+#include "protocol/mi_msg.hpp"
+
+#include <boost/asio/error.hpp>
+#include <cstring>
+#include <memory>
+#include <sstream>
+
+namespace nvmemi::metrics
+{
+static EndpointRegistry<EndpointStats> endpoints{};
+
+void LatencyHistogram::observe(std::chrono::microseconds latency) noexcept
+{
+    uint64_t latencyUs = latency.count() > 0 ? latency.count() : 0;
+    size_t idx = 0;
+    while (idx < bucketBounds.size() &&
+           latencyUs > static_cast<uint64_t>(bucketBounds[idx]) * 1000)
+    {
+        idx++;
+    }
+    buckets[idx].fetch_add(1, std::memory_order_relaxed);
+    sumMicroseconds.fetch_add(latencyUs, std::memory_order_relaxed);
+}
+
+std::array<uint64_t, LatencyHistogram::bucketCount>
+    LatencyHistogram::getBuckets() const noexcept
+{
+    std::array<uint64_t, bucketCount> counts{};
+    for (size_t idx = 0; idx < bucketCount; idx++)
+    {
+        counts[idx] = buckets[idx].load(std::memory_order_relaxed);
+    }
+    return counts;
+}
+
+uint64_t LatencyHistogram::getSumMicroseconds() const noexcept
+{
+    return sumMicroseconds.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() noexcept
+{
+    for (auto& bucket : buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    sumMicroseconds.store(0, std::memory_order_relaxed);
+}
+
+void CommandStats::reset() noexcept
+{
+    latency.reset();
+    success.store(0, std::memory_order_relaxed);
+    timeout.store(0, std::memory_order_relaxed);
+    crcError.store(0, std::memory_order_relaxed);
+    transportError.store(0, std::memory_order_relaxed);
+    bytesSent.store(0, std::memory_order_relaxed);
+    bytesReceived.store(0, std::memory_order_relaxed);
+}
+
+void EndpointStats::record(Command cmd, Outcome outcome,
+                           std::chrono::microseconds latency, size_t txBytes,
+                           size_t rxBytes) noexcept
+{
+    if (cmd >= Command::count)
+    {
+        cmd = Command::other;
+    }
+    auto& stats = commands[static_cast<size_t>(cmd)];
+    switch (outcome)
+    {
+        case Outcome::success:
+            stats.success.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case Outcome::timeout:
+            stats.timeout.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case Outcome::crcError:
+            stats.crcError.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case Outcome::transportError:
+            stats.transportError.fetch_add(1, std::memory_order_relaxed);
+            break;
+    }
+    // Timed out transactions are not added to the histogram as the latency
+    // would only reflect the configured timeout.
+    if (outcome != Outcome::timeout)
+    {
+        stats.latency.observe(latency);
+    }
+    stats.bytesSent.fetch_add(txBytes, std::memory_order_relaxed);
+    stats.bytesReceived.fetch_add(rxBytes, std::memory_order_relaxed);
+}
+
+const CommandStats& EndpointStats::get(Command cmd) const noexcept
+{
+    if (cmd >= Command::count)
+    {
+        cmd = Command::other;
+    }
+    return commands[static_cast<size_t>(cmd)];
+}
+
+void EndpointStats::reset() noexcept
+{
+    for (auto& stats : commands)
+    {
+        stats.reset();
+    }
+}
+
+Command classifyRequest(const std::vector<uint8_t>& request) noexcept
+{
+    using nvmemi::protocol::AdminOpCode;
+    using nvmemi::protocol::CommonHeader;
+    using nvmemi::protocol::MiOpCode;
+    using nvmemi::protocol::NVMeMessageTye;
+    // Opcode is the first byte after the common header for both MI and
+    // Admin commands
+    if (request.size() <= sizeof(CommonHeader))
+    {
+        return Command::other;
+    }
+    auto header = reinterpret_cast<const CommonHeader*>(request.data());
+    uint8_t opCode = request[sizeof(CommonHeader)];
+    if (header->nvmeMiMsgType == NVMeMessageTye::miCommand)
+    {
+        switch (static_cast<MiOpCode>(opCode))
+        {
+            case MiOpCode::readDataStructure:
+                return Command::readDataStructure;
+            case MiOpCode::subsystemHealthStatusPoll:
+                return Command::subsystemHealthStatusPoll;
+            case MiOpCode::controllerHealthStatusPoll:
+                return Command::controllerHealthStatusPoll;
+            case MiOpCode::configSet:
+                return Command::configSet;
+            case MiOpCode::configGet:
+                return Command::configGet;
+            case MiOpCode::vpdRead:
+                return Command::vpdRead;
+            default:
+                return Command::other;
+        }
+    }
+    if (header->nvmeMiMsgType == NVMeMessageTye::adminCommand)
+    {
+        switch (static_cast<AdminOpCode>(opCode))
+        {
+            case AdminOpCode::getLogPage:
+                return Command::getLogPage;
+            case AdminOpCode::identify:
+                return Command::identify;
+            case AdminOpCode::getFeatures:
+                return Command::getFeatures;
+            case AdminOpCode::setFeatures:
+                return Command::setFeatures;
+            default:
+                return Command::other;
+        }
+    }
+    return Command::other;
+}
+
+Outcome classifyResponse(const boost::system::error_code& ec,
+                         const std::vector<uint8_t>& response) noexcept
+{
+    if (ec == boost::system::errc::timed_out ||
+        ec == boost::asio::error::timed_out)
+    {
+        return Outcome::timeout;
+    }
+    if (ec)
+    {
+        return Outcome::transportError;
+    }
+    using CRC32C = nvmemi::protocol::NVMeMessage<const uint8_t*>::CRC32C;
+    if (response.size() <= sizeof(CRC32C))
+    {
+        return Outcome::crcError;
+    }
+    size_t dataSize = response.size() - sizeof(CRC32C);
+    CRC32C crc = 0;
+    std::memcpy(&crc, response.data() + dataSize, sizeof(crc));
+    if (le32toh(crc) != crc32c(response.data(), static_cast<int>(dataSize)))
+    {
+        return Outcome::crcError;
+    }
+    return Outcome::success;
+}
+
+const char* getCommandName(Command cmd) noexcept
+{
+    switch (cmd)
+    {
+        case Command::readDataStructure:
+            return "read_data_structure";
+        case Command::subsystemHealthStatusPoll:
+            return "subsystem_health_status_poll";
+        case Command::controllerHealthStatusPoll:
+            return "controller_health_status_poll";
+        case Command::configSet:
+            return "config_set";
+        case Command::configGet:
+            return "config_get";
+        case Command::vpdRead:
+            return "vpd_read";
+        case Command::getLogPage:
+            return "get_log_page";
+        case Command::identify:
+            return "identify";
+        case Command::getFeatures:
+            return "get_features";
+        case Command::setFeatures:
+            return "set_features";
+        default:
+            return "other";
+    }
+}
+
+EndpointStats& registerEndpoint(mctpw::eid_t eid, const void* owner)
+{
+    return endpoints.add(eid, owner);
+}
+
+void unregisterEndpoint(mctpw::eid_t eid, const void* owner)
+{
+    endpoints.remove(eid, owner);
+}
+
+EndpointStats* getEndpoint(mctpw::eid_t eid) noexcept
+{
+    return endpoints.get(eid);
+}
+
+std::vector<mctpw::eid_t> getRegisteredEndpoints()
+{
+    return endpoints.getEids();
+}
+
+std::string dumpPrometheus()
+{
+    static constexpr const char* prefix = "nvme_mi_";
+    std::stringstream hist;
+    std::stringstream requests;
+    std::stringstream bytes;
+    hist << "# TYPE " << prefix << "request_duration_seconds histogram\n";
+    requests << "# TYPE " << prefix << "requests_total counter\n";
+    bytes << "# TYPE " << prefix << "transferred_bytes_total counter\n";
+    for (auto eid : getRegisteredEndpoints())
+    {
+        const EndpointStats& endpoint = *endpoints.get(eid);
+        for (size_t idx = 0; idx < static_cast<size_t>(Command::count); idx++)
+        {
+            auto cmd = static_cast<Command>(idx);
+            const CommandStats& stats = endpoint.get(cmd);
+            std::string labels = "eid=\"" + std::to_string(eid) +
+                                 "\",command=\"" + getCommandName(cmd) + "\"";
+            auto counts = stats.latency.getBuckets();
+            uint64_t cumulative = 0;
+            for (size_t bucket = 0; bucket < counts.size(); bucket++)
+            {
+                cumulative += counts[bucket];
+                hist << prefix << "request_duration_seconds_bucket{" << labels
+                     << ",le=\"";
+                if (bucket < LatencyHistogram::bucketBounds.size())
+                {
+                    hist << LatencyHistogram::bucketBounds[bucket] / 1000.0;
+                }
+                else
+                {
+                    hist << "+Inf";
+                }
+                hist << "\"} " << cumulative << '\n';
+            }
+            hist << prefix << "request_duration_seconds_sum{" << labels << "} "
+                 << stats.latency.getSumMicroseconds() / 1000000.0 << '\n';
+            hist << prefix << "request_duration_seconds_count{" << labels
+                 << "} " << cumulative << '\n';
+
+            std::pair<const char*, uint64_t> outcomes[] = {
+                {"success", stats.success.load(std::memory_order_relaxed)},
+                {"timeout", stats.timeout.load(std::memory_order_relaxed)},
+                {"crc_error", stats.crcError.load(std::memory_order_relaxed)},
+                {"transport_error",
+                 stats.transportError.load(std::memory_order_relaxed)}};
+            for (const auto& [outcome, count] : outcomes)
+            {
+                requests << prefix << "requests_total{" << labels
+                         << ",outcome=\"" << outcome << "\"} " << count
+                         << '\n';
+            }
+            bytes << prefix << "transferred_bytes_total{" << labels
+                  << ",direction=\"tx\"} "
+                  << stats.bytesSent.load(std::memory_order_relaxed) << '\n';
+            bytes << prefix << "transferred_bytes_total{" << labels
+                  << ",direction=\"rx\"} "
+                  << stats.bytesReceived.load(std::memory_order_relaxed)
+                  << '\n';
+        }
+    }
+    return hist.str() + requests.str() + bytes.str();
+}
+} // namespace nvmemi::metrics
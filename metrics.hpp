@@ -0,0 +1,179 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <boost/system/error_code.hpp>
+#include <chrono>
+#include <cstdint>
+#include <mctp_wrapper.hpp>
+#include <string>
+#include <vector>
+
+namespace nvmemi::metrics
+{
+/**
+ * @brief NVMe-MI command classes tracked by the metrics. Derived from the
+ * message type and opcode of the request.
+ *
+ */
+enum class Command : uint8_t
+{
+    readDataStructure,
+    subsystemHealthStatusPoll,
+    controllerHealthStatusPoll,
+    configSet,
+    configGet,
+    vpdRead,
+    getLogPage,
+    identify,
+    getFeatures,
+    setFeatures,
+    other,
+    count
+};
+
+enum class Outcome : uint8_t
+{
+    success,
+    timeout,
+    crcError,
+    transportError,
+};
+
+/**
+ * @brief Fixed bucket latency histogram. All the members are atomics so the
+ * histogram can be updated without locks or allocations.
+ *
+ */
+class LatencyHistogram
+{
+  public:
+    /** @brief Upper bounds of the buckets in milliseconds */
+    static constexpr std::array<uint32_t, 12> bucketBounds = {
+        1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+    /** @brief One extra bucket for values above the last bound */
+    static constexpr size_t bucketCount = bucketBounds.size() + 1;
+
+    void observe(std::chrono::microseconds latency) noexcept;
+    /**
+     * @brief Get the per bucket counts. Counts are not cumulative.
+     *
+     * @return std::array<uint64_t, bucketCount> Count of samples per bucket
+     */
+    std::array<uint64_t, bucketCount> getBuckets() const noexcept;
+    uint64_t getSumMicroseconds() const noexcept;
+    void reset() noexcept;
+
+  private:
+    std::array<std::atomic<uint64_t>, bucketCount> buckets{};
+    std::atomic<uint64_t> sumMicroseconds{0};
+};
+
+struct CommandStats
+{
+    LatencyHistogram latency;
+    std::atomic<uint64_t> success{0};
+    std::atomic<uint64_t> timeout{0};
+    std::atomic<uint64_t> crcError{0};
+    std::atomic<uint64_t> transportError{0};
+    std::atomic<uint64_t> bytesSent{0};
+    std::atomic<uint64_t> bytesReceived{0};
+
+    void reset() noexcept;
+};
+
+/**
+ * @brief Request statistics of a single MCTP endpoint
+ *
+ */
+class EndpointStats
+{
+  public:
+    /**
+     * @brief Record the result of one request response transaction
+     *
+     * @param cmd Command class of the request
+     * @param outcome Result of the transaction
+     * @param latency Time taken from send to receive
+     * @param txBytes Size of the request
+     * @param rxBytes Size of the response
+     */
+    void record(Command cmd, Outcome outcome,
+                std::chrono::microseconds latency, size_t txBytes,
+                size_t rxBytes) noexcept;
+    const CommandStats& get(Command cmd) const noexcept;
+    void reset() noexcept;
+
+  private:
+    std::array<CommandStats, static_cast<size_t>(Command::count)> commands{};
+};
+
+/**
+ * @brief Get the command class for a raw NVMe-MI request
+ *
+ * @param request Request bytes including the NVMe-MI header
+ * @return Command Command class. Command::other if not tracked separately
+ */
+Command classifyRequest(const std::vector<uint8_t>& request) noexcept;
+
+/**
+ * @brief Get the outcome of a transaction from the transport error code and
+ * the integrity of the response
+ *
+ */
+Outcome classifyResponse(const boost::system::error_code& ec,
+                         const std::vector<uint8_t>& response) noexcept;
+
+const char* getCommandName(Command cmd) noexcept;
+
+/**
+ * @brief Allocate statistics for an endpoint. Must be called before requests
+ * are sent so that the hot path does not allocate.
+ *
+ * @param eid MCTP EID
+ * @param owner Object the endpoint is registered for. An endpoint registered
+ * for an other owner gets a new entry.
+ * @return EndpointStats& Statistics object for the EID
+ */
+EndpointStats& registerEndpoint(mctpw::eid_t eid,
+                                const void* owner = nullptr);
+/**
+ * @brief Free the entry of an endpoint
+ *
+ * @param eid MCTP EID
+ * @param owner Owner given at registration. The entry is kept if the endpoint
+ * was registered for an other owner since. nullptr frees it anyway.
+ */
+void unregisterEndpoint(mctpw::eid_t eid, const void* owner = nullptr);
+/**
+ * @brief Get the statistics for an endpoint
+ *
+ * @param eid MCTP EID
+ * @return EndpointStats* nullptr if the endpoint is not registered
+ */
+EndpointStats* getEndpoint(mctpw::eid_t eid) noexcept;
+std::vector<mctpw::eid_t> getRegisteredEndpoints();
+
+/**
+ * @brief Dump the statistics of all registered endpoints in Prometheus text
+ * exposition format
+ *
+ * @return std::string Metrics text
+ */
+std::string dumpPrometheus();
+} // namespace nvmemi::metrics
@@ -17,9 +17,10 @@
 #include "numeric_sensor.hpp"
 
 #include "threshold_helper.hpp"
+#include "utils.hpp"
 
+#include <algorithm>
 #include <phosphor-logging/log.hpp>
-#include <regex>
 
 using nvmemi::NumericSensor;
 
@@ -48,7 +49,7 @@ NumericSensor::NumericSensor(sdbusplus::asio::object_server& objServer,
                              const std::string& sensorName,
                              std::vector<thresholds::Threshold> thresholdVals,
                              const double min, const double max) :
-    name(std::regex_replace(sensorName, std::regex("[^a-zA-Z0-9_/]+"), "_")),
+    name(nvmemi::utils::sanitizeName(sensorName)),
     thresholds(std::move(thresholdVals)), minValue(min), maxValue(max),
     hysteresisTrigger((max - min) * 0.01),
     hysteresisPublish((max - min) * 0.0001)
@@ -74,9 +75,19 @@ NumericSensor::NumericSensor(sdbusplus::asio::object_server& objServer,
     setInitialProperties(false);
 }
 
+NumericSensor::~NumericSensor()
+{
+    if (publishPending)
+    {
+        pendingSensors.erase(
+            std::remove(pendingSensors.begin(), pendingSensors.end(), this),
+            pendingSensors.end());
+    }
+}
+
 void NumericSensor::markFunctional(bool isFunctional)
 {
-    operationalInterface->set_property("Functional", isFunctional);
+    operationalInterface->set_property<bool, true>("Functional", isFunctional);
 
     if (isFunctional)
     {
@@ -90,11 +101,62 @@ void NumericSensor::markFunctional(bool isFunctional)
 
 void NumericSensor::markAvailable(bool isAvailable)
 {
-    availableInterface->set_property("Available", isAvailable);
+    availableInterface->set_property<bool, true>("Available", isAvailable);
     errCount = 0;
 }
 
 void NumericSensor::updateValue(const double newValue)
+{
+    if (!batchActive)
+    {
+        publishValue(newValue);
+        return;
+    }
+    pendingValue = newValue;
+    if (!publishPending)
+    {
+        publishPending = true;
+        pendingSensors.emplace_back(this);
+    }
+}
+
+void NumericSensor::beginBatch()
+{
+    batchActive = true;
+}
+
+void NumericSensor::flushBatch()
+{
+    batchActive = false;
+    std::vector<NumericSensor*> sensors;
+    sensors.swap(pendingSensors);
+    for (NumericSensor* sensor : sensors)
+    {
+        sensor->publishPending = false;
+        sensor->publishValue(sensor->pendingValue);
+    }
+}
+
+std::optional<double>
+    NumericSensor::getThreshold(thresholds::Level level,
+                                thresholds::Direction direction) const
+{
+    for (const auto& threshold : thresholds)
+    {
+        if (threshold.level == level && threshold.direction == direction)
+        {
+            return threshold.value;
+        }
+    }
+    return std::nullopt;
+}
+
+void NumericSensor::setThresholdsChangedHandler(std::function<void()> handler)
+{
+    thresholdsChanged = std::move(handler);
+}
+
+void NumericSensor::publishValue(const double newValue)
 {
     if (requiresUpdate(value, newValue))
     {
@@ -177,6 +239,10 @@ void NumericSensor::setInitialProperties(const bool sensorDisabled)
                     // directly. Let the regular sensor monitor call the same
                     // using updateValue(), which can check conditions like
                     // poweron, etc., before raising any event.
+                    if (thresholdsChanged)
+                    {
+                        thresholdsChanged();
+                    }
                     return 1;
                 }))
 
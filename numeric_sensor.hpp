@@ -19,7 +19,9 @@
 #include "change_param.hpp"
 #include "threshold.hpp"
 
+#include <functional>
 #include <memory>
+#include <optional>
 #include <sdbusplus/asio/object_server.hpp>
 #include <string>
 #include <vector>
@@ -48,6 +50,9 @@ class NumericSensor
                   std::vector<thresholds::Threshold> thresholdVals,
                   const double min = std::numeric_limits<double>::quiet_NaN(),
                   const double max = std::numeric_limits<double>::quiet_NaN());
+    NumericSensor(const NumericSensor&) = delete;
+    NumericSensor& operator=(const NumericSensor&) = delete;
+    ~NumericSensor();
     /**
      * @brief Mark sensor as functional or not
      *
@@ -69,12 +74,52 @@ class NumericSensor
      */
     void updateValue(const double newValue);
 
+    /**
+     * @brief Start buffering sensor updates. Updates from all the sensors
+     * are held until flushBatch is called. Used to publish the results of a
+     * poll sweep together instead of one sensor at a time.
+     *
+     */
+    static void beginBatch();
+
+    /**
+     * @brief Publish the updates buffered since beginBatch and return to
+     * immediate publication
+     *
+     */
+    static void flushBatch();
+
+    /**
+     * @brief Get the current value of a threshold. Values set over DBus are
+     * included.
+     *
+     * @param level Threshold level
+     * @param direction Threshold direction
+     * @return Value of the threshold, std::nullopt if the sensor has none
+     */
+    std::optional<double> getThreshold(thresholds::Level level,
+                                       thresholds::Direction direction) const;
+
+    /**
+     * @brief Set the function called after a threshold is changed over DBus
+     *
+     */
+    void setThresholdsChangedHandler(std::function<void()> handler);
+
   private:
+    void publishValue(const double newValue);
+
+    static inline bool batchActive = false;
+    static inline std::vector<NumericSensor*> pendingSensors{};
+    bool publishPending = false;
+    double pendingValue{std::numeric_limits<double>::quiet_NaN()};
+
     std::string name{};
     std::unique_ptr<sdbusplus::asio::dbus_interface> sensorInterface{};
     std::unique_ptr<sdbusplus::asio::dbus_interface> availableInterface{};
     std::unique_ptr<sdbusplus::asio::dbus_interface> operationalInterface{};
     std::vector<thresholds::Threshold> thresholds{};
+    std::function<void()> thresholdsChanged{};
     std::unique_ptr<sdbusplus::asio::dbus_interface>
         thresholdInterfaceWarning{};
     std::unique_ptr<sdbusplus::asio::dbus_interface>
@@ -24,6 +24,7 @@ enum class AdminOpCode : uint8_t
 {
     getLogPage = 0x02,
     identify = 0x06,
+    setFeatures = 0x09,
     getFeatures = 0x0A,
 };
 
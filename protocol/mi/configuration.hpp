@@ -0,0 +1,75 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace nvmemi::protocol::configuration
+{
+enum class ConfigurationId : uint8_t
+{
+    smbusFrequency = 0x01,
+    healthStatusChange = 0x02,
+    mctpUnitSize = 0x03,
+};
+
+enum class SMBusFrequency : uint8_t
+{
+    notSupported = 0x00,
+    freq100kHz = 0x01,
+    freq400kHz = 0x02,
+    freq1MHz = 0x03,
+};
+
+/** @brief Smallest MCTP transmission unit size a port has to support */
+static constexpr uint16_t minMctpUnitSize = 64;
+
+/**
+ * @brief Dword 0 of Configuration Set and Configuration Get
+ *
+ */
+struct RequestDWord0
+{
+    uint8_t configurationId;
+    uint8_t smbusFrequency : 4;
+    uint16_t reserved : 12;
+    uint8_t portId;
+} __attribute__((packed));
+
+/**
+ * @brief Get the highest SMBus frequency supported by both the drive and the
+ * platform. The current frequency is kept if it is already higher.
+ *
+ */
+constexpr SMBusFrequency negotiateFrequency(SMBusFrequency current,
+                                            SMBusFrequency driveMax,
+                                            SMBusFrequency platformMax)
+{
+    return std::max(current, std::min(driveMax, platformMax));
+}
+
+/**
+ * @brief Get the largest MCTP transmission unit size supported by both the
+ * drive and the platform. The current size is kept if it is already larger.
+ *
+ */
+constexpr uint16_t negotiateUnitSize(uint16_t current, uint16_t driveMax,
+                                     uint16_t platformMax)
+{
+    return std::max(current, std::min(driveMax, platformMax));
+}
+} // namespace nvmemi::protocol::configuration
@@ -16,7 +16,11 @@
 
 #pragma once
 
+#include <endian.h>
+
+#include <cstddef>
 #include <cstdint>
+#include <optional>
 
 namespace nvmemi::protocol::controllerhspoll
 {
@@ -40,4 +44,71 @@ struct DWord1
     uint32_t rsvd2 : 26;
     bool clearChangedFlags : 1;
 } __attribute__((packed));
+
+/**
+ * @brief Controller Health Data Structure, one per controller reported
+ *
+ */
+struct ControllerHealth
+{
+    uint16_t controllerId;
+    uint16_t controllerStatus;
+    uint16_t compositeTemperature;
+    uint8_t percentageUsed;
+    uint8_t availableSpare;
+    uint8_t criticalWarning;
+    uint16_t changedFlags;
+    uint8_t rsvd[5];
+} __attribute__((packed));
+
+/**
+ * @brief Entries requested per page. maxEntries could ask for 256, but the
+ * Response Entries field of the response is a byte and counts at most 255.
+ */
+constexpr size_t maxEntriesPerPage = 255;
+
+/**
+ * @brief Get the request dword 0 for a page of controllers. PCI functions
+ * and SR-IOV physical and virtual functions are included, so that all the
+ * controllers of multi function drives are reported.
+ *
+ * @param startId Controller ID to start the page at
+ * @param entries Number of entries, 1 to maxEntriesPerPage
+ */
+inline DWord0 getPageRequest(uint16_t startId, size_t entries)
+{
+    DWord0 dword0{};
+    dword0.startId = htole16(startId);
+    // 0's based
+    dword0.maxEntries = static_cast<uint8_t>(entries - 1);
+    dword0.includePCIFunctions = true;
+    dword0.includeSRIOVPhysical = true;
+    dword0.includeSRIOVVirtual = true;
+    dword0.reportAll = true;
+    return dword0;
+}
+
+/**
+ * @brief Get the start ID of the page following a response. Controller IDs
+ * are not contiguous, so the next page starts after the last ID reported
+ * rather than after the number of entries. A short page is not taken as the
+ * last one, since a drive can return fewer entries than requested to fit its
+ * message size; paging stops at an empty page.
+ *
+ * @param startId Start ID of the page
+ * @param received Number of entries in the response
+ * @param lastId Controller ID of the last entry in the response
+ * @return std::optional<uint16_t> nullopt if there are no more controllers
+ */
+constexpr std::optional<uint16_t> getNextStartId(uint16_t startId,
+                                                 size_t received,
+                                                 uint16_t lastId)
+{
+    // A last ID before the start ID would page forever
+    if (received == 0 || lastId < startId || lastId == UINT16_MAX)
+    {
+        return std::nullopt;
+    }
+    return static_cast<uint16_t>(lastId + 1);
+}
 } // namespace nvmemi::protocol::controllerhspoll
@@ -45,4 +45,26 @@ struct SubsystemInfo
     uint8_t reserverd[29];
 } __attribute__((packed));
 
+enum class PortType : uint8_t
+{
+    inactive = 0x00,
+    pcie = 0x01,
+    smbus = 0x02,
+};
+
+struct PortInfo
+{
+    PortType portType;
+    uint8_t reserved1;
+    uint16_t maxMctpUnitSize;
+    uint32_t managementEndpointBufferSize;
+    // Fields of SMBus/I2C ports
+    uint8_t vpdAddress;
+    uint8_t vpdMaxFrequency;
+    uint8_t managementEndpointAddress;
+    uint8_t managementEndpointMaxFrequency;
+    uint8_t basicManagement;
+    uint8_t reserved2[19];
+} __attribute__((packed));
+
 } // namespace nvmemi::protocol::readnvmeds
\ No newline at end of file
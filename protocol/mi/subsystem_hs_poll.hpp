@@ -17,6 +17,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <stdexcept>
 
 namespace nvmemi::protocol::subsystemhs
@@ -64,6 +65,45 @@ struct ResponseData
     uint16_t reserved;
 } __attribute__((packed));
 
+/**
+ * @brief Bits of CompositeControllerStatus that report a change since the
+ * status was last cleared with clearStatus
+ *
+ */
+enum Change : uint16_t
+{
+    resetOccured = 1 << 4,
+    controllerEnableChanged = 1 << 5,
+    namespaceAttributeChanged = 1 << 6,
+    firmwareActivated = 1 << 7,
+    controllerStatusChange = 1 << 8,
+    compositeTemperatureChange = 1 << 9,
+    percentageUsed = 1 << 10,
+    availableSpare = 1 << 11,
+    criticalWarning = 1 << 12,
+};
+
+static constexpr uint16_t changeMask = 0x1FF0;
+
+static inline uint16_t
+    getChanges(const ResponseData::CompositeControllerStatus& ccs)
+{
+    uint16_t value = 0;
+    std::memcpy(&value, &ccs, sizeof(value));
+    return static_cast<uint16_t>(value & changeMask);
+}
+
+/**
+ * @brief Check the SMART warnings for a critical warning. The field is the
+ * one's complement of the Critical Warning of the SMART / Health log.
+ *
+ */
+static inline bool hasCriticalWarning(uint8_t smartWarnings)
+{
+    static constexpr uint8_t warningMask = 0x1F;
+    return (~smartWarnings & warningMask) != 0;
+}
+
 static inline int8_t convertToCelsius(uint8_t tempByte)
 {
     switch (tempByte)
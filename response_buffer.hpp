@@ -0,0 +1,185 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace nvmemi
+{
+/**
+ * @brief Read only view of a range of bytes. Does not own the bytes.
+ *
+ */
+class ByteView
+{
+  public:
+    ByteView() = default;
+    ByteView(const uint8_t* viewData, size_t viewSize) :
+        ptr(viewData), len(viewSize)
+    {
+    }
+    const uint8_t* data() const noexcept
+    {
+        return ptr;
+    }
+    size_t size() const noexcept
+    {
+        return len;
+    }
+    bool empty() const noexcept
+    {
+        return len == 0;
+    }
+    const uint8_t* begin() const noexcept
+    {
+        return ptr;
+    }
+    const uint8_t* end() const noexcept
+    {
+        return ptr + len;
+    }
+    uint8_t operator[](size_t idx) const noexcept
+    {
+        return ptr[idx];
+    }
+    /**
+     * @brief Get a part of the view
+     *
+     * @throws std::out_of_range if the part is not within the view
+     */
+    ByteView subview(size_t offset, size_t count) const
+    {
+        if (offset > len || count > len - offset)
+        {
+            throw std::out_of_range("Subview out of range");
+        }
+        return ByteView(ptr + offset, count);
+    }
+
+  private:
+    const uint8_t* ptr = nullptr;
+    size_t len = 0;
+};
+
+/**
+ * @brief Part of a received response, usually its payload. Copies share the
+ * response bytes, which stay valid as long as any copy or view obtained
+ * from it is in use.
+ *
+ */
+class ResponseBuffer
+{
+  public:
+    ResponseBuffer() = default;
+    /**
+     * @brief Take over a response without copying it
+     *
+     * @param response Received response
+     * @param payload View of the payload within the response
+     */
+    ResponseBuffer(std::vector<uint8_t>&& response, ByteView payload) :
+        bytes(std::make_shared<const std::vector<uint8_t>>(
+            std::move(response))),
+        length(payload.size())
+    {
+        // Moving a vector keeps its storage, so the view is still valid
+        auto start = reinterpret_cast<uintptr_t>(bytes->data());
+        auto payloadStart = reinterpret_cast<uintptr_t>(payload.data());
+        if (payloadStart < start ||
+            payloadStart + length > start + bytes->size())
+        {
+            throw std::out_of_range("Payload is not within the response");
+        }
+        offset = payloadStart - start;
+    }
+    ByteView view() const noexcept
+    {
+        if (!bytes)
+        {
+            return ByteView();
+        }
+        return ByteView(bytes->data() + offset, length);
+    }
+    const uint8_t* data() const noexcept
+    {
+        return view().data();
+    }
+    size_t size() const noexcept
+    {
+        return length;
+    }
+    uint8_t operator[](size_t idx) const noexcept
+    {
+        return data()[idx];
+    }
+    const uint8_t* begin() const noexcept
+    {
+        return view().begin();
+    }
+    const uint8_t* end() const noexcept
+    {
+        return view().end();
+    }
+
+  private:
+    std::shared_ptr<const std::vector<uint8_t>> bytes;
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+/**
+ * @brief Packed structure decoded in place from a response
+ *
+ */
+template <typename T>
+class ResponseStruct
+{
+  public:
+    static_assert(alignof(T) == 1, "Response structures must be packed");
+
+    ResponseStruct() = default;
+    /**
+     * @throws std::length_error if the buffer is smaller than the structure
+     */
+    explicit ResponseStruct(ResponseBuffer responseBuffer) :
+        buffer(std::move(responseBuffer))
+    {
+        if (buffer.size() < sizeof(T))
+        {
+            throw std::length_error("Response too short for the structure");
+        }
+    }
+    explicit operator bool() const noexcept
+    {
+        return buffer.size() >= sizeof(T);
+    }
+    const T* operator->() const noexcept
+    {
+        return reinterpret_cast<const T*>(buffer.data());
+    }
+    const T& operator*() const noexcept
+    {
+        return *operator->();
+    }
+
+  private:
+    ResponseBuffer buffer;
+};
+} // namespace nvmemi
@@ -0,0 +1,285 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "retry_policy.hpp"
+
+#include "endpoint_registry.hpp"
+#include "metrics.hpp"
+#include "protocol/mi/subsystem_hs_poll.hpp"
+#include "protocol/mi_msg.hpp"
+#include "protocol/nvme_msg.hpp"
+#include "single_flight.hpp"
+
+#include <algorithm>
+#include <boost/asio/steady_timer.hpp>
+#include <cstring>
+#include <memory>
+
+namespace nvmemi::retry
+{
+static constexpr size_t classCount = static_cast<size_t>(ErrorClass::count);
+static EndpointRegistry<Budget> endpoints{};
+static size_t budgetCapacity = 10;
+
+// Indexed by ErrorClass. More Processing Required is not resent: the final
+// response may still come for the command slot and would be matched to the
+// resent request.
+static constexpr std::array<Policy, classCount> policies = {{
+    {Action::none, 0, std::chrono::milliseconds(0), false},
+    {Action::delayed, 1, std::chrono::milliseconds(100), true},
+    {Action::delayed, 1, std::chrono::milliseconds(200), true},
+    {Action::immediate, 2, std::chrono::milliseconds(0), true},
+    {Action::none, 0, std::chrono::milliseconds(0), false},
+    {Action::delayed, 1, std::chrono::milliseconds(100), false},
+    {Action::none, 0, std::chrono::milliseconds(0), false},
+    {Action::delayed, 2, std::chrono::milliseconds(100), false},
+    {Action::none, 0, std::chrono::milliseconds(0), false},
+}};
+
+ErrorClass classify(const boost::system::error_code& ec,
+                    const std::vector<uint8_t>& response) noexcept
+{
+    using nvmemi::metrics::Outcome;
+    using nvmemi::protocol::CommonHeader;
+    using nvmemi::protocol::NVMeMessageTye;
+    switch (nvmemi::metrics::classifyResponse(ec, response))
+    {
+        case Outcome::timeout:
+            return ErrorClass::timeout;
+        case Outcome::crcError:
+            return ErrorClass::crcError;
+        case Outcome::transportError:
+            return ErrorClass::transportError;
+        default:
+            break;
+    }
+    static constexpr size_t statusOffset = sizeof(CommonHeader);
+    if (response.size() <= statusOffset)
+    {
+        return ErrorClass::none;
+    }
+    static constexpr uint8_t miMoreProcessingRequired = 0x01;
+    static constexpr uint8_t miInternalError = 0x02;
+    uint8_t status = response[statusOffset];
+    if (status == miMoreProcessingRequired)
+    {
+        return ErrorClass::moreProcessingRequired;
+    }
+    if (status == miInternalError)
+    {
+        return ErrorClass::miInternalError;
+    }
+    if (status != 0)
+    {
+        return ErrorClass::miRejected;
+    }
+    auto header = reinterpret_cast<const CommonHeader*>(response.data());
+    // Status, reserved, completion queue dwords 0 and 1 come first
+    static constexpr size_t cqDword3Offset = statusOffset + 12;
+    if (header->nvmeMiMsgType != NVMeMessageTye::adminCommand ||
+        response.size() < cqDword3Offset + sizeof(uint32_t))
+    {
+        return ErrorClass::none;
+    }
+    uint32_t cqDword3 = 0;
+    std::memcpy(&cqDword3, response.data() + cqDword3Offset,
+                sizeof(cqDword3));
+    cqDword3 = le32toh(cqDword3);
+    auto statusCode = static_cast<uint8_t>((cqDword3 >> 17) & 0xFF);
+    auto statusType = static_cast<uint8_t>((cqDword3 >> 25) & 0x07);
+    bool doNotRetry = (cqDword3 & (1u << 31)) != 0;
+    if (statusCode == 0 && statusType == 0)
+    {
+        return ErrorClass::none;
+    }
+    static constexpr uint8_t genericStatusType = 0x00;
+    static constexpr uint8_t internalError = 0x06;
+    static constexpr uint8_t commandInterrupted = 0x21;
+    static constexpr uint8_t namespaceNotReady = 0x82;
+    if (!doNotRetry && statusType == genericStatusType &&
+        (statusCode == internalError || statusCode == commandInterrupted ||
+         statusCode == namespaceNotReady))
+    {
+        return ErrorClass::adminTransient;
+    }
+    return ErrorClass::adminRejected;
+}
+
+const Policy& getPolicy(ErrorClass errorClass) noexcept
+{
+    if (errorClass >= ErrorClass::count)
+    {
+        errorClass = ErrorClass::none;
+    }
+    return policies[static_cast<size_t>(errorClass)];
+}
+
+const char* getErrorClassName(ErrorClass errorClass) noexcept
+{
+    switch (errorClass)
+    {
+        case ErrorClass::timeout:
+            return "timeout";
+        case ErrorClass::transportError:
+            return "transport_error";
+        case ErrorClass::crcError:
+            return "crc_error";
+        case ErrorClass::moreProcessingRequired:
+            return "more_processing_required";
+        case ErrorClass::miInternalError:
+            return "mi_internal_error";
+        case ErrorClass::miRejected:
+            return "mi_rejected";
+        case ErrorClass::adminTransient:
+            return "admin_transient";
+        case ErrorClass::adminRejected:
+            return "admin_rejected";
+        default:
+            return "none";
+    }
+}
+
+Budget::Budget(size_t budget) : capacity(budget), tokens(budget)
+{
+}
+
+bool Budget::consume(std::chrono::steady_clock::time_point now) noexcept
+{
+    if (tokens == capacity)
+    {
+        lastRefill = now;
+    }
+    else if (now > lastRefill)
+    {
+        auto refills = static_cast<size_t>((now - lastRefill) / refillInterval);
+        tokens = std::min(capacity, tokens + refills);
+        lastRefill += refillInterval * refills;
+    }
+    if (tokens == 0)
+    {
+        exhausted++;
+        return false;
+    }
+    tokens--;
+    return true;
+}
+
+void Budget::recordRetry(ErrorClass errorClass) noexcept
+{
+    if (errorClass < ErrorClass::count)
+    {
+        retries[static_cast<size_t>(errorClass)]++;
+    }
+}
+
+uint64_t Budget::getRetries(ErrorClass errorClass) const noexcept
+{
+    if (errorClass >= ErrorClass::count)
+    {
+        return 0;
+    }
+    return retries[static_cast<size_t>(errorClass)];
+}
+
+uint64_t Budget::getExhausted() const noexcept
+{
+    return exhausted;
+}
+
+void setBudgetCapacity(size_t capacity)
+{
+    budgetCapacity = capacity;
+}
+
+Budget& registerEndpoint(mctpw::eid_t eid, const void* owner)
+{
+    return endpoints.add(eid, owner, budgetCapacity);
+}
+
+void unregisterEndpoint(mctpw::eid_t eid, const void* owner)
+{
+    endpoints.remove(eid, owner);
+}
+
+Budget* getEndpoint(mctpw::eid_t eid)
+{
+    return endpoints.get(eid);
+}
+
+bool isIdempotent(const std::vector<uint8_t>& request) noexcept
+{
+    using nvmemi::protocol::CommonHeader;
+    using nvmemi::protocol::MiMessageHeader;
+    using nvmemi::protocol::MiOpCode;
+    using nvmemi::protocol::NVMeMessageTye;
+    if (nvmemi::singleflight::isShareable(request))
+    {
+        return true;
+    }
+    if (request.size() < sizeof(CommonHeader) + sizeof(MiMessageHeader))
+    {
+        return false;
+    }
+    auto header = reinterpret_cast<const CommonHeader*>(request.data());
+    auto miHeader = reinterpret_cast<const MiMessageHeader*>(
+        request.data() + sizeof(CommonHeader));
+    if (header->nvmeMiMsgType != NVMeMessageTye::miCommand ||
+        miHeader->opCode != MiOpCode::subsystemHealthStatusPoll)
+    {
+        return false;
+    }
+    // Clearing the status bits loses the changes reported in the response
+    nvmemi::protocol::subsystemhs::RequestDWord1 dword1{};
+    std::memcpy(&dword1, &miHeader->dword1, sizeof(dword1));
+    return !dword1.clearStatus;
+}
+
+Result run(mctpw::eid_t eid, boost::asio::yield_context yield,
+           const Transaction& transaction, bool readOnly)
+{
+    std::array<uint8_t, classCount> retries{};
+    while (true)
+    {
+        Result result = transaction(yield);
+        ErrorClass errorClass = classify(result.first, result.second);
+        const Policy& policy = getPolicy(errorClass);
+        auto& classRetries = retries[static_cast<size_t>(errorClass)];
+        if (policy.action == Action::none ||
+            classRetries >= policy.maxRetries ||
+            (policy.readOnlyOnly && !readOnly))
+        {
+            return result;
+        }
+        // Looked up on every retry since the drive can be removed meanwhile
+        Budget* budget = getEndpoint(eid);
+        if (budget == nullptr ||
+            !budget->consume(std::chrono::steady_clock::now()))
+        {
+            return result;
+        }
+        budget->recordRetry(errorClass);
+        classRetries++;
+        if (policy.action == Action::delayed)
+        {
+            boost::asio::steady_timer timer(
+                boost::asio::get_associated_executor(yield));
+            timer.expires_after(policy.delay);
+            boost::system::error_code ec;
+            timer.async_wait(yield[ec]);
+        }
+    }
+}
+} // namespace nvmemi::retry
@@ -0,0 +1,167 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <array>
+#include <boost/asio/spawn.hpp>
+#include <boost/system/error_code.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mctp_wrapper.hpp>
+#include <utility>
+#include <vector>
+
+namespace nvmemi::retry
+{
+using Result = std::pair<boost::system::error_code, std::vector<uint8_t>>;
+using Transaction = std::function<Result(boost::asio::yield_context)>;
+
+/**
+ * @brief Kind of failure of a transaction
+ *
+ */
+enum class ErrorClass : uint8_t
+{
+    /** @brief Success, or a response the caller has to handle */
+    none,
+    timeout,
+    transportError,
+    crcError,
+    /**
+     * @brief NVMe-MI status More Processing Required. This is an interim
+     * response, the command is still being processed.
+     */
+    moreProcessingRequired,
+    /** @brief NVMe-MI status Internal Error */
+    miInternalError,
+    /** @brief Any other NVMe-MI error status */
+    miRejected,
+    /** @brief Admin status the drive allows to retry and that can clear */
+    adminTransient,
+    /** @brief Any other admin error status */
+    adminRejected,
+    count
+};
+
+enum class Action : uint8_t
+{
+    none,
+    immediate,
+    delayed
+};
+
+struct Policy
+{
+    Action action;
+    uint8_t maxRetries;
+    std::chrono::milliseconds delay;
+    /**
+     * @brief The drive may have executed the command, so only requests
+     * without side effects are retried
+     */
+    bool readOnlyOnly;
+};
+
+/**
+ * @brief Get the error class of a transaction from the transport error code
+ * and the response
+ *
+ */
+ErrorClass classify(const boost::system::error_code& ec,
+                    const std::vector<uint8_t>& response) noexcept;
+const Policy& getPolicy(ErrorClass errorClass) noexcept;
+const char* getErrorClassName(ErrorClass errorClass) noexcept;
+
+/**
+ * @brief Retries left for an endpoint. Up to the capacity is available at
+ * once, then one retry every refillInterval, so that a drive that stopped
+ * responding does not multiply the bus traffic.
+ *
+ */
+class Budget
+{
+  public:
+    static constexpr std::chrono::seconds refillInterval{5};
+
+    explicit Budget(size_t capacity);
+    /**
+     * @brief Take one retry from the budget
+     *
+     * @return true if the retry can be made
+     */
+    bool consume(std::chrono::steady_clock::time_point now) noexcept;
+    void recordRetry(ErrorClass errorClass) noexcept;
+    uint64_t getRetries(ErrorClass errorClass) const noexcept;
+    uint64_t getExhausted() const noexcept;
+
+  private:
+    size_t capacity;
+    size_t tokens;
+    std::chrono::steady_clock::time_point lastRefill{};
+    std::array<uint64_t, static_cast<size_t>(ErrorClass::count)> retries{};
+    uint64_t exhausted = 0;
+};
+
+/**
+ * @brief Set the retry budget capacity of the endpoints registered afterwards
+ *
+ * @param capacity Retries available at once, 0 disables the retries
+ */
+void setBudgetCapacity(size_t capacity);
+
+/**
+ * @brief Create the retry budget of an endpoint
+ *
+ * @param eid MCTP EID
+ * @param owner Object the endpoint is registered for. An endpoint registered
+ * for an other owner gets a full budget.
+ */
+Budget& registerEndpoint(mctpw::eid_t eid, const void* owner = nullptr);
+/**
+ * @brief Free the entry of an endpoint
+ *
+ * @param eid MCTP EID
+ * @param owner Owner given at registration. The entry is kept if the endpoint
+ * was registered for an other owner since. nullptr frees it anyway.
+ */
+void unregisterEndpoint(mctpw::eid_t eid, const void* owner = nullptr);
+Budget* getEndpoint(mctpw::eid_t eid);
+
+/**
+ * @brief Check if a request can be sent again after a lost or corrupted
+ * response. Requests that can share a response in flight qualify, and so
+ * does the Subsystem Health Status Poll unless it clears the status bits.
+ *
+ * @param request Request bytes including the NVMe-MI header
+ */
+bool isIdempotent(const std::vector<uint8_t>& request) noexcept;
+
+/**
+ * @brief Run a transaction and repeat it while the policy of its error class
+ * allows and the budget of the endpoint has retries left. Endpoints that are
+ * not registered are not retried.
+ *
+ * @param eid MCTP EID the transaction is sent to
+ * @param yield yield_context of the calling coroutine
+ * @param transaction Sends the request and receives the response
+ * @param readOnly true if the request has no side effects on the drive and
+ * can be sent again after a lost or corrupted response
+ * @return Result Result of the last attempt
+ */
+Result run(mctpw::eid_t eid, boost::asio::yield_context yield,
+           const Transaction& transaction, bool readOnly);
+} // namespace nvmemi::retry
@@ -0,0 +1,182 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "rtt_estimator.hpp"
+
+#include "endpoint_registry.hpp"
+
+#include <algorithm>
+#include <array>
+#include <memory>
+
+using nvmemi::RttEstimator;
+
+// Gains and variance multiplier from RFC 6298
+static constexpr int64_t srttGainShift = 3;   // alpha = 1/8
+static constexpr int64_t rttvarGainShift = 2; // beta = 1/4
+static constexpr int64_t rttvarMultiplier = 4;
+/**
+ * @brief Clock granularity G of RFC 6298. Keeps a margin over SRTT once the
+ * variation of steady response times decays to nothing, so that normal
+ * jitter does not time out.
+ */
+static constexpr std::chrono::microseconds granularity{10000};
+
+RttEstimator::RttEstimator(std::chrono::milliseconds initial,
+                           std::chrono::milliseconds floorVal,
+                           std::chrono::milliseconds ceilingVal) :
+    floor(floorVal),
+    ceiling(ceilingVal), timeout(initial)
+{
+    timeout = clamp(timeout);
+}
+
+void RttEstimator::addSample(std::chrono::microseconds rtt) noexcept
+{
+    if (rtt.count() < 0)
+    {
+        return;
+    }
+    if (!hasSample)
+    {
+        srtt = rtt;
+        rttvar = rtt / 2;
+        hasSample = true;
+    }
+    else
+    {
+        auto delta = srtt - rtt;
+        if (delta.count() < 0)
+        {
+            delta = -delta;
+        }
+        rttvar += (delta - rttvar) / (1 << rttvarGainShift);
+        srtt += (rtt - srtt) / (1 << srttGainShift);
+    }
+    timeout = clamp(srtt + std::max<std::chrono::microseconds>(
+                               granularity, rttvarMultiplier * rttvar));
+}
+
+void RttEstimator::onTimeout() noexcept
+{
+    timeout = clamp(timeout * 2);
+}
+
+std::chrono::milliseconds RttEstimator::getTimeout() const noexcept
+{
+    // Round up so that the timeout never gets below the estimate
+    return std::chrono::ceil<std::chrono::milliseconds>(timeout);
+}
+
+std::chrono::microseconds RttEstimator::getSmoothedRtt() const noexcept
+{
+    return srtt;
+}
+
+std::chrono::microseconds RttEstimator::getRttVariation() const noexcept
+{
+    return rttvar;
+}
+
+std::chrono::microseconds
+    RttEstimator::clamp(std::chrono::microseconds value) const noexcept
+{
+    return std::clamp(value, floor, ceiling);
+}
+
+namespace nvmemi::timeouts
+{
+using namespace std::chrono_literals;
+static constexpr size_t classCount = static_cast<size_t>(ResponseClass::count);
+static constexpr std::array<Limits, classCount> limits = {
+    Limits{100ms, 20ms, 1000ms},   // healthPoll
+    Limits{600ms, 50ms, 3000ms},   // normal
+    Limits{3000ms, 200ms, 6000ms}, // longResponse
+    Limits{3000ms, 200ms, 6000ms}, // logPage
+};
+
+using EndpointEstimators = std::array<RttEstimator, classCount>;
+static EndpointRegistry<EndpointEstimators> endpoints{};
+
+const Limits& getLimits(ResponseClass responseClass) noexcept
+{
+    if (responseClass >= ResponseClass::count)
+    {
+        responseClass = ResponseClass::normal;
+    }
+    return limits[static_cast<size_t>(responseClass)];
+}
+
+const char* getResponseClassName(ResponseClass responseClass) noexcept
+{
+    switch (responseClass)
+    {
+        case ResponseClass::healthPoll:
+            return "health_poll";
+        case ResponseClass::normal:
+            return "normal";
+        case ResponseClass::longResponse:
+            return "long_response";
+        case ResponseClass::logPage:
+            return "log_page";
+        default:
+            return "unknown";
+    }
+}
+
+static RttEstimator createEstimator(ResponseClass responseClass)
+{
+    const Limits& classLimits = getLimits(responseClass);
+    return RttEstimator(classLimits.initial, classLimits.floor,
+                        classLimits.ceiling);
+}
+
+void registerEndpoint(mctpw::eid_t eid, const void* owner)
+{
+    endpoints.add(eid, owner,
+                  EndpointEstimators{
+                      createEstimator(ResponseClass::healthPoll),
+                      createEstimator(ResponseClass::normal),
+                      createEstimator(ResponseClass::longResponse),
+                      createEstimator(ResponseClass::logPage)});
+}
+
+void unregisterEndpoint(mctpw::eid_t eid, const void* owner)
+{
+    endpoints.remove(eid, owner);
+}
+
+RttEstimator* getEstimator(mctpw::eid_t eid,
+                           ResponseClass responseClass) noexcept
+{
+    auto estimators = endpoints.get(eid);
+    if (!estimators || responseClass >= ResponseClass::count)
+    {
+        return nullptr;
+    }
+    return &(*estimators)[static_cast<size_t>(responseClass)];
+}
+
+std::chrono::milliseconds getTimeout(mctpw::eid_t eid,
+                                     ResponseClass responseClass) noexcept
+{
+    if (auto estimator = getEstimator(eid, responseClass))
+    {
+        return estimator->getTimeout();
+    }
+    return getLimits(responseClass).initial;
+}
+} // namespace nvmemi::timeouts
@@ -0,0 +1,129 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mctp_wrapper.hpp>
+
+namespace nvmemi
+{
+/**
+ * @brief Estimates the response timeout from observed round trip times.
+ * Follows the SRTT/RTTVAR computation of RFC 6298, SRTT + max(G, 4 * RTTVAR),
+ * with the result clamped between a floor and a ceiling.
+ *
+ */
+class RttEstimator
+{
+  public:
+    /**
+     * @brief Construct a new RttEstimator object
+     *
+     * @param initial Timeout to use until the first sample is available
+     * @param floor Minimum timeout
+     * @param ceiling Maximum timeout
+     */
+    RttEstimator(std::chrono::milliseconds initial,
+                 std::chrono::milliseconds floor,
+                 std::chrono::milliseconds ceiling);
+    /**
+     * @brief Update the estimate with the round trip time of a response
+     *
+     * @param rtt Time from sending the request to receiving the response
+     */
+    void addSample(std::chrono::microseconds rtt) noexcept;
+    /**
+     * @brief Back off the timeout after a request timed out. The timeout is
+     * doubled until the next response is received.
+     *
+     */
+    void onTimeout() noexcept;
+    std::chrono::milliseconds getTimeout() const noexcept;
+    std::chrono::microseconds getSmoothedRtt() const noexcept;
+    std::chrono::microseconds getRttVariation() const noexcept;
+
+  private:
+    std::chrono::microseconds clamp(std::chrono::microseconds value) const
+        noexcept;
+
+    std::chrono::microseconds floor;
+    std::chrono::microseconds ceiling;
+    std::chrono::microseconds timeout;
+    std::chrono::microseconds srtt{0};
+    std::chrono::microseconds rttvar{0};
+    bool hasSample = false;
+};
+
+namespace timeouts
+{
+/**
+ * @brief Groups of commands with comparable response times. Each group has
+ * its own estimator per endpoint.
+ *
+ */
+enum class ResponseClass : uint8_t
+{
+    healthPoll,
+    normal,
+    longResponse,
+    logPage,
+    count
+};
+
+struct Limits
+{
+    std::chrono::milliseconds initial;
+    std::chrono::milliseconds floor;
+    std::chrono::milliseconds ceiling;
+};
+
+const Limits& getLimits(ResponseClass responseClass) noexcept;
+const char* getResponseClassName(ResponseClass responseClass) noexcept;
+
+/**
+ * @brief Create the estimators of an endpoint
+ *
+ * @param eid MCTP EID
+ * @param owner Object the endpoint is registered for. An endpoint registered
+ * for an other owner gets new estimators.
+ */
+void registerEndpoint(mctpw::eid_t eid, const void* owner = nullptr);
+/**
+ * @brief Free the entry of an endpoint
+ *
+ * @param eid MCTP EID
+ * @param owner Owner given at registration. The entry is kept if the endpoint
+ * was registered for an other owner since. nullptr frees it anyway.
+ */
+void unregisterEndpoint(mctpw::eid_t eid, const void* owner = nullptr);
+/**
+ * @brief Get the estimator for an endpoint and response class
+ *
+ * @return RttEstimator* nullptr if the endpoint is not registered
+ */
+RttEstimator* getEstimator(mctpw::eid_t eid,
+                           ResponseClass responseClass) noexcept;
+/**
+ * @brief Get the timeout to be used for the next request
+ *
+ * @return std::chrono::milliseconds Estimated timeout or the initial value if
+ * the endpoint is not registered
+ */
+std::chrono::milliseconds getTimeout(mctpw::eid_t eid,
+                                     ResponseClass responseClass) noexcept;
+} // namespace timeouts
+} // namespace nvmemi
@@ -0,0 +1,163 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "single_flight.hpp"
+
+#include "protocol/admin/admin_cmd.hpp"
+#include "protocol/admin/get_log_page.hpp"
+#include "protocol/mi_msg.hpp"
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/post.hpp>
+#include <cstddef>
+#include <exception>
+#include <map>
+#include <memory>
+#include <optional>
+
+namespace nvmemi::singleflight
+{
+/** @brief Transaction in flight and the callers waiting for its result */
+struct Flight
+{
+    std::optional<Result> result;
+    std::exception_ptr error;
+    std::vector<std::function<void()>> waiters;
+};
+
+/** @brief Flights by EID followed by the request bytes without the CRC */
+static std::map<std::vector<uint8_t>, std::shared_ptr<Flight>> flights{};
+static uint64_t sharedCount = 0;
+
+bool isShareable(const std::vector<uint8_t>& request) noexcept
+{
+    using nvmemi::protocol::AdminCommandHeader;
+    using nvmemi::protocol::AdminOpCode;
+    using nvmemi::protocol::CommonHeader;
+    using nvmemi::protocol::MiOpCode;
+    using nvmemi::protocol::NVMeMessageTye;
+    if (request.size() <= sizeof(CommonHeader))
+    {
+        return false;
+    }
+    auto header = reinterpret_cast<const CommonHeader*>(request.data());
+    uint8_t opCode = request[sizeof(CommonHeader)];
+    if (header->nvmeMiMsgType == NVMeMessageTye::miCommand)
+    {
+        switch (static_cast<MiOpCode>(opCode))
+        {
+            case MiOpCode::readDataStructure:
+            case MiOpCode::configGet:
+            case MiOpCode::vpdRead:
+                return true;
+            default:
+                return false;
+        }
+    }
+    if (header->nvmeMiMsgType != NVMeMessageTye::adminCommand)
+    {
+        return false;
+    }
+    switch (static_cast<AdminOpCode>(opCode))
+    {
+        case AdminOpCode::identify:
+        case AdminOpCode::getFeatures:
+            return true;
+        case AdminOpCode::getLogPage: {
+            // Without RAE the read clears asynchronous events of the log page
+            static constexpr size_t dword10Offset =
+                sizeof(CommonHeader) + offsetof(AdminCommandHeader, sqdword10);
+            if (request.size() <
+                dword10Offset + sizeof(nvmemi::protocol::getlog::Request))
+            {
+                return false;
+            }
+            auto logRequest =
+                reinterpret_cast<const nvmemi::protocol::getlog::Request*>(
+                    request.data() + dword10Offset);
+            return logRequest->retainAsyncEvents;
+        }
+        default:
+            return false;
+    }
+}
+
+Result run(mctpw::eid_t eid, const std::vector<uint8_t>& request,
+           boost::asio::yield_context yield, const Transaction& transaction)
+{
+    static constexpr size_t crcSize = sizeof(uint32_t);
+    if (!isShareable(request) || request.size() < crcSize)
+    {
+        return transaction(yield);
+    }
+    std::vector<uint8_t> key;
+    key.reserve(request.size() + 1 - crcSize);
+    key.emplace_back(eid);
+    key.insert(key.end(), request.begin(), request.end() - crcSize);
+
+    if (auto it = flights.find(key); it != flights.end())
+    {
+        std::shared_ptr<Flight> flight = it->second;
+        sharedCount++;
+        boost::asio::async_initiate<boost::asio::yield_context,
+                                    void(boost::system::error_code)>(
+            [&flight](auto handler) {
+                auto shared =
+                    std::make_shared<decltype(handler)>(std::move(handler));
+                flight->waiters.emplace_back([shared]() {
+                    auto executor =
+                        boost::asio::get_associated_executor(*shared);
+                    boost::asio::post(executor, [shared]() {
+                        (*shared)(boost::system::error_code());
+                    });
+                });
+            },
+            yield);
+        if (flight->error)
+        {
+            std::rethrow_exception(flight->error);
+        }
+        return *flight->result;
+    }
+
+    auto flight = std::make_shared<Flight>();
+    flights.emplace(key, flight);
+    try
+    {
+        flight->result = transaction(yield);
+    }
+    catch (...)
+    {
+        flight->error = std::current_exception();
+    }
+    // Requests made from now on run a new transaction
+    flights.erase(key);
+    for (auto& resume : flight->waiters)
+    {
+        resume();
+    }
+    if (flight->error)
+    {
+        std::rethrow_exception(flight->error);
+    }
+    return *flight->result;
+}
+
+uint64_t getSharedCount()
+{
+    return sharedCount;
+}
+} // namespace nvmemi::singleflight
@@ -0,0 +1,62 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <boost/asio/spawn.hpp>
+#include <boost/system/error_code.hpp>
+#include <cstdint>
+#include <functional>
+#include <mctp_wrapper.hpp>
+#include <utility>
+#include <vector>
+
+namespace nvmemi::singleflight
+{
+using Result = std::pair<boost::system::error_code, std::vector<uint8_t>>;
+using Transaction = std::function<Result(boost::asio::yield_context)>;
+
+/**
+ * @brief Check if a request only reads from the drive, so that identical
+ * requests in flight can share one response. Identify, Get Features, Read
+ * NVMe-MI Data Structure, Configuration Get, VPD Read and Get Log Page with
+ * Retain Asynchronous Event set qualify.
+ *
+ * @param request Request bytes including the NVMe-MI header
+ */
+bool isShareable(const std::vector<uint8_t>& request) noexcept;
+
+/**
+ * @brief Run the transaction for a request, or wait for the transaction of an
+ * identical request to the same EID that is already in flight and get a copy
+ * of its result. Requests that are not shareable always run their own
+ * transaction. Exceptions of the transaction are rethrown in every caller.
+ *
+ * @param eid MCTP EID the request is sent to
+ * @param request Request bytes including the NVMe-MI header and CRC
+ * @param yield yield_context of the calling coroutine
+ * @param transaction Sends the request and receives the response
+ * @return Result Transport error and response
+ */
+Result run(mctpw::eid_t eid, const std::vector<uint8_t>& request,
+           boost::asio::yield_context yield, const Transaction& transaction);
+
+/**
+ * @brief Get the number of requests served by a transaction of another
+ * request
+ *
+ */
+uint64_t getSharedCount();
+} // namespace nvmemi::singleflight
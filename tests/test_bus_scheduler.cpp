@@ -0,0 +1,143 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../bus_scheduler.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <map>
+
+#include <gtest/gtest.h>
+
+using nvmemi::scheduler::Priority;
+
+class BusSchedulerTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        nvmemi::scheduler::setMaxOutstanding(1);
+        registerEndpoints();
+    }
+    void registerEndpoints()
+    {
+        nvmemi::scheduler::registerEndpoint(10, "busA");
+        nvmemi::scheduler::registerEndpoint(11, "busA");
+        nvmemi::scheduler::registerEndpoint(20, "busB");
+    }
+    void TearDown() override
+    {
+        for (mctpw::eid_t eid : {10, 11, 20})
+        {
+            nvmemi::scheduler::unregisterEndpoint(eid);
+        }
+    }
+    void transaction(const std::string& tag, mctpw::eid_t eid,
+                     Priority priority, std::chrono::milliseconds delay)
+    {
+        boost::asio::spawn(ioContext, [=](boost::asio::yield_context yield) {
+            boost::asio::steady_timer timer(ioContext);
+            timer.expires_after(delay);
+            timer.async_wait(yield);
+            auto grant = nvmemi::scheduler::acquire(eid, priority, yield);
+            order.emplace_back(tag);
+            commandSlots[tag] = grant.endpoint.getIndex();
+            timer.expires_after(std::chrono::milliseconds(20));
+            timer.async_wait(yield);
+        });
+    }
+    boost::asio::io_context ioContext;
+    std::vector<std::string> order;
+    std::map<std::string, size_t> commandSlots;
+};
+
+TEST_F(BusSchedulerTest, BusPriority)
+{
+    using namespace std::chrono_literals;
+    transaction("first", 10, Priority::bulk, 0ms);
+    transaction("bulk", 10, Priority::bulk, 5ms);
+    transaction("health", 11, Priority::health, 10ms);
+    // Other bus is not blocked by busA
+    transaction("otherBus", 20, Priority::bulk, 5ms);
+    ioContext.run();
+    std::vector<std::string> expected{"first", "otherBus", "health", "bulk"};
+    EXPECT_EQ(order, expected);
+}
+
+TEST_F(BusSchedulerTest, EndpointPriority)
+{
+    using namespace std::chrono_literals;
+    transaction("first", 20, Priority::inventory, 0ms);
+    transaction("second", 20, Priority::inventory, 1ms);
+    transaction("bulk", 20, Priority::bulk, 2ms);
+    transaction("inventory", 20, Priority::inventory, 4ms);
+    transaction("health", 20, Priority::health, 6ms);
+    ioContext.run();
+    std::vector<std::string> expected{"first", "second", "health",
+                                      "inventory", "bulk"};
+    EXPECT_EQ(order, expected);
+}
+
+TEST_F(BusSchedulerTest, CommandSlots)
+{
+    using namespace std::chrono_literals;
+    TearDown();
+    nvmemi::scheduler::setMaxOutstanding(2);
+    registerEndpoints();
+    // Health poll is not blocked by the bulk transfer to the same drive
+    transaction("bulk", 20, Priority::bulk, 0ms);
+    transaction("bulk2", 20, Priority::bulk, 2ms);
+    transaction("health", 20, Priority::health, 4ms);
+    ioContext.run();
+    std::vector<std::string> expected{"bulk", "health", "bulk2"};
+    EXPECT_EQ(order, expected);
+    EXPECT_EQ(commandSlots["bulk"], 0);
+    EXPECT_EQ(commandSlots["bulk2"], 0);
+    EXPECT_EQ(commandSlots["health"], 1);
+}
+
+TEST_F(BusSchedulerTest, Topology)
+{
+    auto buses = nvmemi::scheduler::getBuses();
+    ASSERT_EQ(buses.size(), 2);
+    for (const auto& bus : buses)
+    {
+        EXPECT_EQ(bus.endpoints.size(), bus.name == "busA" ? 2 : 1);
+        EXPECT_EQ(bus.outstanding, 0);
+    }
+    nvmemi::scheduler::unregisterEndpoint(20);
+    EXPECT_EQ(nvmemi::scheduler::getBuses().size(), 1);
+
+    // Unregistered endpoints are not scheduled
+    bool done = false;
+    boost::asio::spawn(ioContext, [&](boost::asio::yield_context yield) {
+        auto slot = nvmemi::scheduler::acquire(20, Priority::bulk, yield);
+        done = true;
+    });
+    ioContext.run();
+    EXPECT_TRUE(done);
+}
+
+TEST_F(BusSchedulerTest, Owner)
+{
+    int oldDrive = 0;
+    int newDrive = 0;
+    nvmemi::scheduler::registerEndpoint(30, "busC", &oldDrive);
+    nvmemi::scheduler::registerEndpoint(30, "busC", &newDrive);
+    nvmemi::scheduler::unregisterEndpoint(30, &oldDrive);
+    EXPECT_EQ(nvmemi::scheduler::getBuses().size(), 3);
+    nvmemi::scheduler::unregisterEndpoint(30, &newDrive);
+    EXPECT_EQ(nvmemi::scheduler::getBuses().size(), 2);
+}
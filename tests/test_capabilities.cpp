@@ -0,0 +1,119 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../capabilities.hpp"
+
+#include <gtest/gtest.h>
+
+using nvmemi::capabilities::Capabilities;
+using nvmemi::capabilities::Kind;
+using nvmemi::capabilities::Support;
+
+TEST(Capabilities, UnsupportedIsSticky)
+{
+    Capabilities capabilities;
+    EXPECT_EQ(capabilities.get(Kind::feature, 0x04), Support::unknown);
+    capabilities.set(Kind::feature, 0x04, Support::unsupported);
+    capabilities.set(Kind::feature, 0x04, Support::supported);
+    EXPECT_TRUE(capabilities.isUnsupported(Kind::feature, 0x04));
+    // Same identifier of another kind is tracked separately
+    EXPECT_EQ(capabilities.get(Kind::logPage, 0x04), Support::unknown);
+    capabilities.setDiscovered();
+    capabilities.reset();
+    EXPECT_EQ(capabilities.get(Kind::feature, 0x04), Support::unknown);
+    EXPECT_FALSE(capabilities.isDiscovered());
+}
+
+TEST(Capabilities, IdentifyController)
+{
+    std::vector<uint8_t> identify(512, 0x00);
+    // LPA: Commands Supported and Effects, telemetry
+    identify[261] = 0x0A;
+    // CTRATT: endurance groups
+    identify[96] = 0x10;
+    Capabilities capabilities;
+    capabilities.setIdentifyController(identify.data(), identify.size());
+    EXPECT_EQ(capabilities.get(Kind::logPage, 0x02), Support::supported);
+    EXPECT_EQ(capabilities.get(Kind::logPage, 0x05), Support::supported);
+    EXPECT_EQ(capabilities.get(Kind::logPage, 0x07), Support::supported);
+    EXPECT_EQ(capabilities.get(Kind::logPage, 0x09), Support::supported);
+    EXPECT_TRUE(capabilities.isUnsupported(Kind::logPage, 0x06));
+    EXPECT_TRUE(capabilities.isUnsupported(Kind::logPage, 0x0A));
+    EXPECT_TRUE(capabilities.isUnsupported(Kind::logPage, 0x0C));
+    EXPECT_TRUE(capabilities.isUnsupported(Kind::logPage, 0x0D));
+    // Log pages not covered by Identify stay unknown
+    EXPECT_EQ(capabilities.get(Kind::logPage, 0x0E), Support::unknown);
+
+    Capabilities truncated;
+    truncated.setIdentifyController(identify.data(), 200);
+    EXPECT_EQ(truncated.get(Kind::logPage, 0x06), Support::unknown);
+}
+
+TEST(Capabilities, OptionalCommands)
+{
+    Capabilities capabilities;
+    // Vendor specific MI command and Set Features
+    capabilities.setOptionalCommands({{1, 0xC0}, {2, 0x09}});
+    EXPECT_EQ(capabilities.get(Kind::miCommand, 0xC0), Support::supported);
+    // Mandatory MI commands are not listed, VPD Read to Reset included
+    EXPECT_EQ(capabilities.get(Kind::miCommand, 0x03), Support::supported);
+    EXPECT_EQ(capabilities.get(Kind::miCommand, 0x05), Support::supported);
+    EXPECT_EQ(capabilities.get(Kind::miCommand, 0x06), Support::supported);
+    EXPECT_EQ(capabilities.get(Kind::miCommand, 0x07), Support::supported);
+    EXPECT_TRUE(capabilities.isUnsupported(Kind::miCommand, 0x08));
+    EXPECT_EQ(capabilities.get(Kind::adminCommand, 0x09),
+              Support::supported);
+    EXPECT_EQ(capabilities.get(Kind::adminCommand, 0x0A),
+              Support::supported);
+    EXPECT_TRUE(capabilities.isUnsupported(Kind::adminCommand, 0x10));
+}
+
+TEST(Capabilities, CommandsSupported)
+{
+    std::vector<uint8_t> log(1024, 0x00);
+    log[0x02 * 4] = 0x01;
+    log[0x09 * 4] = 0x03;
+    Capabilities capabilities;
+    capabilities.setCommandsSupported(log.data(), log.size());
+    EXPECT_EQ(capabilities.get(Kind::adminCommand, 0x02),
+              Support::supported);
+    EXPECT_EQ(capabilities.get(Kind::adminCommand, 0x09),
+              Support::supported);
+    EXPECT_TRUE(capabilities.isUnsupported(Kind::adminCommand, 0x0A));
+}
+
+TEST(Capabilities, UnsupportedStatus)
+{
+    using nvmemi::capabilities::isUnsupportedStatus;
+    EXPECT_FALSE(isUnsupportedStatus(0x00, 0));
+    EXPECT_TRUE(isUnsupportedStatus(0x03, 0));
+    EXPECT_TRUE(isUnsupportedStatus(0x04, 0));
+    EXPECT_FALSE(isUnsupportedStatus(0x02, 0));
+    // Generic Invalid Field in Command
+    EXPECT_TRUE(isUnsupportedStatus(0x00, 0x02u << 17));
+    EXPECT_TRUE(isUnsupportedStatus(0x00, (0x01u << 17) | 0x10000));
+    // Command specific status with the same status code
+    EXPECT_FALSE(isUnsupportedStatus(0x00, (0x01u << 25) | (0x02u << 17)));
+}
+
+TEST(Capabilities, Registry)
+{
+    using namespace nvmemi::capabilities;
+    EXPECT_EQ(getEndpoint(20), nullptr);
+    Capabilities& capabilities = registerEndpoint(20);
+    EXPECT_EQ(getEndpoint(20), &capabilities);
+    unregisterEndpoint(20);
+    EXPECT_EQ(getEndpoint(20), nullptr);
+}
@@ -40,6 +40,55 @@ std::unique_ptr<GlobalData> gAppData;
 static constexpr size_t readIdx = 0;
 static constexpr size_t writeIdx = 1;
 
+static std::string getJobProperty(boost::asio::yield_context yield,
+                                  const std::string& jobPath,
+                                  const std::string& property)
+{
+    boost::system::error_code ec;
+    auto value =
+        gAppData->dbusConnection->yield_method_call<std::variant<std::string>>(
+            yield, ec, "xyz.openbmc_project.nvmemi_test", jobPath,
+            "org.freedesktop.DBus.Properties", "Get",
+            "xyz.openbmc_project.drive_log_job", property);
+    if (ec)
+    {
+        throw std::runtime_error("Error getting job property " + property);
+    }
+    return std::get<std::string>(value);
+}
+
+void checkCollectLogJob(boost::asio::yield_context yield)
+{
+    boost::system::error_code ec;
+    auto jobPath = gAppData->dbusConnection
+                       ->yield_method_call<sdbusplus::message::object_path>(
+                           yield, ec, "xyz.openbmc_project.nvmemi_test",
+                           "/xyz/openbmc_project/CollectLogDrive",
+                           "xyz.openbmc_project.drive_log", "StartCollectLog",
+                           "health", static_cast<uint32_t>(0));
+    ASSERT_FALSE(ec) << ec.message();
+    EXPECT_EQ(jobPath.str,
+              "/xyz/openbmc_project/CollectLogDrive/collect_log/0");
+
+    std::string state;
+    boost::asio::steady_timer timer(*gAppData->ioContext);
+    for (int retry = 0; retry < 100; retry++)
+    {
+        state = getJobProperty(yield, jobPath.str, "State");
+        if (state != "Queued" && state != "Running")
+        {
+            break;
+        }
+        timer.expires_after(std::chrono::milliseconds(100));
+        timer.async_wait(yield[ec]);
+    }
+    ASSERT_EQ(state, "Completed");
+    std::ifstream ifs(getJobProperty(yield, jobPath.str, "Result"));
+    nlohmann::json nvmeDumpFile = nlohmann::json::parse(ifs);
+    EXPECT_TRUE(nvmeDumpFile["GetLogPage"].contains("SMARTHealth"));
+    EXPECT_FALSE(nvmeDumpFile.contains("Identify"));
+}
+
 void parentTask()
 {
     close(gAppData->cToP[readIdx]);
@@ -102,6 +151,15 @@ void parentTask()
                 std::cerr << "Collect log. Generic error." << '\n';
             }
 
+            try
+            {
+                checkCollectLogJob(yield);
+            }
+            catch (const std::exception& e)
+            {
+                ADD_FAILURE() << "Collect log job. " << e.what();
+            }
+
             gAppData->ioContext->stop();
             write(gAppData->cToP[writeIdx], &readData, sizeof(readData));
         });
@@ -0,0 +1,103 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../drive_state.hpp"
+
+#include <unistd.h>
+
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+using nvmemi::DaemonState;
+using nvmemi::DriveState;
+
+class DriveStateTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        char dirTemplate[] = "/tmp/nvmemi_state_test_XXXXXX";
+        directory = mkdtemp(dirTemplate);
+    }
+    void TearDown() override
+    {
+        std::filesystem::remove_all(directory);
+    }
+    std::filesystem::path directory;
+};
+
+TEST_F(DriveStateTest, RoundTrip)
+{
+    DaemonState state;
+    state.driveCounter = 3;
+    nvmemi::HealthSample sample{1600000000, {0x38, 0xFF, 0x21, 0x01, 0, 0}};
+    state.drives.emplace_back(DriveState{"NVMe_1", 10, sample, true, 2});
+    state.drives.emplace_back(
+        DriveState{"NVMeDrive2", 11, std::nullopt, false, 0});
+    auto path = directory / "state" / "state.json";
+    nvmemi::statefile::save(path, state);
+
+    DaemonState loaded = nvmemi::statefile::load(path);
+    EXPECT_EQ(loaded.driveCounter, 3);
+    ASSERT_EQ(loaded.drives.size(), 2);
+    const DriveState* drive = loaded.findByName("NVMe_1");
+    ASSERT_NE(drive, nullptr);
+    EXPECT_EQ(drive->eid, 10);
+    ASSERT_TRUE(drive->lastHealth.has_value());
+    EXPECT_EQ(drive->lastHealth->timestamp, sample.timestamp);
+    EXPECT_EQ(drive->lastHealth->data, sample.data);
+    EXPECT_TRUE(drive->criticalWarning);
+    EXPECT_EQ(drive->errorCount, 2);
+    drive = loaded.findByEid(11);
+    ASSERT_NE(drive, nullptr);
+    EXPECT_EQ(drive->name, "NVMeDrive2");
+    EXPECT_FALSE(drive->lastHealth.has_value());
+    EXPECT_EQ(loaded.findByEid(12), nullptr);
+}
+
+TEST_F(DriveStateTest, DurableState)
+{
+    DaemonState state;
+    state.drives.emplace_back(DriveState{"NVMe_1", 10, std::nullopt, false, 0});
+    DaemonState other = state;
+    // A new health reading alone does not need a write
+    other.drives[0].lastHealth =
+        nvmemi::HealthSample{1600000000, {0x38, 0xFF, 0x21, 0x01, 0, 0}};
+    EXPECT_TRUE(state.sameDurableState(other));
+    other.drives[0].errorCount = 1;
+    EXPECT_FALSE(state.sameDurableState(other));
+    other = state;
+    other.drives[0].criticalWarning = true;
+    EXPECT_FALSE(state.sameDurableState(other));
+    other = state;
+    other.drives.emplace_back(
+        DriveState{"NVMe_2", 11, std::nullopt, false, 0});
+    EXPECT_FALSE(state.sameDurableState(other));
+    other = state;
+    other.driveCounter = 2;
+    EXPECT_FALSE(state.sameDurableState(other));
+}
+
+TEST_F(DriveStateTest, MissingAndInvalid)
+{
+    auto path = directory / "state.json";
+    DaemonState state = nvmemi::statefile::load(path);
+    EXPECT_TRUE(state.drives.empty());
+    EXPECT_EQ(state.driveCounter, 1);
+
+    std::ofstream(path) << "{\"Version\": 1";
+    EXPECT_THROW(nvmemi::statefile::load(path), std::runtime_error);
+}
@@ -0,0 +1,112 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../dump_store.hpp"
+
+#include <unistd.h>
+
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+using nvmemi::DumpStore;
+
+class DumpStoreTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        char dirTemplate[] = "/tmp/nvmemi_dump_test_XXXXXX";
+        directory = mkdtemp(dirTemplate);
+    }
+    void TearDown() override
+    {
+        std::filesystem::remove_all(directory);
+    }
+    std::filesystem::path directory;
+};
+
+TEST_F(DumpStoreTest, Rotation)
+{
+    DumpStore store(directory, 250, DumpStore::Compression::none);
+    std::string content(100, 'a');
+    auto first = store.add(content);
+    auto second = store.add(content);
+    EXPECT_EQ(store.getUsedBytes(), 200);
+
+    // Opening the first dump makes the second one least recently used
+    int fd = store.open(first.id);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    auto third = store.add(content);
+    EXPECT_EQ(store.getUsedBytes(), 200);
+    EXPECT_TRUE(std::filesystem::exists(first.path));
+    EXPECT_FALSE(std::filesystem::exists(second.path));
+    EXPECT_TRUE(std::filesystem::exists(third.path));
+    EXPECT_THROW(store.open(second.id), std::invalid_argument);
+
+    // Most recent dump is kept even if over the quota
+    auto large = store.add(std::string(400, 'b'));
+    ASSERT_EQ(store.list().size(), 1);
+    EXPECT_EQ(store.list()[0].id, large.id);
+
+    EXPECT_TRUE(store.remove(large.id));
+    EXPECT_FALSE(store.remove(large.id));
+    EXPECT_EQ(store.getUsedBytes(), 0);
+}
+
+TEST_F(DumpStoreTest, DeleteFailure)
+{
+    DumpStore store(directory, 250, DumpStore::Compression::none);
+    std::string content(100, 'a');
+    auto stuck = store.add(content);
+    // A non-empty directory in place of the file can not be deleted
+    std::filesystem::remove(stuck.path);
+    std::filesystem::create_directory(stuck.path);
+    std::ofstream(stuck.path / "file") << "x";
+    EXPECT_FALSE(store.remove(stuck.id));
+    EXPECT_EQ(store.list().size(), 1);
+    EXPECT_EQ(store.getUsedBytes(), 100);
+
+    // Rotation skips the dump that can not be deleted
+    auto second = store.add(content);
+    auto third = store.add(content);
+    EXPECT_EQ(store.getUsedBytes(), 200);
+    EXPECT_TRUE(std::filesystem::exists(stuck.path));
+    EXPECT_FALSE(std::filesystem::exists(second.path));
+    EXPECT_TRUE(std::filesystem::exists(third.path));
+}
+
+TEST_F(DumpStoreTest, Rescan)
+{
+    {
+        DumpStore store(directory, 1000, DumpStore::Compression::none);
+        store.add(std::string(100, 'a'));
+        store.add(std::string(100, 'a'));
+    }
+    DumpStore store(directory, 150, DumpStore::Compression::none);
+    EXPECT_EQ(store.list().size(), 1);
+    EXPECT_EQ(store.getUsedBytes(), 100);
+}
+
+#ifdef NVME_DUMP_GZIP
+TEST_F(DumpStoreTest, Gzip)
+{
+    DumpStore store(directory, 1000, DumpStore::Compression::gzip);
+    auto dump = store.add(std::string(10000, 'a'));
+    EXPECT_EQ(dump.path.extension(), ".gz");
+    EXPECT_LT(dump.size, 1000);
+}
+#endif
@@ -0,0 +1,58 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../endpoint_registry.hpp"
+
+#include <gtest/gtest.h>
+
+using nvmemi::EndpointRegistry;
+
+TEST(EndpointRegistry, AddAndRemove)
+{
+    EndpointRegistry<int> registry;
+    EXPECT_EQ(registry.get(10), nullptr);
+    registry.add(10, nullptr, 5);
+    ASSERT_NE(registry.get(10), nullptr);
+    EXPECT_EQ(*registry.get(10), 5);
+    EXPECT_EQ(registry.getEids(), std::vector<mctpw::eid_t>{10});
+
+    // Registering again for the same owner keeps the entry
+    *registry.get(10) = 6;
+    registry.add(10, nullptr, 5);
+    EXPECT_EQ(*registry.get(10), 6);
+
+    auto shared = registry.share(10);
+    EXPECT_TRUE(registry.remove(10, nullptr));
+    EXPECT_EQ(registry.get(10), nullptr);
+    EXPECT_TRUE(registry.getEids().empty());
+    // Shared entries outlive the registration
+    EXPECT_EQ(*shared, 6);
+}
+
+TEST(EndpointRegistry, Owner)
+{
+    EndpointRegistry<int> registry;
+    int first = 0;
+    int second = 0;
+    registry.add(20, &first, 1);
+    // An other owner gets a new entry
+    registry.add(20, &second, 2);
+    EXPECT_EQ(*registry.get(20), 2);
+    // The previous owner going away keeps the entry of the new one
+    EXPECT_FALSE(registry.remove(20, &first));
+    EXPECT_EQ(*registry.get(20), 2);
+    EXPECT_TRUE(registry.remove(20, &second));
+    EXPECT_EQ(registry.get(20), nullptr);
+}
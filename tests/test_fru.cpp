@@ -0,0 +1,129 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../fru.hpp"
+
+#include <gtest/gtest.h>
+
+using nvmemi::fru::Fru;
+
+static void appendField(std::vector<uint8_t>& area, const std::string& text)
+{
+    area.emplace_back(static_cast<uint8_t>(0xC0 | text.size()));
+    area.insert(area.end(), text.begin(), text.end());
+}
+
+/** @brief Pad to a multiple of 8 bytes and set the length and checksum */
+static void closeArea(std::vector<uint8_t>& area)
+{
+    area.emplace_back(0xC1);
+    while ((area.size() + 1) % 8 != 0)
+    {
+        area.emplace_back(0x00);
+    }
+    area[1] = static_cast<uint8_t>((area.size() + 1) / 8);
+    uint8_t sum = 0;
+    for (uint8_t byte : area)
+    {
+        sum = static_cast<uint8_t>(sum + byte);
+    }
+    area.emplace_back(static_cast<uint8_t>(-sum));
+}
+
+static std::vector<uint8_t> makeVpd()
+{
+    std::vector<uint8_t> board = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
+    appendField(board, "Vendor");
+    appendField(board, "Board");
+    appendField(board, "SN1234  ");
+    appendField(board, "PN-1");
+    closeArea(board);
+    std::vector<uint8_t> product = {0x01, 0x00, 0x00};
+    appendField(product, "Vendor");
+    appendField(product, "NVMe SSD");
+    appendField(product, "MODEL-9");
+    // 6-bit ASCII "1.0 " packed in three bytes, trailing space trimmed
+    product.insert(product.end(), {0x83, 0x91, 0x03, 0x01});
+    closeArea(product);
+    std::vector<uint8_t> record = {0x0B, 0x82, 0x02, 0x00, 0x00, 0x10, 0x20};
+    record[3] = static_cast<uint8_t>(-(0x10 + 0x20));
+    record[4] = static_cast<uint8_t>(-(0x0B + 0x82 + 0x02 + record[3]));
+
+    std::vector<uint8_t> vpd(8, 0x00);
+    vpd[0] = 0x01;
+    vpd[3] = 1;
+    vpd[4] = static_cast<uint8_t>(1 + board.size() / 8);
+    vpd[5] = static_cast<uint8_t>(vpd[4] + product.size() / 8);
+    uint8_t sum = 0;
+    for (size_t idx = 0; idx < 7; idx++)
+    {
+        sum = static_cast<uint8_t>(sum + vpd[idx]);
+    }
+    vpd[7] = static_cast<uint8_t>(-sum);
+    vpd.insert(vpd.end(), board.begin(), board.end());
+    vpd.insert(vpd.end(), product.begin(), product.end());
+    vpd.insert(vpd.end(), record.begin(), record.end());
+    return vpd;
+}
+
+TEST(Fru, Parse)
+{
+    auto vpd = makeVpd();
+    auto fru = nvmemi::fru::parse(vpd.data(), vpd.size());
+    ASSERT_TRUE(fru);
+    EXPECT_EQ(fru->boardManufacturer, "Vendor");
+    EXPECT_EQ(fru->boardSerialNumber, "SN1234");
+    EXPECT_EQ(fru->boardPartNumber, "PN-1");
+    EXPECT_EQ(fru->productName, "NVMe SSD");
+    EXPECT_EQ(fru->productPartNumber, "MODEL-9");
+    EXPECT_EQ(fru->productVersion, "1.0");
+    EXPECT_EQ(fru->productSerialNumber, "");
+    ASSERT_EQ(fru->recordTypes.size(), 1);
+    EXPECT_EQ(fru->recordTypes[0], nvmemi::fru::RecordType::nvme);
+
+    // Bad board area checksum only drops the board fields
+    vpd[8 + 10]++;
+    fru = nvmemi::fru::parse(vpd.data(), vpd.size());
+    ASSERT_TRUE(fru);
+    EXPECT_EQ(fru->boardManufacturer, "");
+    EXPECT_EQ(fru->productName, "NVMe SSD");
+
+    vpd[7]++;
+    EXPECT_FALSE(nvmemi::fru::parse(vpd.data(), vpd.size()));
+}
+
+TEST(Fru, RequiredSize)
+{
+    auto vpd = makeVpd();
+    size_t size = 0;
+    // Read the way the drive does, up to the size required so far
+    size_t reads = 0;
+    while (true)
+    {
+        size_t required = nvmemi::fru::getRequiredSize(vpd.data(), size);
+        if (required <= size)
+        {
+            break;
+        }
+        size = required;
+        reads++;
+        ASSERT_LE(size, vpd.size());
+    }
+    EXPECT_EQ(size, vpd.size());
+    EXPECT_GT(reads, 1);
+
+    std::vector<uint8_t> blank(8, 0xFF);
+    EXPECT_EQ(nvmemi::fru::getRequiredSize(blank.data(), blank.size()), 8);
+}
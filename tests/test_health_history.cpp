@@ -0,0 +1,90 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../health_history.hpp"
+
+#include <gtest/gtest.h>
+
+using nvmemi::HealthHistory;
+using nvmemi::HealthSample;
+
+static HealthSample makeSample(uint32_t timestamp, uint8_t temperature,
+                               uint8_t smartWarnings = 0xFF)
+{
+    return HealthSample{timestamp,
+                        {0x38, smartWarnings, temperature, 0x00, 0x21, 0x01}};
+}
+
+TEST(HealthHistory, DayAtOneHertz)
+{
+    HealthHistory history;
+    constexpr uint32_t start = 1600000000;
+    constexpr uint32_t day = 24 * 60 * 60;
+    // Temperature drifting up and down by one degree every few minutes
+    for (uint32_t sec = 0; sec < day; sec++)
+    {
+        auto temperature = static_cast<uint8_t>(35 + (sec / 240) % 4);
+        history.add(makeSample(start + sec, temperature));
+    }
+    EXPECT_LE(history.getUsedBytes(),
+              HealthHistory::blockSize * HealthHistory::blockCount);
+
+    auto samples = history.read();
+    ASSERT_EQ(samples.size(), day);
+    for (uint32_t sec = 0; sec < day; sec++)
+    {
+        EXPECT_EQ(samples[sec].timestamp, start + sec);
+        EXPECT_EQ(samples[sec].data[HealthSample::temperatureIdx],
+                  35 + (sec / 240) % 4);
+    }
+
+    auto recent = history.read(start + day - 10);
+    ASSERT_EQ(recent.size(), 10);
+    EXPECT_EQ(recent.front().timestamp, start + day - 10);
+}
+
+TEST(HealthHistory, Rotation)
+{
+    HealthHistory history;
+    // Every sample differs in more than the temperature
+    constexpr uint32_t count = 10000;
+    for (uint32_t idx = 0; idx < count; idx++)
+    {
+        history.add(makeSample(idx * 2, static_cast<uint8_t>(idx * 20),
+                               static_cast<uint8_t>(idx)));
+    }
+    auto samples = history.read();
+    ASSERT_FALSE(samples.empty());
+    EXPECT_LT(samples.size(), count);
+    EXPECT_EQ(samples.back().timestamp, (count - 1) * 2);
+    EXPECT_EQ(samples.back().data[1], static_cast<uint8_t>(count - 1));
+    for (size_t idx = 1; idx < samples.size(); idx++)
+    {
+        EXPECT_EQ(samples[idx].timestamp, samples[idx - 1].timestamp + 2);
+    }
+}
+
+TEST(HealthHistory, ClockStep)
+{
+    HealthHistory history;
+    history.add(makeSample(1000, 30));
+    history.add(makeSample(1001, 30));
+    history.add(makeSample(500, 31));
+    auto samples = history.read();
+    ASSERT_EQ(samples.size(), 3);
+    EXPECT_EQ(samples[1].timestamp, 1001);
+    EXPECT_EQ(samples[2].timestamp, 500);
+    EXPECT_EQ(samples[2].data[HealthSample::temperatureIdx], 31);
+}
@@ -0,0 +1,37 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../log_profile.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace nvmemi::logprofile;
+
+TEST(LogProfile, Profiles)
+{
+    EXPECT_EQ(getProfileMask("health"), errorLog | smartHealthLog);
+    EXPECT_EQ(getProfileMask("full"), allSections);
+    EXPECT_FALSE(getProfileMask("unknown").has_value());
+}
+
+TEST(LogProfile, Resolve)
+{
+    EXPECT_EQ(resolveSections("", 0), allSections);
+    EXPECT_EQ(resolveSections("", identify), identify);
+    EXPECT_EQ(resolveSections("health", identify),
+              errorLog | smartHealthLog | identify);
+    EXPECT_THROW(resolveSections("unknown", 0), std::invalid_argument);
+    EXPECT_THROW(resolveSections("", 1 << 20), std::invalid_argument);
+}
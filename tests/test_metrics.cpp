@@ -0,0 +1,101 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../metrics.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace nvmemi::metrics;
+
+TEST(Metrics, Classify)
+{
+    std::vector<uint8_t> subsystemHS = {
+        0x84, 0x08, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xD2, 0xD4, 0x77, 0x36};
+    EXPECT_EQ(classifyRequest(subsystemHS), Command::subsystemHealthStatusPoll);
+    std::vector<uint8_t> identify = {0x84, 0x10, 0x00, 0x00, 0x06, 0x01};
+    EXPECT_EQ(classifyRequest(identify), Command::identify);
+    std::vector<uint8_t> setFeatures = {0x84, 0x10, 0x00, 0x00, 0x09, 0x00};
+    EXPECT_EQ(classifyRequest(setFeatures), Command::setFeatures);
+    std::vector<uint8_t> shortReq = {0x84, 0x10, 0x00, 0x00};
+    EXPECT_EQ(classifyRequest(shortReq), Command::other);
+
+    std::vector<uint8_t> response = {132, 136, 0,  0, 0, 0, 0,   0,  56, 255,
+                                     59,  0,   33, 1, 0, 0, 194, 38, 58, 37};
+    EXPECT_EQ(classifyResponse(boost::system::error_code(), response),
+              Outcome::success);
+    response[8] = 57;
+    EXPECT_EQ(classifyResponse(boost::system::error_code(), response),
+              Outcome::crcError);
+    EXPECT_EQ(classifyResponse(boost::system::errc::make_error_code(
+                                   boost::system::errc::timed_out),
+                               {}),
+              Outcome::timeout);
+    EXPECT_EQ(classifyResponse(boost::system::errc::make_error_code(
+                                   boost::system::errc::io_error),
+                               {}),
+              Outcome::transportError);
+}
+
+TEST(Metrics, Record)
+{
+    using namespace std::chrono_literals;
+    constexpr mctpw::eid_t eid = 10;
+    EXPECT_EQ(getEndpoint(eid), nullptr);
+    auto& stats = registerEndpoint(eid);
+    EXPECT_EQ(getEndpoint(eid), &stats);
+
+    stats.record(Command::getLogPage, Outcome::success, 500us, 76, 520);
+    stats.record(Command::getLogPage, Outcome::success, 1500us, 76, 520);
+    stats.record(Command::getLogPage, Outcome::timeout, 3000ms, 76, 0);
+    stats.record(Command::getLogPage, Outcome::success, 10s, 76, 520);
+    const auto& logPage = stats.get(Command::getLogPage);
+    EXPECT_EQ(logPage.success, 3);
+    EXPECT_EQ(logPage.timeout, 1);
+    EXPECT_EQ(logPage.bytesSent, 4 * 76);
+    EXPECT_EQ(logPage.bytesReceived, 3 * 520);
+    auto buckets = logPage.latency.getBuckets();
+    EXPECT_EQ(buckets[0], 1);
+    EXPECT_EQ(buckets[1], 1);
+    EXPECT_EQ(buckets[LatencyHistogram::bucketCount - 1], 1);
+    EXPECT_EQ(logPage.latency.getSumMicroseconds(), 500 + 1500 + 10000000);
+
+    auto dump = dumpPrometheus();
+    EXPECT_NE(dump.find("nvme_mi_request_duration_seconds_bucket{eid=\"10\","
+                        "command=\"get_log_page\",le=\"+Inf\"} 3"),
+              std::string::npos);
+    EXPECT_NE(dump.find("nvme_mi_requests_total{eid=\"10\",command=\"get_log_"
+                        "page\",outcome=\"timeout\"} 1"),
+              std::string::npos);
+
+    stats.reset();
+    EXPECT_EQ(stats.get(Command::getLogPage).success, 0);
+    unregisterEndpoint(eid);
+    EXPECT_EQ(getEndpoint(eid), nullptr);
+}
+
+TEST(Metrics, Owner)
+{
+    constexpr mctpw::eid_t eid = 11;
+    int oldDrive = 0;
+    int newDrive = 0;
+    registerEndpoint(eid, &oldDrive);
+    auto& stats = registerEndpoint(eid, &newDrive);
+    // Former owner released after the EID was registered again
+    unregisterEndpoint(eid, &oldDrive);
+    EXPECT_EQ(getEndpoint(eid), &stats);
+    unregisterEndpoint(eid, &newDrive);
+    EXPECT_EQ(getEndpoint(eid), nullptr);
+}
@@ -15,12 +15,17 @@
 */
 #include "../protocol/admin/admin_cmd.hpp"
 #include "../protocol/admin/admin_rsp.hpp"
+#include "../protocol/mi/configuration.hpp"
+#include "../protocol/mi/controller_hs_poll.hpp"
+#include "../protocol/mi/read_nvmemi_ds.hpp"
 #include "../protocol/mi/subsystem_hs_poll.hpp"
 #include "../protocol/mi_msg.hpp"
 #include "../protocol/mi_rsp.hpp"
 #include "../protocol/nvme_msg.hpp"
 #include "../protocol/nvme_rsp.hpp"
 
+#include <cstring>
+
 #include <gtest/gtest.h>
 
 TEST(NVMeMsg, Create)
@@ -319,6 +324,27 @@ TEST(SubsystemHealthStatusPoll, Struct)
     EXPECT_EQ(respData[2], temperature + 1);
 }
 
+TEST(SubsystemHealthStatusPoll, Changes)
+{
+    namespace subsystemhs = nvmemi::protocol::subsystemhs;
+    using Response = subsystemhs::ResponseData;
+    std::array<uint8_t, sizeof(Response)> respData{};
+    auto respPtr = reinterpret_cast<Response*>(respData.data());
+    // Ready and shutdown status are levels, not changes
+    respData[4] = 0x05;
+    EXPECT_EQ(subsystemhs::getChanges(respPtr->ccs), 0);
+    respPtr->ccs.firmwareActivated = true;
+    respPtr->ccs.criticalWarning = true;
+    EXPECT_EQ(subsystemhs::getChanges(respPtr->ccs),
+              subsystemhs::firmwareActivated | subsystemhs::criticalWarning);
+    respPtr->ccs.compositeTemperatureChange = true;
+    EXPECT_EQ(respData[5] & 0x02, 0x02);
+
+    EXPECT_FALSE(subsystemhs::hasCriticalWarning(0xFF));
+    EXPECT_FALSE(subsystemhs::hasCriticalWarning(0x1F));
+    EXPECT_TRUE(subsystemhs::hasCriticalWarning(0xFB));
+}
+
 TEST(SubsystemHealthStatusPoll, convertToCelsius)
 {
     namespace prot = nvmemi::protocol;
@@ -335,6 +361,52 @@ TEST(SubsystemHealthStatusPoll, convertToCelsius)
     EXPECT_THROW(func(0xC4), std::invalid_argument);
 }
 
+TEST(Configuration, Negotiate)
+{
+    namespace configuration = nvmemi::protocol::configuration;
+    using configuration::SMBusFrequency;
+    EXPECT_EQ(sizeof(nvmemi::protocol::readnvmeds::PortInfo), 32);
+    EXPECT_EQ(sizeof(configuration::RequestDWord0), 4);
+    EXPECT_EQ(configuration::negotiateFrequency(SMBusFrequency::freq100kHz,
+                                                SMBusFrequency::freq1MHz,
+                                                SMBusFrequency::freq400kHz),
+              SMBusFrequency::freq400kHz);
+    EXPECT_EQ(configuration::negotiateFrequency(SMBusFrequency::freq100kHz,
+                                                SMBusFrequency::freq400kHz,
+                                                SMBusFrequency::freq1MHz),
+              SMBusFrequency::freq400kHz);
+    EXPECT_EQ(configuration::negotiateFrequency(SMBusFrequency::freq400kHz,
+                                                SMBusFrequency::notSupported,
+                                                SMBusFrequency::freq1MHz),
+              SMBusFrequency::freq400kHz);
+    EXPECT_EQ(configuration::negotiateUnitSize(64, 250, 1024), 250);
+    EXPECT_EQ(configuration::negotiateUnitSize(64, 4096, 1024), 1024);
+    EXPECT_EQ(configuration::negotiateUnitSize(512, 4096, 256), 512);
+}
+
+TEST(ControllerHSPoll, Paging)
+{
+    namespace controllerhspoll = nvmemi::protocol::controllerhspoll;
+    using controllerhspoll::getNextStartId;
+    EXPECT_EQ(sizeof(controllerhspoll::ControllerHealth), 16);
+    EXPECT_EQ(sizeof(controllerhspoll::DWord0), 4);
+    // Sparse IDs continue after the last ID, past the 8 bit range
+    EXPECT_EQ(getNextStartId(0, 255, 0x0300), 0x0301);
+    EXPECT_EQ(getNextStartId(0x0301, 255, 0x1000), 0x1001);
+    // Drives capping the entries per response are paged on
+    EXPECT_EQ(getNextStartId(0x1001, 10, 0x1100), 0x1101);
+    EXPECT_EQ(getNextStartId(0x1101, 0, 0), std::nullopt);
+    EXPECT_EQ(getNextStartId(0xFF00, 255, 0xFFFF), std::nullopt);
+    EXPECT_EQ(getNextStartId(0x1000, 255, 0x0010), std::nullopt);
+
+    // Start ID, 0's based entries, PCI, SR-IOV physical and virtual
+    // functions and report all
+    auto dword0 = controllerhspoll::getPageRequest(0x0301, 255);
+    uint32_t raw = 0;
+    std::memcpy(&raw, &dword0, sizeof(raw));
+    EXPECT_EQ(le32toh(raw), 0x87FE0301);
+}
+
 TEST(AdminCommand, Create)
 {
     namespace prot = nvmemi::protocol;
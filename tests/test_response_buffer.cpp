@@ -0,0 +1,66 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../response_buffer.hpp"
+
+#include <endian.h>
+
+#include <gtest/gtest.h>
+
+using nvmemi::ByteView;
+using nvmemi::ResponseBuffer;
+
+struct TestStruct
+{
+    uint8_t first;
+    uint16_t second;
+} __attribute__((packed));
+
+TEST(ResponseBuffer, NoCopy)
+{
+    std::vector<uint8_t> response{0x84, 0x88, 0x01, 0x34, 0x12, 0xAA};
+    const uint8_t* storage = response.data();
+    ResponseBuffer payload(std::move(response), ByteView(storage + 2, 3));
+    // Payload points into the original storage
+    EXPECT_EQ(payload.data(), storage + 2);
+    EXPECT_EQ(payload.size(), 3);
+    EXPECT_EQ(payload[0], 0x01);
+
+    ResponseBuffer copy = payload;
+    EXPECT_EQ(copy.data(), payload.data());
+
+    nvmemi::ResponseStruct<TestStruct> decoded(copy);
+    EXPECT_TRUE(decoded);
+    EXPECT_EQ(decoded->first, 0x01);
+    EXPECT_EQ(le16toh(decoded->second), 0x1234);
+
+    EXPECT_EQ(payload.view().subview(1, 2)[1], 0x12);
+    EXPECT_THROW(payload.view().subview(2, 2), std::out_of_range);
+}
+
+TEST(ResponseBuffer, Bounds)
+{
+    std::vector<uint8_t> other(4);
+    EXPECT_THROW(ResponseBuffer(std::vector<uint8_t>(4),
+                                ByteView(other.data(), other.size())),
+                 std::out_of_range);
+
+    std::vector<uint8_t> response(4);
+    const uint8_t* storage = response.data();
+    ResponseBuffer payload(std::move(response), ByteView(storage + 2, 2));
+    EXPECT_THROW(nvmemi::ResponseStruct<TestStruct>{payload},
+                 std::length_error);
+    EXPECT_FALSE(nvmemi::ResponseStruct<TestStruct>());
+}
@@ -0,0 +1,221 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../protocol/linux/crc32c.h"
+#include "../retry_policy.hpp"
+
+#include <boost/asio/io_context.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace nvmemi::retry;
+
+// Response with the given NVMe-MI status, completion queue dword 3 and CRC
+static std::vector<uint8_t> makeResponse(uint8_t msgType, uint8_t status,
+                                         uint32_t cqDword3 = 0)
+{
+    std::vector<uint8_t> response(4 + 4 + 12 + 4, 0x00);
+    response[0] = 0x84;
+    response[1] = static_cast<uint8_t>(0x80 | (msgType << 3));
+    response[4] = status;
+    for (size_t idx = 0; idx < sizeof(cqDword3); idx++)
+    {
+        response[16 + idx] = static_cast<uint8_t>(cqDword3 >> (idx * 8));
+    }
+    uint32_t crc = crc32c(response.data(), static_cast<int>(response.size()));
+    for (size_t idx = 0; idx < sizeof(crc); idx++)
+    {
+        response.emplace_back(static_cast<uint8_t>(crc >> (idx * 8)));
+    }
+    return response;
+}
+
+static uint32_t makeAdminStatus(uint8_t statusType, uint8_t statusCode,
+                                bool doNotRetry)
+{
+    return (static_cast<uint32_t>(statusCode) << 17) |
+           (static_cast<uint32_t>(statusType) << 25) |
+           (doNotRetry ? (1u << 31) : 0);
+}
+
+TEST(RetryPolicy, Classify)
+{
+    constexpr uint8_t mi = 0x01;
+    constexpr uint8_t admin = 0x02;
+    boost::system::error_code ok;
+    EXPECT_EQ(classify(ok, makeResponse(mi, 0x00)), ErrorClass::none);
+    EXPECT_EQ(classify(ok, makeResponse(mi, 0x01)),
+              ErrorClass::moreProcessingRequired);
+    EXPECT_EQ(classify(ok, makeResponse(mi, 0x02)),
+              ErrorClass::miInternalError);
+    EXPECT_EQ(classify(ok, makeResponse(mi, 0x04)), ErrorClass::miRejected);
+    EXPECT_EQ(classify(ok, makeResponse(admin, 0x00,
+                                        makeAdminStatus(0, 0x21, false))),
+              ErrorClass::adminTransient);
+    EXPECT_EQ(classify(ok, makeResponse(admin, 0x00,
+                                        makeAdminStatus(0, 0x21, true))),
+              ErrorClass::adminRejected);
+    EXPECT_EQ(classify(ok, makeResponse(admin, 0x00,
+                                        makeAdminStatus(1, 0x06, false))),
+              ErrorClass::adminRejected);
+    // Completion queue dword 3 is only meaningful in admin responses
+    EXPECT_EQ(classify(ok, makeResponse(mi, 0x00,
+                                        makeAdminStatus(0, 0x21, false))),
+              ErrorClass::none);
+
+    auto response = makeResponse(mi, 0x00);
+    response[5] ^= 0xFF;
+    EXPECT_EQ(classify(ok, response), ErrorClass::crcError);
+    EXPECT_EQ(classify(boost::system::errc::make_error_code(
+                           boost::system::errc::timed_out),
+                       {}),
+              ErrorClass::timeout);
+    EXPECT_EQ(classify(boost::system::errc::make_error_code(
+                           boost::system::errc::io_error),
+                       {}),
+              ErrorClass::transportError);
+}
+
+class RetryPolicyTest : public ::testing::Test
+{
+  protected:
+    void TearDown() override
+    {
+        unregisterEndpoint(eid);
+        setBudgetCapacity(10);
+    }
+
+    // Runs a transaction returning the given responses in turn
+    Result send(const std::vector<Result>& responses, bool readOnly = true)
+    {
+        Result result;
+        boost::asio::spawn(
+            ioContext, [this, &result, &responses,
+                        readOnly](boost::asio::yield_context yield) {
+                result = run(
+                    eid, yield,
+                    [this, &responses](boost::asio::yield_context) {
+                        return responses[std::min(attempts++,
+                                                   responses.size() - 1)];
+                    },
+                    readOnly);
+            });
+        ioContext.run();
+        ioContext.restart();
+        return result;
+    }
+
+    static constexpr mctpw::eid_t eid = 12;
+    boost::asio::io_context ioContext;
+    size_t attempts = 0;
+};
+
+TEST_F(RetryPolicyTest, RetryThenSuccess)
+{
+    registerEndpoint(eid);
+    Result failed(boost::system::error_code(), makeResponse(0x01, 0x02));
+    Result done(boost::system::error_code(), makeResponse(0x01, 0x00));
+    auto result = send({failed, done}, false);
+    EXPECT_EQ(attempts, 2);
+    EXPECT_EQ(result.second, done.second);
+    EXPECT_EQ(getEndpoint(eid)->getRetries(ErrorClass::miInternalError), 1);
+}
+
+TEST_F(RetryPolicyTest, RetryLimit)
+{
+    registerEndpoint(eid);
+    Result badCrc(boost::system::error_code(), {0x84, 0x88});
+    send({badCrc});
+    EXPECT_EQ(attempts, 1 + getPolicy(ErrorClass::crcError).maxRetries);
+}
+
+TEST_F(RetryPolicyTest, NoRetryOnRejected)
+{
+    registerEndpoint(eid);
+    Result rejected(boost::system::error_code(), makeResponse(0x01, 0x04));
+    send({rejected});
+    EXPECT_EQ(attempts, 1);
+}
+
+TEST_F(RetryPolicyTest, NoResendOnMoreProcessingRequired)
+{
+    registerEndpoint(eid);
+    Result busy(boost::system::error_code(), makeResponse(0x01, 0x01));
+    send({busy});
+    EXPECT_EQ(attempts, 1);
+}
+
+TEST_F(RetryPolicyTest, NoRetryOfLostResponseWithSideEffects)
+{
+    registerEndpoint(eid);
+    Result badCrc(boost::system::error_code(), {0x84, 0x88});
+    send({badCrc}, false);
+    EXPECT_EQ(attempts, 1);
+    Result timeout(boost::system::errc::make_error_code(
+                       boost::system::errc::timed_out),
+                   {});
+    attempts = 0;
+    send({timeout}, false);
+    EXPECT_EQ(attempts, 1);
+}
+
+// Subsystem Health Status Poll request
+static std::vector<uint8_t> makeHealthPoll(bool clearStatus)
+{
+    std::vector<uint8_t> request(4 + 12 + 4, 0x00);
+    request[0] = 0x84;
+    request[1] = 0x08;
+    request[4] = 0x01;
+    request[15] = clearStatus ? 0x80 : 0x00;
+    return request;
+}
+
+TEST_F(RetryPolicyTest, HealthPollRetry)
+{
+    registerEndpoint(eid);
+    Result timeout(boost::system::errc::make_error_code(
+                       boost::system::errc::timed_out),
+                   {});
+    Result done(boost::system::error_code(), makeResponse(0x01, 0x00));
+    // Level-triggered poll has no side effects
+    auto result = send({timeout, done}, isIdempotent(makeHealthPoll(false)));
+    EXPECT_EQ(attempts, 2);
+    EXPECT_EQ(result.second, done.second);
+    // Resending a clearStatus poll could lose the changes it cleared
+    attempts = 0;
+    send({timeout, done}, isIdempotent(makeHealthPoll(true)));
+    EXPECT_EQ(attempts, 1);
+}
+
+TEST_F(RetryPolicyTest, Budget)
+{
+    setBudgetCapacity(1);
+    auto& budget = registerEndpoint(eid);
+    Result badCrc(boost::system::error_code(), {0x84, 0x88});
+    send({badCrc});
+    EXPECT_EQ(attempts, 2);
+    EXPECT_EQ(budget.getExhausted(), 1);
+
+    auto now = std::chrono::steady_clock::now();
+    EXPECT_FALSE(budget.consume(now));
+    EXPECT_TRUE(budget.consume(now + Budget::refillInterval));
+}
+
+TEST_F(RetryPolicyTest, Unregistered)
+{
+    Result badCrc(boost::system::error_code(), {0x84, 0x88});
+    send({badCrc});
+    EXPECT_EQ(attempts, 1);
+}
@@ -0,0 +1,110 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../rtt_estimator.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+TEST(RttEstimator, InitialAndLimits)
+{
+    nvmemi::RttEstimator estimator(100ms, 20ms, 1000ms);
+    EXPECT_EQ(estimator.getTimeout(), 100ms);
+    nvmemi::RttEstimator lowInitial(5ms, 20ms, 1000ms);
+    EXPECT_EQ(lowInitial.getTimeout(), 20ms);
+
+    // First sample. RTO = R + 4 * R/2 = 3R
+    estimator.addSample(4ms);
+    EXPECT_EQ(estimator.getSmoothedRtt(), 4ms);
+    EXPECT_EQ(estimator.getRttVariation(), 2ms);
+    EXPECT_EQ(estimator.getTimeout(), 20ms);
+
+    // Slow response drives the timeout to the ceiling
+    estimator.addSample(5000ms);
+    EXPECT_EQ(estimator.getTimeout(), 1000ms);
+}
+
+TEST(RttEstimator, Converge)
+{
+    nvmemi::RttEstimator estimator(600ms, 50ms, 3000ms);
+    for (int i = 0; i < 100; i++)
+    {
+        estimator.addSample(30ms);
+    }
+    EXPECT_EQ(estimator.getSmoothedRtt(), 30ms);
+    EXPECT_LT(estimator.getRttVariation(), 1ms);
+    EXPECT_EQ(estimator.getTimeout(), 50ms);
+
+    for (int i = 0; i < 100; i++)
+    {
+        estimator.addSample(400ms);
+    }
+    EXPECT_GE(estimator.getTimeout(), 400ms);
+    EXPECT_LT(estimator.getTimeout(), 500ms);
+}
+
+TEST(RttEstimator, Granularity)
+{
+    // Steady response times keep a margin over the smoothed response time
+    nvmemi::RttEstimator estimator(100ms, 20ms, 1000ms);
+    for (int i = 0; i < 100; i++)
+    {
+        estimator.addSample(100ms);
+    }
+    EXPECT_LT(estimator.getRttVariation(), 1ms);
+    EXPECT_EQ(estimator.getTimeout(), 110ms);
+}
+
+TEST(RttEstimator, Backoff)
+{
+    nvmemi::RttEstimator estimator(100ms, 20ms, 1000ms);
+    estimator.addSample(10ms);
+    EXPECT_EQ(estimator.getTimeout(), 30ms);
+    estimator.onTimeout();
+    EXPECT_EQ(estimator.getTimeout(), 60ms);
+    estimator.onTimeout();
+    estimator.onTimeout();
+    estimator.onTimeout();
+    estimator.onTimeout();
+    EXPECT_EQ(estimator.getTimeout(), 960ms);
+    estimator.onTimeout();
+    EXPECT_EQ(estimator.getTimeout(), 1000ms);
+    // Next response recomputes the timeout from the estimate
+    estimator.addSample(10ms);
+    EXPECT_LT(estimator.getTimeout(), 100ms);
+}
+
+TEST(RttEstimator, Registry)
+{
+    using nvmemi::timeouts::ResponseClass;
+    constexpr mctpw::eid_t eid = 20;
+    EXPECT_EQ(nvmemi::timeouts::getEstimator(eid, ResponseClass::logPage),
+              nullptr);
+    EXPECT_EQ(nvmemi::timeouts::getTimeout(eid, ResponseClass::logPage),
+              3000ms);
+    nvmemi::timeouts::registerEndpoint(eid);
+    auto estimator =
+        nvmemi::timeouts::getEstimator(eid, ResponseClass::healthPoll);
+    ASSERT_NE(estimator, nullptr);
+    estimator->addSample(5ms);
+    EXPECT_EQ(nvmemi::timeouts::getTimeout(eid, ResponseClass::healthPoll),
+              20ms);
+    EXPECT_EQ(nvmemi::timeouts::getTimeout(eid, ResponseClass::normal),
+              600ms);
+    nvmemi::timeouts::unregisterEndpoint(eid);
+    EXPECT_EQ(nvmemi::timeouts::getTimeout(eid, ResponseClass::healthPoll),
+              100ms);
+}
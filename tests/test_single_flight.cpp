@@ -0,0 +1,140 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../single_flight.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <gtest/gtest.h>
+
+using nvmemi::singleflight::Result;
+
+// Admin request with the second byte of dword 10 set and a CRC placeholder
+static std::vector<uint8_t> makeAdminRequest(uint8_t opCode, uint8_t dword10b1)
+{
+    std::vector<uint8_t> request(4 + 64 + 4, 0x00);
+    request[0] = 0x84;
+    request[1] = 0x10;
+    request[4] = opCode;
+    request[4 + 40 + 1] = dword10b1;
+    return request;
+}
+
+class SingleFlightTest : public ::testing::Test
+{
+  protected:
+    void send(mctpw::eid_t eid, const std::vector<uint8_t>& request)
+    {
+        boost::asio::spawn(ioContext, [this, eid,
+                                       request](boost::asio::yield_context
+                                                    yield) {
+            auto result = nvmemi::singleflight::run(
+                eid, request, yield,
+                [this, eid](boost::asio::yield_context flightYield) {
+                    transactions++;
+                    boost::asio::steady_timer timer(ioContext);
+                    timer.expires_after(std::chrono::milliseconds(10));
+                    timer.async_wait(flightYield);
+                    return Result(boost::system::error_code(),
+                                  {eid, static_cast<uint8_t>(transactions)});
+                });
+            results.emplace_back(result.second);
+        });
+    }
+
+    boost::asio::io_context ioContext;
+    size_t transactions = 0;
+    std::vector<std::vector<uint8_t>> results;
+};
+
+TEST_F(SingleFlightTest, Shareable)
+{
+    EXPECT_TRUE(nvmemi::singleflight::isShareable(makeAdminRequest(0x06, 0)));
+    EXPECT_TRUE(
+        nvmemi::singleflight::isShareable(makeAdminRequest(0x02, 0x80)));
+    EXPECT_FALSE(nvmemi::singleflight::isShareable(makeAdminRequest(0x02, 0)));
+    EXPECT_FALSE(nvmemi::singleflight::isShareable(makeAdminRequest(0x09, 0)));
+    std::vector<uint8_t> healthPoll = {0x84, 0x08, 0x00, 0x00, 0x01, 0x00,
+                                       0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                       0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                       0x00, 0x00};
+    EXPECT_FALSE(nvmemi::singleflight::isShareable(healthPoll));
+}
+
+TEST_F(SingleFlightTest, Share)
+{
+    auto identify = makeAdminRequest(0x06, 0);
+    auto sharedBefore = nvmemi::singleflight::getSharedCount();
+    send(10, identify);
+    send(10, identify);
+    send(10, identify);
+    ioContext.run();
+    EXPECT_EQ(transactions, 1);
+    ASSERT_EQ(results.size(), 3);
+    EXPECT_EQ(results[0], results[1]);
+    EXPECT_EQ(results[0], results[2]);
+    EXPECT_EQ(nvmemi::singleflight::getSharedCount() - sharedBefore, 2);
+
+    // Finished flights are not reused
+    ioContext.restart();
+    send(10, identify);
+    ioContext.run();
+    EXPECT_EQ(transactions, 2);
+}
+
+TEST_F(SingleFlightTest, Separate)
+{
+    auto identify = makeAdminRequest(0x06, 0);
+    auto otherIdentify = makeAdminRequest(0x06, 0);
+    otherIdentify[4 + 40] = 0x01;
+    send(10, identify);
+    send(11, identify);
+    send(10, otherIdentify);
+    send(10, makeAdminRequest(0x02, 0));
+    send(10, makeAdminRequest(0x02, 0));
+    ioContext.run();
+    EXPECT_EQ(transactions, 5);
+}
+
+TEST_F(SingleFlightTest, Error)
+{
+    size_t errors = 0;
+    auto identify = makeAdminRequest(0x06, 0);
+    for (size_t idx = 0; idx < 2; idx++)
+    {
+        boost::asio::spawn(ioContext, [&](boost::asio::yield_context yield) {
+            try
+            {
+                nvmemi::singleflight::run(
+                    99, identify, yield,
+                    [this](boost::asio::yield_context flightYield) -> Result {
+                        transactions++;
+                        boost::asio::steady_timer timer(ioContext);
+                        timer.expires_after(std::chrono::milliseconds(10));
+                        timer.async_wait(flightYield);
+                        throw std::runtime_error("Transaction failed");
+                    });
+            }
+            catch (const std::runtime_error&)
+            {
+                errors++;
+            }
+        });
+    }
+    ioContext.run();
+    EXPECT_EQ(transactions, 1);
+    EXPECT_EQ(errors, 2);
+}
@@ -0,0 +1,213 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../mctp_socket_transport.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include <gtest/gtest.h>
+
+/**
+ * @brief Local stand-in for the MCTP socket. Messages are framed as
+ * [EID][tag][message] on one end of a socketpair.
+ *
+ */
+class FramedSocket : public nvmemi::MessageSocket
+{
+  public:
+    explicit FramedSocket(int socketFd) : fd(socketFd)
+    {
+    }
+    ~FramedSocket() override
+    {
+        close(fd);
+    }
+    int getFd() const override
+    {
+        return fd;
+    }
+    boost::system::error_code allocateTag(mctpw::eid_t eid,
+                                          uint8_t& tag) override
+    {
+        // Tags are handed out in turn like the kernel does, so a late
+        // response does not match the next request
+        for (size_t idx = 0; idx < 8; idx++)
+        {
+            tag = nextTag[eid];
+            nextTag[eid] = (tag + 1) % 8;
+            if ((tags[eid] & (1 << tag)) == 0)
+            {
+                tags[eid] |= static_cast<uint8_t>(1 << tag);
+                return {};
+            }
+        }
+        return boost::system::errc::make_error_code(
+            boost::system::errc::resource_unavailable_try_again);
+    }
+    void releaseTag(mctpw::eid_t eid, uint8_t tag) override
+    {
+        tags[eid] &= static_cast<uint8_t>(~(1 << tag));
+    }
+    boost::system::error_code
+        send(mctpw::eid_t eid, uint8_t tag,
+             const std::vector<uint8_t>& message) override
+    {
+        std::vector<uint8_t> frame{eid, tag};
+        frame.insert(frame.end(), message.begin(), message.end());
+        if (::send(fd, frame.data(), frame.size(), 0) < 0)
+        {
+            return {errno, boost::system::system_category()};
+        }
+        return {};
+    }
+    boost::system::error_code receive(mctpw::eid_t& eid, uint8_t& tag,
+                                      std::vector<uint8_t>& message) override
+    {
+        std::vector<uint8_t> frame(1024);
+        ssize_t len = ::recv(fd, frame.data(), frame.size(), MSG_DONTWAIT);
+        if (len < 2)
+        {
+            return {errno, boost::system::system_category()};
+        }
+        eid = frame[0];
+        tag = frame[1];
+        message.assign(frame.begin() + 2, frame.begin() + len);
+        return {};
+    }
+
+    std::array<uint8_t, 256> tags{};
+
+  private:
+    std::array<uint8_t, 256> nextTag{};
+    int fd;
+};
+
+using Frame = std::vector<uint8_t>;
+
+class SocketTransportTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        std::array<int, 2> fds{};
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0,
+                             fds.data()),
+                  0);
+        peer = fds[1];
+        auto socket = std::make_unique<FramedSocket>(fds[0]);
+        framed = socket.get();
+        transport = std::make_shared<nvmemi::SocketTransport>(
+            ioContext, std::move(socket));
+    }
+    void TearDown() override
+    {
+        transport.reset();
+        close(peer);
+    }
+    Frame readRequest()
+    {
+        Frame frame(1024);
+        ssize_t len = ::recv(peer, frame.data(), frame.size(), MSG_DONTWAIT);
+        frame.resize(len < 0 ? 0 : static_cast<size_t>(len));
+        return frame;
+    }
+    void writeResponse(const Frame& frame)
+    {
+        ASSERT_EQ(::send(peer, frame.data(), frame.size(), 0),
+                  static_cast<ssize_t>(frame.size()));
+    }
+
+    boost::asio::io_context ioContext;
+    std::shared_ptr<nvmemi::SocketTransport> transport;
+    FramedSocket* framed = nullptr;
+    int peer = -1;
+};
+
+TEST_F(SocketTransportTest, MatchByTag)
+{
+    static constexpr std::chrono::milliseconds timeout(1000);
+    std::vector<std::vector<uint8_t>> responses(2);
+    for (uint8_t idx = 0; idx < 2; idx++)
+    {
+        boost::asio::spawn(ioContext, [&, idx](
+                                          boost::asio::yield_context yield) {
+            auto [ec, response] =
+                transport->sendReceive(yield, 10, {0x84, idx}, timeout);
+            EXPECT_FALSE(ec);
+            responses[idx] = response;
+        });
+    }
+    // Both requests are sent before the peer answers them in reverse order
+    boost::asio::spawn(ioContext, [&](boost::asio::yield_context yield) {
+        boost::asio::post(ioContext, yield);
+        Frame first = readRequest();
+        Frame second = readRequest();
+        ASSERT_EQ(first, (Frame{10, 0, 0x84, 0}));
+        ASSERT_EQ(second, (Frame{10, 1, 0x84, 1}));
+        writeResponse({10, 1, 0x84, 0xB1});
+        writeResponse({10, 0, 0x84, 0xB0});
+    });
+    ioContext.run();
+    EXPECT_EQ(responses[0], (std::vector<uint8_t>{0x84, 0xB0}));
+    EXPECT_EQ(responses[1], (std::vector<uint8_t>{0x84, 0xB1}));
+    EXPECT_EQ(framed->tags[10], 0);
+}
+
+TEST_F(SocketTransportTest, MatchByEid)
+{
+    static constexpr std::chrono::milliseconds timeout(1000);
+    std::vector<uint8_t> response;
+    boost::asio::spawn(ioContext, [&](boost::asio::yield_context yield) {
+        boost::system::error_code ec;
+        std::tie(ec, response) =
+            transport->sendReceive(yield, 11, {0x84, 0x01}, timeout);
+        EXPECT_FALSE(ec);
+    });
+    boost::asio::spawn(ioContext, [&](boost::asio::yield_context yield) {
+        boost::asio::post(ioContext, yield);
+        ASSERT_EQ(readRequest(), (Frame{11, 0, 0x84, 0x01}));
+        // Same tag from another EID is not a response to the request
+        writeResponse({12, 0, 0x84, 0xEE});
+        writeResponse({11, 0, 0x84, 0xAA});
+    });
+    ioContext.run();
+    EXPECT_EQ(response, (std::vector<uint8_t>{0x84, 0xAA}));
+}
+
+TEST_F(SocketTransportTest, Timeout)
+{
+    static constexpr std::chrono::milliseconds timeout(20);
+    bool done = false;
+    boost::asio::spawn(ioContext, [&](boost::asio::yield_context yield) {
+        auto [ec, response] =
+            transport->sendReceive(yield, 10, {0x84, 0x01}, timeout);
+        EXPECT_EQ(ec, boost::system::errc::timed_out);
+        EXPECT_TRUE(response.empty());
+        // Tag is released, a late response is dropped
+        EXPECT_EQ(framed->tags[10], 0);
+        writeResponse({10, 0, 0x84, 0xAA});
+        std::tie(ec, response) =
+            transport->sendReceive(yield, 10, {0x84, 0x02}, timeout);
+        EXPECT_EQ(ec, boost::system::errc::timed_out);
+        done = true;
+    });
+    ioContext.run();
+    EXPECT_TRUE(done);
+}
@@ -0,0 +1,43 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../utils.hpp"
+
+#include <regex>
+
+#include <gtest/gtest.h>
+
+TEST(Utils, SanitizeName)
+{
+    EXPECT_EQ(nvmemi::utils::sanitizeName("NVMeDrive1"), "NVMeDrive1");
+    EXPECT_EQ(nvmemi::utils::sanitizeName("NVMe_Slot 1"), "NVMe_Slot_1");
+    EXPECT_EQ(nvmemi::utils::sanitizeName("NVMe_Bay #2 - Front"),
+              "NVMe_Bay_2_Front");
+    EXPECT_EQ(nvmemi::utils::sanitizeName(""), "");
+    EXPECT_EQ(nvmemi::utils::sanitizeName("..."), "_");
+}
+
+TEST(Utils, SanitizeNameMatchesRegex)
+{
+    // Names used to be sanitized with this regex
+    const std::regex illegal("[^a-zA-Z0-9_/]+");
+    for (const char* name :
+         {"NVMe_Riser1/Slot-3", "a..b  c", " lead", "trail ",
+          "\xC3\xA9t\xC3\xA9", "x_y/z", "--", "tab\there"})
+    {
+        EXPECT_EQ(nvmemi::utils::sanitizeName(name),
+                  std::regex_replace(name, illegal, "_"));
+    }
+}
@@ -0,0 +1,56 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "../worker_pool.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+TEST(WorkerPool, Offload)
+{
+    boost::asio::io_context ioContext;
+    auto ioThread = std::this_thread::get_id();
+    nvmemi::workers::start(2);
+    bool done = false;
+    boost::asio::spawn(ioContext, [&](boost::asio::yield_context yield) {
+        auto workerThread = nvmemi::workers::offload(
+            yield, []() { return std::this_thread::get_id(); });
+        EXPECT_NE(workerThread, ioThread);
+        // Coroutine resumes on the io_context thread
+        EXPECT_EQ(std::this_thread::get_id(), ioThread);
+        EXPECT_THROW(nvmemi::workers::offload(
+                         yield,
+                         []() -> int { throw std::runtime_error("failed"); }),
+                     std::runtime_error);
+        done = true;
+    });
+    ioContext.run();
+    EXPECT_TRUE(done);
+    nvmemi::workers::stop();
+}
+
+TEST(WorkerPool, Inline)
+{
+    boost::asio::io_context ioContext;
+    auto ioThread = std::this_thread::get_id();
+    boost::asio::spawn(ioContext, [&](boost::asio::yield_context yield) {
+        auto thread = nvmemi::workers::offload(
+            yield, []() { return std::this_thread::get_id(); });
+        EXPECT_EQ(thread, ioThread);
+    });
+    ioContext.run();
+}
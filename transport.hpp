@@ -0,0 +1,76 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <boost/asio/spawn.hpp>
+#include <chrono>
+#include <cstdint>
+#include <mctp_wrapper.hpp>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace nvmemi
+{
+/**
+ * @brief Request/response transport to the MCTP endpoints. Requests and
+ * responses start with the MCTP message type byte.
+ *
+ */
+class Transport
+{
+  public:
+    virtual ~Transport() = default;
+    /**
+     * @brief Send a request and suspend the coroutine until the response
+     * arrives or the timeout expires
+     *
+     * @param yield yield_context of the calling coroutine
+     * @param eid MCTP EID the request is sent to
+     * @param request Request message
+     * @param timeout Time to wait for the response
+     * @return Error code and the response message
+     */
+    virtual std::pair<boost::system::error_code, std::vector<uint8_t>>
+        sendReceive(boost::asio::yield_context yield, mctpw::eid_t eid,
+                    const std::vector<uint8_t>& request,
+                    std::chrono::milliseconds timeout) = 0;
+};
+
+/**
+ * @brief Transport through mctpd using the MCTP wrapper library
+ *
+ */
+class MctpwTransport : public Transport
+{
+  public:
+    explicit MctpwTransport(std::shared_ptr<mctpw::MCTPWrapper> mctpWrapper) :
+        wrapper(std::move(mctpWrapper))
+    {
+    }
+
+    std::pair<boost::system::error_code, std::vector<uint8_t>>
+        sendReceive(boost::asio::yield_context yield, mctpw::eid_t eid,
+                    const std::vector<uint8_t>& request,
+                    std::chrono::milliseconds timeout) override
+    {
+        return wrapper->sendReceiveYield(yield, eid, request, timeout);
+    }
+
+  private:
+    std::shared_ptr<mctpw::MCTPWrapper> wrapper;
+};
+} // namespace nvmemi
@@ -0,0 +1,51 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace nvmemi::utils
+{
+/**
+ * @brief Make a name usable as part of a DBus object path. Every run of
+ * characters other than [a-zA-Z0-9_/] is replaced with a single '_'.
+ *
+ * @param name Human readable name
+ * @return std::string Sanitized name
+ */
+inline std::string sanitizeName(std::string_view name)
+{
+    std::string sanitized;
+    sanitized.reserve(name.size());
+    bool replacing = false;
+    for (char c : name)
+    {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '_' || c == '/')
+        {
+            sanitized.push_back(c);
+            replacing = false;
+        }
+        else if (!replacing)
+        {
+            sanitized.push_back('_');
+            replacing = true;
+        }
+    }
+    return sanitized;
+}
+} // namespace nvmemi::utils
@@ -0,0 +1,45 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "worker_pool.hpp"
+
+namespace nvmemi::workers
+{
+static std::unique_ptr<boost::asio::thread_pool> pool{};
+
+void start(size_t threads)
+{
+    stop();
+    if (threads != 0)
+    {
+        pool = std::make_unique<boost::asio::thread_pool>(threads);
+    }
+}
+
+void stop()
+{
+    if (pool)
+    {
+        pool->join();
+        pool.reset();
+    }
+}
+
+boost::asio::thread_pool* getPool()
+{
+    return pool.get();
+}
+} // namespace nvmemi::workers
@@ -0,0 +1,94 @@
+/*
+// Copyright (c) 2021 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#pragma once
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/spawn.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+namespace nvmemi::workers
+{
+/**
+ * @brief Start the worker threads for CPU heavy work. DBus and MCTP traffic
+ * stay on the io_context thread.
+ *
+ * @param threads Number of worker threads. 0 runs the work inline.
+ */
+void start(size_t threads);
+/**
+ * @brief Wait for the queued work and join the worker threads
+ *
+ */
+void stop();
+boost::asio::thread_pool* getPool();
+
+/**
+ * @brief Run a function on a worker thread and suspend the coroutine until
+ * it is done. Runs the function inline if no worker threads are started.
+ * The function must not touch state owned by the io_context thread.
+ *
+ * @param yield yield_context of the calling coroutine
+ * @param fn Function to run
+ * @return Result of the function. Exceptions are rethrown in the caller.
+ */
+template <typename Fn>
+std::invoke_result_t<Fn> offload(boost::asio::yield_context yield, Fn&& fn)
+{
+    using Result = std::invoke_result_t<Fn>;
+    boost::asio::thread_pool* pool = getPool();
+    if (pool == nullptr)
+    {
+        return fn();
+    }
+    auto result = std::make_shared<std::optional<Result>>();
+    auto error = std::make_shared<std::exception_ptr>();
+    // fn lives on the suspended coroutine stack until the handler resumes it
+    boost::asio::async_initiate<boost::asio::yield_context,
+                                void(boost::system::error_code)>(
+        [pool, &fn, result, error](auto handler) {
+            auto work = boost::asio::make_work_guard(handler);
+            boost::asio::post(*pool, [handler = std::move(handler),
+                                      work = std::move(work), &fn, result,
+                                      error]() mutable {
+                try
+                {
+                    result->emplace(fn());
+                }
+                catch (...)
+                {
+                    *error = std::current_exception();
+                }
+                auto executor = work.get_executor();
+                boost::asio::post(executor,
+                                  [handler = std::move(handler)]() mutable {
+                                      handler(boost::system::error_code());
+                                  });
+            });
+        },
+        yield);
+    if (*error)
+    {
+        std::rethrow_exception(*error);
+    }
+    return std::move(**result);
+}
+} // namespace nvmemi::workers